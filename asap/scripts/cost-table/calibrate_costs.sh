@@ -0,0 +1,169 @@
+#!/bin/bash
+
+# Measures the cost of sanitizer callbacks and inline checks on this machine,
+# in cycles, and writes a cost table for `opt -asap-cost-table=...`.
+#
+# Usage: calibrate_costs.sh [output_file]
+#
+# Each measurement runs a small kernel in a loop, built once without and once
+# with some instrumentation, and linked against libFuzzer with FUSS, so that
+# callbacks do the same work as while fuzzing. The difference in cycles per
+# iteration is the cost of the instrumentation. Set ITERATIONS to trade
+# accuracy for time.
+#
+# ASan's inline checks are keyed by the function they call when they fail,
+# e.g. __asan_report_load4; ASAP charges that cost once per execution of the
+# whole check. The fast path is the same for all access sizes up to 16 bytes,
+# except for an extra comparison when the shadow byte is non-zero, so the
+# 4-byte measurements stand in for all sizes.
+
+set -e
+set -o pipefail
+
+OUTPUT="$(readlink -f "${1:-cost-table.txt}")"
+ITERATIONS="${ITERATIONS:-100000000}"
+WORK_DIR="$(mktemp -d calibrate-costs.XXXXXX)"
+FUZZER_SRC="$(llvm-config --src-root)/lib/Fuzzer"
+
+cd "$WORK_DIR"
+
+cat > kernels.c <<'EOF'
+#include <stdint.h>
+
+volatile uint32_t sink;
+volatile uint32_t divisor = 3;
+
+// One basic block, and one 64-bit comparison, per iteration.
+__attribute__((noinline)) void kernel_blocks(uint32_t *p, uint64_t n) {
+  for (uint64_t i = 0; i < n; ++i) {
+    __asm__ volatile("");
+  }
+}
+
+// Like kernel_blocks, plus one 32-bit comparison per iteration.
+__attribute__((noinline)) void kernel_cmp4(uint32_t *p, uint64_t n) {
+  uint32_t v = sink;
+  for (uint64_t i = 0; i < n; ++i) {
+    __asm__ volatile("" : "+r"(v));
+    sink = (v == 42);
+  }
+}
+
+// Like kernel_blocks, plus one 32-bit division per iteration.
+__attribute__((noinline)) void kernel_div4(uint32_t *p, uint64_t n) {
+  uint32_t v = sink;
+  for (uint64_t i = 0; i < n; ++i) {
+    __asm__ volatile("" : "+r"(v));
+    sink = v / divisor;
+  }
+}
+
+// Like kernel_blocks, plus one 4-byte load per iteration.
+__attribute__((noinline)) void kernel_load(uint32_t *p, uint64_t n) {
+  uint32_t sum = 0;
+  for (uint64_t i = 0; i < n; ++i) {
+    sum += p[i & 63];
+  }
+  sink = sum;
+}
+
+// Like kernel_blocks, plus one 4-byte store per iteration.
+__attribute__((noinline)) void kernel_store(uint32_t *p, uint64_t n) {
+  for (uint64_t i = 0; i < n; ++i) {
+    p[i & 63] = (uint32_t)i;
+  }
+}
+EOF
+
+cat > driver.c <<'EOF'
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+
+void KERNEL(uint32_t *p, uint64_t n);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  uint32_t *p = calloc(64, sizeof(uint32_t));
+  uint64_t best = UINT64_MAX;
+  for (int rep = 0; rep < 5; ++rep) {
+    uint64_t start = __rdtsc();
+    KERNEL(p, ITERATIONS);
+    uint64_t cycles = __rdtsc() - start;
+    if (cycles < best)
+      best = cycles;
+  }
+  printf("cycles %f\n", (double)best / ITERATIONS);
+  free(p);
+  exit(0);
+}
+EOF
+
+# Build libFuzzer with FUSS.
+mkdir Fuzzer-fuss-build
+for i in "$FUZZER_SRC"/*.cpp; do
+  clang++ -O2 -g -std=c++11 -DFUSS -c "$i" -I"$FUZZER_SRC" -o "Fuzzer-fuss-build/$(basename "$i" .cpp).o" &
+done
+wait
+
+# measure <kernel> <flags...>: prints cycles per iteration of the kernel,
+# instrumented with the given flags.
+measure() {
+  local kernel="$1"
+  shift
+  clang -O2 "$@" -c kernels.c -o kernels.o
+  clang -O2 -DKERNEL="$kernel" -DITERATIONS="${ITERATIONS}ULL" -c driver.c -o driver.o
+  clang++ "$@" kernels.o driver.o Fuzzer-fuss-build/*.o -o bench
+  ./bench -runs=1 2>/dev/null | sed -n 's/^cycles //p'
+}
+
+# cost <name> <cycles>: writes a table entry, rounded to whole cycles. Every
+# measured cost is at least one cycle.
+cost() {
+  awk -v name="$1" -v cycles="$2" \
+    'BEGIN { c = int(cycles + 0.5); if (c < 1) c = 1; print name, c }' >> "$OUTPUT"
+}
+
+GUARD="-fsanitize-coverage=trace-pc-guard"
+
+echo "Measuring trace-pc-guard..."
+blocks_base="$(measure kernel_blocks)"
+blocks_guard="$(measure kernel_blocks $GUARD)"
+blocks_cmp="$(measure kernel_blocks $GUARD,trace-cmp)"
+
+echo "Measuring trace-cmp..."
+cmp4_guard="$(measure kernel_cmp4 $GUARD)"
+cmp4_cmp="$(measure kernel_cmp4 $GUARD,trace-cmp)"
+
+echo "Measuring trace-div..."
+div4_guard="$(measure kernel_div4 $GUARD)"
+div4_div="$(measure kernel_div4 $GUARD,trace-div)"
+
+echo "Measuring ASan checks..."
+load_base="$(measure kernel_load)"
+load_asan="$(measure kernel_load -fsanitize=address)"
+store_base="$(measure kernel_store)"
+store_asan="$(measure kernel_store -fsanitize=address)"
+
+cat > "$OUTPUT" <<EOF
+# Instrumentation costs in cycles, measured by calibrate_costs.sh
+# Host: $(hostname), $(grep -m1 'model name' /proc/cpuinfo | cut -d: -f2 | sed 's/^ *//')
+# Date: $(date -u +%Y-%m-%d)
+EOF
+cmp8="$(echo "$blocks_cmp - $blocks_guard" | bc -l)"
+cost __sanitizer_cov_trace_pc_guard "$(echo "$blocks_guard - $blocks_base" | bc -l)"
+cost __sanitizer_cov_trace_cmp8 "$cmp8"
+cost __sanitizer_cov_trace_cmp4 "$(echo "$cmp4_cmp - $cmp4_guard - $cmp8" | bc -l)"
+cost __sanitizer_cov_trace_div4 "$(echo "$div4_div - $div4_guard" | bc -l)"
+asan_load="$(echo "$load_asan - $load_base" | bc -l)"
+asan_store="$(echo "$store_asan - $store_base" | bc -l)"
+for size in 1 2 4 8 16; do
+  for suffix in "" _noabort; do
+    cost "__asan_report_load$size$suffix" "$asan_load"
+    cost "__asan_report_store$size$suffix" "$asan_store"
+  done
+done
+
+cd ..
+rm -rf "$WORK_DIR"
+echo "Wrote $OUTPUT"
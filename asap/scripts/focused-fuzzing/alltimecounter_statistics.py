@@ -7,8 +7,8 @@ import argparse
 import re
 import sys
 
-# AllTimeCounter: 0x51dcbe 123 2
-ALLTIMECOUNTER_RE = re.compile(r'^AllTimeCounter: (0x[0-9a-f]+) .* (\d+)$')
+# AllTimeCounter: 0x51dcbe 123 2 [0x8f3c02e1d4a9b7c5]
+ALLTIMECOUNTER_RE = re.compile(r'^AllTimeCounter: (0x[0-9a-f]+) \d+ (\d+)( 0x[0-9a-f]+)?$')
 
 def extract_pcs_and_costs(log):
     """Extracts PCs and their cost (i.e., counter values) from a fuzzer log."""
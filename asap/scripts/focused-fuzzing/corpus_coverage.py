@@ -13,8 +13,8 @@ import re
 import subprocess
 import sys
 
-# AllTimeCounter: 0x51dcbe 123 2
-ALLTIMECOUNTER_RE = re.compile(r'^AllTimeCounter: (0x[0-9a-f]+) .* (\d+)$')
+# AllTimeCounter: 0x51dcbe 123 2 [0x8f3c02e1d4a9b7c5]
+ALLTIMECOUNTER_RE = re.compile(r'^AllTimeCounter: (0x[0-9a-f]+) \d+ (\d+)( 0x[0-9a-f]+)?$')
 
 def covered_pcs(fuzzer, testcase):
     """Computes the set of PCs covered by a given testcase."""
@@ -0,0 +1,68 @@
+#!/bin/bash
+
+# Measures how long `opt -asap-coverage` takes to load coverage and match it
+# to `trace_pc_guard` calls, on a large generated module.
+#
+# Usage: coverage_cost_compile_time.sh [n_functions] [n_blocks_per_function]
+#
+# The generated fuzz target has n_functions functions with
+# n_blocks_per_function covered blocks each. Run the script with different
+# versions of ASAP's opt in $PATH to compare them. Pass
+# CFLAGS="-mllvm -sanitizer-coverage-check-ids" to measure lookups by check
+# ID instead of by debug location.
+
+set -e
+set -o pipefail
+
+N_FUNCTIONS="${1:-200}"
+N_BLOCKS="${2:-200}"
+WORK_DIR="$(mktemp -d coverage-cost-compile-time.XXXXXX)"
+FUZZER_SRC="$(llvm-config --src-root)/lib/Fuzzer"
+TARGET_CFLAGS="-O1 -g -fsanitize=address -fsanitize-coverage=trace-pc-guard $CFLAGS"
+
+cd "$WORK_DIR"
+
+# Generate a fuzz target where every block is covered by an input of zeros.
+python3 - "$N_FUNCTIONS" "$N_BLOCKS" > target.c <<'PYTHON'
+import sys
+n_functions, n_blocks = int(sys.argv[1]), int(sys.argv[2])
+print('#include <stddef.h>')
+print('#include <stdint.h>')
+for f in range(n_functions):
+    print('__attribute__((noinline)) int f%d(const uint8_t *d, size_t n) {' % f)
+    print('  int r = 0;')
+    for b in range(n_blocks):
+        print('  if (n > %d && d[%d] == 0) r += d[%d];' % (b, b, (b + 1) % n_blocks))
+    print('  return r;')
+    print('}')
+print('int LLVMFuzzerTestOneInput(const uint8_t *d, size_t n) {')
+print('  int r = 0;')
+for f in range(n_functions):
+    print('  r += f%d(d, n);' % f)
+print('  return r;')
+print('}')
+PYTHON
+head -c "$N_BLOCKS" /dev/zero > input
+
+# Build libFuzzer with FUSS, and the target.
+mkdir Fuzzer-fuss-build
+for i in "$FUZZER_SRC"/*.cpp; do
+  clang++ -O2 -g -std=c++11 -DFUSS -c "$i" -I"$FUZZER_SRC" -o "Fuzzer-fuss-build/$(basename "$i" .cpp).o" &
+done
+wait
+clang $TARGET_CFLAGS -c target.c -o target.o
+clang $TARGET_CFLAGS -flto -c target.c -o target.bc
+clang++ -fsanitize=address -fsanitize-coverage=trace-pc-guard target.o Fuzzer-fuss-build/*.o -o fuzzer
+
+# Obtain coverage, and time the cost analysis.
+./fuzzer -runs=100 -print_final_stats=1 input > coverage.log 2>&1
+echo "Covered locations: $(grep -c '^AllTimeCounter:' coverage.log)"
+echo "trace_pc_guard calls: $(llvm-dis < target.bc | grep -c 'call void @__sanitizer_cov_trace_pc_guard')"
+/usr/bin/time -f "opt -asap-coverage: %e s, %M KB" \
+  opt -asap-coverage -asap-cost-threshold=1000 \
+  -asap-module-name="$PWD/fuzzer" -asap-coverage-file="$PWD/coverage.log" \
+  -o /dev/null target.bc 2> opt.log || { cat opt.log; exit 1; }
+tail -n 1 opt.log
+
+cd ..
+rm -rf "$WORK_DIR"
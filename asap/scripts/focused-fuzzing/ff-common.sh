@@ -35,7 +35,7 @@ DEFAULT_LDFLAGS=""
 #       - fperf:  with fuss, and costs from perf
 #       - fprec:  with fuss, and costs from tpcg counters
 
-TPCG_CFLAGS="-fsanitize-coverage=trace-pc-guard"
+TPCG_CFLAGS="-fsanitize-coverage=trace-pc-guard -mllvm -sanitizer-coverage-check-ids -mllvm -sanitizer-coverage-guard-table"
 TPCG_LDFLAGS="-fsanitize-coverage=trace-pc-guard"
 
 ASAN_CFLAGS="-fsanitize=address $TPCG_CFLAGS"
@@ -577,6 +577,25 @@ private:
   /// Emit GlobalAlias or GlobalIFunc.
   void emitGlobalIndirectSymbol(Module &M,
                                 const GlobalIndirectSymbol& GIS);
+
+  /// Address range of the code of a sanity check, delimited by
+  /// SANITY_CHECK_LABEL instructions.
+  struct SanityCheckRange {
+    uint64_t CheckID;
+    MCSymbol *Begin;
+    MCSymbol *End;
+  };
+
+  /// Sanity check ranges of the current function.
+  std::vector<SanityCheckRange> SanityCheckRanges;
+
+  /// Emit a label for a SANITY_CHECK_LABEL instruction, which ends the current
+  /// sanity check range and possibly starts a new one.
+  void emitSanityCheckLabel(const MachineInstr *MI);
+
+  /// Emit the sanity check ranges of the current function into the
+  /// __asap_check_ranges section.
+  void emitSanityCheckRanges();
 };
 }
 
@@ -284,6 +284,14 @@ namespace llvm {
   /// the target platform.
   extern char &XRayInstrumentationID;
 
+  /// This pass brackets the machine code of sanity checks with
+  /// SANITY_CHECK_LABEL instructions.
+  extern char &SanityCheckLabelsID;
+
+  /// This pass writes the spill code that sanity checks cause to the file
+  /// given by -asap-spill-cost-output.
+  extern char &SanityCheckSpillCostsID;
+
   /// \brief This pass implements the "patchable-function" attribute.
   extern char &PatchableFunctionID;
 
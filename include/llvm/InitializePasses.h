@@ -71,9 +71,18 @@ void initializeAliasSetPrinterPass(PassRegistry&);
 void initializeAlignmentFromAssumptionsPass(PassRegistry&);
 void initializeAlwaysInlinerLegacyPassPass(PassRegistry&);
 void initializeArgPromotionPass(PassRegistry&);
+void initializeAsapCloneHotCallSitesPass(PassRegistry&);
+void initializeAsapCoverageModulePassPass(PassRegistry&);
 void initializeAsapCoveragePassPass(PassRegistry&);
+void initializeAsapGcovModulePassPass(PassRegistry&);
 void initializeAsapGcovPassPass(PassRegistry&);
+void initializeAsapInputDependencePass(PassRegistry&);
+void initializeAsapMultiversionPass(PassRegistry&);
+void initializeAsapInstrProfModulePassPass(PassRegistry&);
+void initializeAsapInstrProfPassPass(PassRegistry&);
+void initializeAsapModulePassPass(PassRegistry&);
 void initializeAsapPassPass(PassRegistry&);
+void initializeAsapRemoveSafeChecksPass(PassRegistry&);
 void initializeAtomicExpandPass(PassRegistry&);
 void initializeBBVectorizePass(PassRegistry&);
 void initializeBDCELegacyPassPass(PassRegistry &);
@@ -319,10 +328,15 @@ void initializeSROALegacyPassPass(PassRegistry&);
 void initializeSafeStackPass(PassRegistry&);
 void initializeSampleProfileLoaderLegacyPassPass(PassRegistry&);
 void initializeSanitizerCoverageModulePass(PassRegistry&);
+void initializeSanityCheckColdPathsPass(PassRegistry&);
 void initializeSanityCheckCoverageCostPass(PassRegistry&);
 void initializeSanityCheckGcovCostPass(PassRegistry&);
+void initializeSanityCheckInstrProfCostPass(PassRegistry&);
 void initializeSanityCheckInstructionsPass(PassRegistry&);
+void initializeSanityCheckLabelsPass(PassRegistry&);
 void initializeSanityCheckSampledCostPass(PassRegistry&);
+void initializeSanityCheckSpillCostsPass(PassRegistry&);
+void initializeSanityCheckSwitchesPass(PassRegistry&);
 void initializeScalarEvolutionWrapperPassPass(PassRegistry&);
 void initializeScalarizerPass(PassRegistry&);
 void initializeScopedNoAliasAAWrapperPassPass(PassRegistry&);
@@ -53,4 +53,85 @@ struct AsapCoveragePass : public llvm::FunctionPass, public AsapPassBase {
 
 llvm::FunctionPass *createAsapCoveragePass();
 
+
+// An instantiation of ASAP using cost information from an IR-level
+// instrumentation profile (see SanityCheckInstrProfCost).
+struct AsapInstrProfPass : public llvm::FunctionPass, public AsapPassBase {
+  static char ID;
+
+  AsapInstrProfPass() : FunctionPass(ID) {
+    initializeAsapInstrProfPassPass(*llvm::PassRegistry::getPassRegistry());
+  }
+
+  virtual bool runOnFunction(llvm::Function &F) override;
+
+  virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const override;
+};
+
+llvm::FunctionPass *createAsapInstrProfPass();
+
+
+// Whole-module variants of the above passes. Instead of comparing each check
+// against -asap-cost-threshold, they rank all checks in the module and keep
+// the cheapest ones, according to -asap-cost-level or -asap-sanity-level.
+// This makes them suitable for LTO, where the module is the whole program.
+struct AsapModulePass : public llvm::ModulePass, public AsapPassBase {
+  static char ID;
+
+  AsapModulePass() : ModulePass(ID) {
+    initializeAsapModulePassPass(*llvm::PassRegistry::getPassRegistry());
+  }
+
+  virtual bool runOnModule(llvm::Module &M) override;
+
+  virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const override;
+};
+
+llvm::ModulePass *createAsapModulePass();
+
+
+struct AsapGcovModulePass : public llvm::ModulePass, public AsapPassBase {
+  static char ID;
+
+  AsapGcovModulePass() : ModulePass(ID) {
+    initializeAsapGcovModulePassPass(*llvm::PassRegistry::getPassRegistry());
+  }
+
+  virtual bool runOnModule(llvm::Module &M) override;
+
+  virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const override;
+};
+
+llvm::ModulePass *createAsapGcovModulePass();
+
+
+struct AsapCoverageModulePass : public llvm::ModulePass, public AsapPassBase {
+  static char ID;
+
+  AsapCoverageModulePass() : ModulePass(ID) {
+    initializeAsapCoverageModulePassPass(*llvm::PassRegistry::getPassRegistry());
+  }
+
+  virtual bool runOnModule(llvm::Module &M) override;
+
+  virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const override;
+};
+
+llvm::ModulePass *createAsapCoverageModulePass();
+
+
+struct AsapInstrProfModulePass : public llvm::ModulePass, public AsapPassBase {
+  static char ID;
+
+  AsapInstrProfModulePass() : ModulePass(ID) {
+    initializeAsapInstrProfModulePassPass(*llvm::PassRegistry::getPassRegistry());
+  }
+
+  virtual bool runOnModule(llvm::Module &M) override;
+
+  virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const override;
+};
+
+llvm::ModulePass *createAsapInstrProfModulePass();
+
 #endif
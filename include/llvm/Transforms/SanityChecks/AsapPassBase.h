@@ -4,10 +4,22 @@
 #ifndef LLVM_TRANSFORMS_SANITYCHECKS_ASAPPASSBASE_H
 #define LLVM_TRANSFORMS_SANITYCHECKS_ASAPPASSBASE_H
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/Pass.h"
 
 namespace llvm {
+class BasicBlock;
+class BranchInst;
+class DominatorTree;
+class Function;
 class Instruction;
+class LoopInfo;
+class MDNode;
+class Module;
+class ScalarEvolution;
+class Value;
 }
 
 struct SanityCheckCost;
@@ -18,7 +30,7 @@ struct SanityCheckInstructions;
 // remove expensive ones. Subclasses can parametrize this using, say, different
 // was to compute a check's cost.
 struct AsapPassBase {
-  AsapPassBase() : SCC(0), SCI(0) {}
+  AsapPassBase() : SCC(0), SCI(0), DT(0), LI(0), SE(0) {}
 
 protected:
   // A pass to compute the cost of a sanity check.
@@ -27,11 +39,122 @@ protected:
   // A pass to find instructions that belong to sanity checks.
   SanityCheckInstructions *SCI;
 
-  // Removes expensive checks from the given function.
+  // Analyses used to hoist checks out of loops (-asap-action=hoist).
+  llvm::DominatorTree *DT;
+  llvm::LoopInfo *LI;
+  llvm::ScalarEvolution *SE;
+
+  // Returns true if DT, LI and SE are needed, because checks are hoisted or
+  // redundant checks are removed.
+  bool needsLoopAnalyses() const;
+
+  // Removes checks in F that are dominated by an identical check, with no
+  // intervening writes to memory. Only considers checks listed by FunctionSCC
+  // that don't belong to a group. Adds the removed checks to Removed and
+  // returns their number.
+  size_t removeRedundantChecks(
+      llvm::Function &F, const SanityCheckCost &FunctionSCC,
+      llvm::SmallPtrSetImpl<llvm::Instruction *> &Removed);
+
+  // Returns true if the given check is removed regardless of its cost,
+  // because -asap-prefer-input-dependent is set and the check cannot depend
+  // on program input.
+  bool isRemovedAsInputIndependent(llvm::Instruction *Inst) const;
+
+  // Returns true if checks in hot functions are limited by
+  // -asap-hot-size-budget.
+  bool usesSizeBudget() const;
+
+  // Returns true if F is hot for -asap-hot-size-budget, given the total cost
+  // of its checks.
+  bool isHot(const llvm::Function &F, uint64_t TotalCost) const;
+
+  // Returns the code size of a check, in bytes, measured with
+  // -asap-check-sizes or estimated. This includes instructions of other
+  // checks in its group (see SanityCheckCost).
+  uint64_t getCheckSize(llvm::Instruction *Inst,
+                        const SanityCheckCost &FunctionSCC) const;
+
+  // Removes expensive checks from the given function. Checks that cost less
+  // than -asap-cost-threshold are kept, unless they exceed the function's
+  // -asap-hot-size-budget.
   virtual bool removeExpensiveChecks(llvm::Function &F);
 
-  // Tries to remove a sanity check; returns true if it worked.
-  bool optimizeCheckAway(llvm::Instruction *Inst);
+  // Removes expensive checks from the whole module, such that the remaining
+  // checks match -asap-cost-level or -asap-sanity-level, and the checks in
+  // each hot function fit into -asap-hot-size-budget. GetSCC provides the
+  // cost analysis for a given function; GetFunctionAnalyses sets SCI and the
+  // loop analyses before checks in that function are removed.
+  bool removeExpensiveChecks(
+      llvm::Module &M,
+      llvm::function_ref<SanityCheckCost *(llvm::Function &)> GetSCC,
+      llvm::function_ref<void(llvm::Function &)> GetFunctionAnalyses);
+
+  // Sets SCI and, if needed, the loop analyses for F, from within the module
+  // pass P.
+  template <class PassT>
+  void getFunctionAnalyses(PassT &P, llvm::Function &F);
+
+  // Sets the loop analyses from within the function pass P, if they are
+  // needed, and to null otherwise. Function passes only require them (see
+  // addRequiredLoopAnalyses) when they are needed, to save compile time.
+  template <class PassT> void getLoopAnalyses(PassT &P);
+  void addRequiredLoopAnalyses(llvm::AnalysisUsage &AU) const;
+
+  // Tries to remove a sanity check; returns true if it worked. With
+  // -asap-action=sample, the check runs once every SamplingPeriod executions
+  // instead; a period of zero means the check cannot be sampled. Group lists
+  // the other checks that share instructions with this one (see
+  // SanityCheckCost::getCheckGroup); they are sampled or removed together,
+  // as one unit.
+  bool
+  optimizeCheckAway(llvm::Instruction *Inst, uint64_t SamplingPeriod = 0,
+                    llvm::ArrayRef<llvm::Instruction *> Group = llvm::None);
+
+  // Tries to replace an ASan check in a loop by a single check of the whole
+  // accessed range in the loop preheader; returns true if it worked.
+  bool hoistCheck(llvm::Instruction *Inst);
+
+  // Finds the conditional branch where program code enters the given check,
+  // and the successor that continues the program. Returns null if the check
+  // does not have this shape.
+  llvm::BranchInst *findCheckBranch(llvm::Instruction *Inst,
+                                    llvm::BasicBlock *&Continue) const;
+
+  // Like the above, for the given instructions of one or more checks.
+  llvm::BranchInst *
+  findCheckBranch(const llvm::SmallPtrSetImpl<llvm::Instruction *> &CheckInsts,
+                  llvm::BasicBlock *&Continue) const;
+
+  // Tries to guard the given check instructions by a per-site counter, such
+  // that they run once every SamplingPeriod executions; returns true if it
+  // worked.
+  bool
+  sampleCheck(const llvm::SmallPtrSetImpl<llvm::Instruction *> &CheckInsts,
+              uint64_t SamplingPeriod);
+
+  // Tries to make a sanity check conditional; returns true if it worked. The
+  // check's instructions in the block where program code enters the check
+  // move to a block of their own. The program then branches to that block if
+  // the value computed by MakeCondition is true, and skips the check
+  // otherwise. MakeCondition inserts its code before the given instruction.
+  // Weights are the branch weights for the new branch, or null.
+  bool guardCheck(
+      llvm::Instruction *Inst,
+      llvm::function_ref<llvm::Value *(llvm::Instruction *)> MakeCondition,
+      llvm::MDNode *Weights);
+
+  // Like the above, for the given instructions of one or more checks.
+  bool guardCheck(
+      const llvm::SmallPtrSetImpl<llvm::Instruction *> &CheckInsts,
+      llvm::function_ref<llvm::Value *(llvm::Instruction *)> MakeCondition,
+      llvm::MDNode *Weights);
+
+  // Removes a sanity check's instructions, leaving the rest to DCE. Group
+  // lists the other checks that share instructions with this one, which are
+  // removed, too.
+  void eraseCheck(llvm::Instruction *Inst,
+                  llvm::ArrayRef<llvm::Instruction *> Group = llvm::None);
 
   // Writes information about a sanity check to the given stream.
   void logSanityCheck(llvm::Instruction *Inst, llvm::StringRef Action,
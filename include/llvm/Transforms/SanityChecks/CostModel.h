@@ -4,18 +4,98 @@
 #ifndef LLVM_TRANSFORMS_SANITYCHECKS_COSTMODEL_H
 #define LLVM_TRANSFORMS_SANITYCHECKS_COSTMODEL_H
 
+#include "llvm/ADT/DenseMap.h"
+
+#include <cstdint>
+
 namespace llvm {
+class Function;
 class Instruction;
+struct MCSchedClassDesc;
+class MCSchedModel;
 class TargetTransformInfo;
 }
 
+struct SanityCheckInstructions;
+
 namespace sanitychecks {
 /// Returns the expected cost of the instruction.
 /// Returns -1 if the cost is unknown.
 /// Note, this method does not cache the cost calculation and it
 /// can be expensive in some cases.
+/// This does not consult -asap-cost-table; callers that want calibrated
+/// costs try getCalibratedCost first.
 unsigned getInstructionCost(const llvm::Instruction *I,
                             const llvm::TargetTransformInfo *TTI);
+
+/// Looks up the instruction in the cost table given by -asap-cost-table.
+/// Calls are looked up by the name of the called function, other
+/// instructions by their opcode name. Returns true if the table has an entry.
+bool getCalibratedCost(const llvm::Instruction *I, unsigned &Cost);
+
+/// Looks up the cost of a whole check in the cost table given by
+/// -asap-cost-table, by the function that its root calls (for example,
+/// __asan_report_load4). The cost is per execution of the check, and
+/// replaces the costs of its instructions. Returns true if the table has an
+/// entry.
+bool getCalibratedCheckCost(const llvm::Instruction *Root, unsigned &Cost);
+
+/// Returns the estimated size of the instruction's machine code, in bytes.
+/// This is a static estimate for x86-64; actual sizes depend on register
+/// allocation and instruction selection. It is the fallback for checks that
+/// getMeasuredCheckSize does not know.
+unsigned getInstructionSize(const llvm::Instruction *I);
+
+/// Looks up the machine code size of the check with the given ID, in the
+/// __asap_check_ranges section of the binary given by -asap-check-sizes (see
+/// llc -asap-check-ranges). The size does not include the terminators of the
+/// check's blocks. Returns false if there is no such binary, or if it has no
+/// code for the check.
+bool getMeasuredCheckSize(uint64_t CheckID, uint64_t &Size);
+
+/// Estimates the costs of sanity check instructions from the target's
+/// scheduling model, if -asap-cost-model=sched.
+///
+/// Each IR instruction is mapped to a representative machine instruction,
+/// whose scheduling class gives its latency and the execution units it uses.
+/// Within each basic block, the instructions of a check form a dependency
+/// chain (for ASan: shift, shadow load, compare, branch). Instructions on the
+/// longest chain cost their full latency; all others only cost the issue
+/// slots and execution unit cycles they occupy.
+class SchedCostModel {
+public:
+  SchedCostModel(const llvm::Function &F, const SanityCheckInstructions &SCI);
+
+  /// Returns true if costs come from the scheduling model. Otherwise, callers
+  /// should use getInstructionCost.
+  bool isEnabled() const { return SchedModel != nullptr; }
+
+  /// Returns the cost of I in cycles. I must belong to a sanity check.
+  double getCost(const llvm::Instruction *I) const;
+
+  struct SchedTarget;
+
+private:
+  // Returns the subtarget that F is compiled for.
+  static const SchedTarget *getSchedTarget(const llvm::Function &F);
+
+  // Returns the scheduling class of a machine instruction that is typical
+  // for I, or null if there is none. Only x86-64 has such instructions.
+  const llvm::MCSchedClassDesc *
+  getSchedClass(const llvm::Instruction *I) const;
+
+  // Returns the latency of I, from its scheduling class if it has one, or
+  // from the model-wide latencies otherwise.
+  unsigned getLatency(const llvm::Instruction *I) const;
+
+  // Returns the cost of I when it is not on the critical path: the issue
+  // slots and execution unit cycles that it uses.
+  double getThroughputCost(const llvm::Instruction *I) const;
+
+  const SchedTarget *Subtarget = nullptr;
+  const llvm::MCSchedModel *SchedModel = nullptr;
+  llvm::DenseMap<const llvm::Instruction *, double> Costs;
+};
 } // namespace sanitychecks
 
 #endif
@@ -38,8 +38,8 @@
 #include <utility>
 
 namespace llvm {
+class BasicBlock;
 class Function;
-class Instruction;
 }
 
 namespace sanitychecks {
@@ -283,14 +283,17 @@ public:
   void dump() const;
   void collectLineCounts(FileInfo &FI);
 
-  // Returns the number of times a given instruction has been executed.
-  uint64_t getCount(llvm::Instruction *Inst) const;
+  // Computes the number of times each basic block of F has been executed.
+  // Returns false if F is not in the GCOV data, or if its CFG does not match.
+  bool getBlockCounts(const llvm::Function &F,
+                      DenseMap<const llvm::BasicBlock *, uint64_t> &Counts) const;
 
 private:
   bool GCNOInitialized;
   GCOV::GCOVVersion Version;
   uint32_t Checksum;
   SmallVector<std::unique_ptr<GCOVFunction>, 16> Functions;
+  StringMap<const GCOVFunction *> FunctionsByName;
   uint32_t RunCount;
   uint32_t ProgramCount;
 
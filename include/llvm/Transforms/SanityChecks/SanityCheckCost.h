@@ -4,14 +4,20 @@
 #ifndef LLVM_TRANSFORMS_SANITYCHECKS_SANITYCHECKCOST_H
 #define LLVM_TRANSFORMS_SANITYCHECKS_SANITYCHECKCOST_H
 
+#include "llvm/ADT/STLExtras.h"
+
 #include <cstdint>
+#include <map>
 #include <utility>
 #include <vector>
 
 namespace llvm {
+class Function;
 class Instruction;
 }
 
+struct SanityCheckInstructions;
+
 // A base class for passes that compute sanity check costs.
 struct SanityCheckCost {
   // A pair that stores a sanity check and its cost.
@@ -19,9 +25,31 @@ struct SanityCheckCost {
 
   const std::vector<CheckCost> &getCheckCosts() const { return CheckCosts; };
 
+  // Returns the checks that share instructions with the given check, and
+  // that need to be removed together with it. This is only non-empty if
+  // checks are grouped (-asap-shared-cost=group); in this case, CheckCosts
+  // contains one entry per group, and its cost is that of the whole group.
+  const std::vector<llvm::Instruction *> &
+  getCheckGroup(llvm::Instruction *Inst) const;
+
 protected:
   // Checks in the current function, with their cost.
   std::vector<CheckCost> CheckCosts;
+
+  // For checks that represent a group, the other checks in the group.
+  std::map<llvm::Instruction *, std::vector<llvm::Instruction *>> CheckGroups;
+
+  // Fills CheckCosts and CheckGroups for the given function, based on the
+  // cost of individual instructions. Instructions that belong to multiple
+  // checks are handled according to -asap-shared-cost. Spill code from
+  // -asap-spill-costs, and the measured cost of whole checks from
+  // -asap-cost-table, are charged once per execution of the check, i.e., of
+  // its most frequently executed instruction. Also attaches the cost to each
+  // check as metadata.
+  void computeCheckCosts(
+      llvm::Function &F, const SanityCheckInstructions &SCI,
+      llvm::function_ref<double(llvm::Instruction *)> InstructionCost,
+      llvm::function_ref<double(llvm::Instruction *)> ExecutionCount);
 };
 
 #endif
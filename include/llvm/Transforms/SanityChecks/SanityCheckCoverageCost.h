@@ -7,6 +7,8 @@
 #include "llvm/Transforms/SanityChecks/SanityCheckCost.h"
 #include "llvm/Pass.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/DebugInfo/DIContext.h"
 
 #include <map>
@@ -64,6 +66,26 @@ private:
   // `trace_pc_guard` array, and cost.
   std::map<llvm::Function *, std::vector<std::tuple<llvm::DIInliningInfo, size_t, uint64_t>>> CoveredLocations;
 
+  // The cost of each covered `trace_pc_guard` index, by function.
+  std::map<llvm::Function *, llvm::DenseMap<size_t, uint64_t>> CostsByIndex;
+
+  // Positions in CoveredLocations, by function and location key (see
+  // getLocationKey). Only locations with equal keys can match.
+  std::map<llvm::Function *,
+           llvm::DenseMap<size_t, llvm::SmallVector<size_t, 1>>>
+      LocationsByKey;
+
+  // The cost of each `trace_pc_guard` call, by check ID. This is filled if the
+  // coverage file contains IDs (see -sanitizer-coverage-check-ids), and makes
+  // CoveredLocations unnecessary.
+  llvm::DenseMap<uint64_t, uint64_t> CostsByCheckID;
+
+  // The check ID of each guard in the binary, in guard order. This is filled
+  // if the binary contains a guard table (see
+  // -sanitizer-coverage-guard-table), and lets us join coverage files without
+  // check IDs by guard index.
+  std::vector<uint64_t> CheckIDsByGuard;
+
   // The offset of the `trace_pc_guard` indices in the current function
   // relative to the indices in CoveredLocations.
   size_t TracePCGuardIndexOffset;
@@ -75,6 +97,10 @@ private:
   // list of symbolized debug locations. Returns true on success.
   bool loadCoverage(const llvm::Module &M);
 
+  // Reads the guard table from the binary given by -asap-module-name into
+  // CheckIDsByGuard. Returns true on success.
+  bool loadGuardTable(const llvm::Module &M);
+
   // Returns true if the given instruction is a call to `trace_pc_guard`.
   bool isTracePCGuardCall(llvm::Instruction *I);
 
@@ -85,6 +111,15 @@ private:
   // true on success.
   bool computeTracePCGuardIndexOffset(llvm::Function &F);
 
+  // Reads the check ID that SanitizerCoverage attached to the given
+  // `trace_pc_guard` call. Returns true on success.
+  bool getCheckID(llvm::Instruction *I, uint64_t &CheckID);
+
+  // Computes a hash of a location's lines and inlining depth, such that
+  // matching locations have equal keys.
+  static size_t getLocationKey(const llvm::DILocation &DIL);
+  static size_t getLocationKey(const llvm::DIInliningInfo &DIII);
+
   // Compares a DIInliningInfo and a DILocation, returning true if they match
   // (i.e., have the same source location and inlining stack).
   bool locationsMatch(const llvm::DILocation &DIL, const llvm::DIInliningInfo &DIII);
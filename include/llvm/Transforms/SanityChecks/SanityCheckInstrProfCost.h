@@ -0,0 +1,42 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+
+#ifndef LLVM_TRANSFORMS_SANITYCHECKS_SANITYCHECKINSTRPROFCOST_H
+#define LLVM_TRANSFORMS_SANITYCHECKS_SANITYCHECKINSTRPROFCOST_H
+
+#include "llvm/Transforms/SanityChecks/SanityCheckCost.h"
+#include "llvm/Pass.h"
+
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class BlockFrequencyInfo;
+class Instruction;
+class raw_ostream;
+}
+
+// Determines the cost of a check based on an IR-level instrumentation profile
+// (clang -fprofile-generate / -fprofile-use). The profile is applied by
+// PGOInstrumentationUse, which matches functions by their CFG hash and
+// annotates exact entry and edge counts; we derive block counts from these.
+struct SanityCheckInstrProfCost : public llvm::FunctionPass, public SanityCheckCost {
+  static char ID;
+
+  SanityCheckInstrProfCost() : FunctionPass(ID) {
+    initializeSanityCheckInstrProfCostPass(*llvm::PassRegistry::getPassRegistry());
+  }
+
+  virtual bool runOnFunction(llvm::Function &F) override;
+
+  virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const override;
+
+  virtual void print(llvm::raw_ostream &O, const llvm::Module *M) const override;
+
+private:
+  // Returns the profiled execution count for the given instruction, or zero
+  // if its function has no profile.
+  uint64_t getExecutionCount(const llvm::Instruction *I, const llvm::BlockFrequencyInfo &BFI) const;
+};
+
+#endif
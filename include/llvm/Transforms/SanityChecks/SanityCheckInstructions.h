@@ -6,6 +6,7 @@
 
 #include "utils.h"
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/Pass.h"
@@ -51,6 +52,18 @@ struct SanityCheckInstructions : public llvm::FunctionPass {
     return InstructionsBySanityCheck.at(Inst);
   }
 
+  // Returns an ID for the given sanity check root that is stable across
+  // builds of the same code. The "sanitycheck" metadata of each sanity check
+  // instruction holds the ID of the first check that uses it, so that the
+  // code generator can attribute machine code to checks.
+  uint64_t getCheckID(llvm::Instruction *Root) const {
+    return CheckIDs.lookup(Root);
+  }
+
+  // Returns false if AsapInputDependence found that the given sanity check
+  // root cannot depend on program input, and true otherwise.
+  static bool isInputDependent(const llvm::Instruction *Root);
+
 private:
   // All instructions that belong to sanity checks
   InstructionSet SCInstructions;
@@ -64,6 +77,12 @@ private:
   // Note that instructions can belong to multiple sanity checks.
   std::map<llvm::Instruction *, InstructionSet> InstructionsBySanityCheck;
 
+  // IDs of all sanity check roots.
+  llvm::DenseMap<llvm::Instruction *, uint64_t> CheckIDs;
+
+  // Computes IDs for all sanity check roots, in program order.
+  void computeCheckIDs(llvm::Function *F);
+
   // Searches for sanity check instructions in the given function.
   void findInstructions(llvm::Function *F);
 
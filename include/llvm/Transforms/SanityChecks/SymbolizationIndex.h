@@ -0,0 +1,62 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+
+#ifndef LLVM_TRANSFORMS_SANITYCHECKS_SYMBOLIZATIONINDEX_H
+#define LLVM_TRANSFORMS_SANITYCHECKS_SYMBOLIZATIONINDEX_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/DebugInfo/DIContext.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A compact index from program counters to their symbolized inlining frames,
+// for one binary. The index is created once per build by
+// asap-symbolize-coverage, and memory-mapped by SanityCheckCoverageCost, so
+// that each translation unit does not need to symbolize the binary again.
+//
+// The file consists of a header, the binary's build ID, entries sorted by
+// PC, frames, and a string table. All integers are little endian.
+class SymbolizationIndex {
+public:
+  // Writes an index for the binary with the given build ID.
+  static std::error_code
+  write(llvm::StringRef Path, llvm::StringRef BuildID,
+        std::vector<std::pair<uint64_t, llvm::DIInliningInfo>> Entries);
+
+  // Opens and validates an index.
+  static llvm::ErrorOr<std::unique_ptr<SymbolizationIndex>>
+  open(llvm::StringRef Path);
+
+  // The build ID of the binary that this index describes.
+  llvm::StringRef getBuildID() const { return BuildID; }
+
+  // Looks up the frames for the given PC. Returns true if PC is in the index.
+  bool lookup(uint64_t PC, llvm::DIInliningInfo &Result) const;
+
+private:
+  struct Header;
+  struct Entry;
+  struct Frame;
+
+  SymbolizationIndex(std::unique_ptr<llvm::MemoryBuffer> Buffer)
+      : Buffer(std::move(Buffer)) {}
+
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  llvm::StringRef BuildID;
+  const Entry *Entries = nullptr;
+  size_t NumEntries = 0;
+  const Frame *Frames = nullptr;
+  size_t NumFrames = 0;
+  llvm::StringRef Strings;
+};
+
+// Reads the GNU build ID of an ELF binary, as raw bytes. Returns an empty
+// string if the binary has no build ID.
+llvm::ErrorOr<std::string> readBuildID(llvm::StringRef Path);
+
+#endif
@@ -5,8 +5,11 @@
 #define SANITYCHECKS_UTILS_H
 
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringRef.h"
 #include "llvm/IR/DebugLoc.h"
 
+#include <cstdint>
+
 namespace llvm {
 class BasicBlock;
 class BranchInst;
@@ -15,6 +18,7 @@ class Instruction;
 class Function;
 class LLVMContext;
 class raw_ostream;
+class Twine;
 }
 
 // Types used to store sanity check blocks / instructions
@@ -26,6 +30,10 @@ typedef llvm::SmallPtrSet<llvm::Instruction *, 32> InstructionSet;
 // etc.
 bool isInstrumentation(const llvm::Instruction *I);
 
+// Returns true if a given instrumentation instruction belongs to
+// SanitizerCoverage, rather than to a sanity check.
+bool isSanitizerCoverage(const llvm::Instruction *I);
+
 // Returns true if the given instruction is an empty inline assembly call.
 // These are inserted by instrumentation tools to ensure that instrumentation
 // code is not optimized away.
@@ -34,6 +42,12 @@ bool isAsmForSideEffect(const llvm::Instruction *I);
 // Returns true if a given call aborts the program.
 bool isAbortingCall(const llvm::CallInst *CI);
 
+// Parses the name of an ASan reporting function such as
+// __asan_report_store4_noabort. Returns false for unknown functions, and for
+// those that take the access size as an argument.
+bool parseAsanReport(llvm::StringRef Name, bool &IsWrite, uint64_t &AccessSize,
+                     bool &Recover);
+
 // Returns the debug location of a basic block. This is the location of the
 // first instruction in the BB which has debug information.
 llvm::DebugLoc getBasicBlockDebugLoc(llvm::BasicBlock *BB);
@@ -47,6 +61,16 @@ llvm::DebugLoc getFunctionDebugLoc(const llvm::Function &F);
 void printDebugLoc(const llvm::DebugLoc &DbgLoc, llvm::LLVMContext &Ctx,
                    llvm::raw_ostream &Outs);
 
+// Clones F into a new internal function, named after F plus Suffix. Unlike
+// llvm::CloneFunction, this gives the clone its own debug info subprogram, as
+// two functions cannot share one. The compile unit, file and type are not
+// duplicated.
+llvm::Function *cloneFunction(llvm::Function *F, const llvm::Twine &Suffix);
+
+// Returns true if F is the fully checked copy of a multiversioned function
+// (see AsapMultiversion). ASAP leaves its checks alone.
+bool isCheckedVersion(const llvm::Function &F);
+
 // Determines the first and one-past-last instruction of a given instruction
 // set, via output parameters `begin` and `end`. Returns false if the set
 // does not form a contiguous single-entry-single-exit region.
@@ -37,9 +37,11 @@
 #include "llvm/MC/MCExpr.h"
 #include "llvm/MC/MCInst.h"
 #include "llvm/MC/MCSection.h"
+#include "llvm/MC/MCSectionELF.h"
 #include "llvm/MC/MCStreamer.h"
 #include "llvm/MC/MCSymbolELF.h"
 #include "llvm/MC/MCValue.h"
+#include "llvm/Support/ELF.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/MathExtras.h"
@@ -886,6 +888,9 @@ void AsmPrinter::EmitFunctionBody() {
       case TargetOpcode::GC_LABEL:
         OutStreamer->EmitLabel(MI.getOperand(0).getMCSymbol());
         break;
+      case TargetOpcode::SANITY_CHECK_LABEL:
+        emitSanityCheckLabel(&MI);
+        break;
       case TargetOpcode::INLINEASM:
         EmitInlineAsm(&MI);
         break;
@@ -916,6 +921,12 @@ void AsmPrinter::EmitFunctionBody() {
       }
     }
 
+    // Sanity check ranges do not span blocks, which might be reordered.
+    if (!SanityCheckRanges.empty() && !SanityCheckRanges.back().End) {
+      SanityCheckRanges.back().End = createTempSymbol("sanity_check");
+      OutStreamer->EmitLabel(SanityCheckRanges.back().End);
+    }
+
     EmitBasicBlockEnd(MBB);
   }
 
@@ -981,9 +992,50 @@ void AsmPrinter::EmitFunctionBody() {
     HI.Handler->endFunction(MF);
   }
 
+  emitSanityCheckRanges();
+
   OutStreamer->AddBlankLine();
 }
 
+void AsmPrinter::emitSanityCheckLabel(const MachineInstr *MI) {
+  MCSymbol *Label = createTempSymbol("sanity_check");
+  OutStreamer->EmitLabel(Label);
+  if (!SanityCheckRanges.empty() && !SanityCheckRanges.back().End)
+    SanityCheckRanges.back().End = Label;
+  if (uint64_t CheckID = MI->getOperand(0).getImm())
+    SanityCheckRanges.push_back({CheckID, Label, nullptr});
+}
+
+void AsmPrinter::emitSanityCheckRanges() {
+  if (SanityCheckRanges.empty())
+    return;
+
+  // Each record contains the check ID and the start and end address of a
+  // range. Tools that attribute samples to checks read these from the final
+  // binary, so the section is not loaded at runtime. It belongs to the
+  // function's comdat group, so that it disappears with the function.
+  if (TM.getTargetTriple().isOSBinFormatELF()) {
+    unsigned Flags = 0;
+    StringRef Group = "";
+    if (const Comdat *C = MF->getFunction()->getComdat()) {
+      Flags |= ELF::SHF_GROUP;
+      Group = C->getName();
+    }
+    MCSection *Section = OutContext.getELFSection(
+        "__asap_check_ranges", ELF::SHT_PROGBITS, Flags, 0, Group);
+    OutStreamer->PushSection();
+    OutStreamer->SwitchSection(Section);
+    OutStreamer->EmitValueToAlignment(8);
+    for (const SanityCheckRange &Range : SanityCheckRanges) {
+      OutStreamer->EmitIntValue(Range.CheckID, 8);
+      OutStreamer->EmitSymbolValue(Range.Begin, 8);
+      OutStreamer->EmitSymbolValue(Range.End, 8);
+    }
+    OutStreamer->PopSection();
+  }
+  SanityCheckRanges.clear();
+}
+
 /// \brief Compute the number of Global Variables that uses a Constant.
 static unsigned getNumGlobalVariableUses(const Constant *C) {
   if (!C)
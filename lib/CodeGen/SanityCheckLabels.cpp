@@ -0,0 +1,258 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+//
+// Brackets the machine code of each sanity check with SANITY_CHECK_LABEL
+// instructions, from which the AsmPrinter emits the address ranges of checks
+// into the __asap_check_ranges section.
+//
+// Sanity check instructions carry "sanitycheck" metadata with their check ID
+// (see SanityCheckInstructions). Instruction selection loses the link between
+// IR and machine instructions, so we recover it: machine code in blocks that
+// only contain check code, and memory accesses to check values (the shadow
+// loads), belong to a check. So do instructions whose results are only used
+// by instructions of that check.
+//
+// The pass runs before register allocation, because it follows the uses of
+// virtual registers. The labels therefore perturb the code they measure:
+// they have side effects, so the schedulers do not move memory accesses or
+// calls across them, which can change the schedule and, through it, register
+// allocation. Other instructions may be scheduled across a label, so ranges
+// are approximate. Spill and reload code can land inside or outside the range of
+// the check that causes it; SanityCheckSpillCosts looks next to the range.
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/CodeGen/Passes.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/Target/TargetInstrInfo.h"
+#include "llvm/Target/TargetRegisterInfo.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "sanity-check-labels"
+
+STATISTIC(NumSanityCheckRanges, "Number of sanity check ranges");
+
+namespace {
+struct SanityCheckLabels : public MachineFunctionPass {
+  static char ID;
+
+  SanityCheckLabels() : MachineFunctionPass(ID) {
+    initializeSanityCheckLabelsPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.setPreservesCFG();
+    MachineFunctionPass::getAnalysisUsage(AU);
+  }
+
+private:
+  // Returns the ID of the check that uses all results of MI, or zero.
+  uint64_t getUsersCheckID(const MachineInstr &MI) const;
+
+  const MachineRegisterInfo *MRI = nullptr;
+  const TargetRegisterInfo *TRI = nullptr;
+
+  // Check IDs of machine instructions that belong to a sanity check.
+  DenseMap<const MachineInstr *, uint64_t> CheckIDs;
+};
+} // anonymous namespace
+
+// Returns the check ID of an IR value, or zero if it does not belong to a
+// sanity check.
+static uint64_t getCheckID(const Value *V) {
+  auto *I = dyn_cast_or_null<Instruction>(V);
+  if (!I) {
+    return 0;
+  }
+  MDNode *MD = I->getMetadata("sanitycheck");
+  if (!MD || MD->getNumOperands() == 0) {
+    return 0;
+  }
+  auto *ID = mdconst::dyn_extract<ConstantInt>(MD->getOperand(0));
+  return ID ? ID->getZExtValue() : 0;
+}
+
+// Returns the check ID of a basic block if all its instructions belong to the
+// same sanity check, or zero.
+static uint64_t getCheckID(const BasicBlock *BB) {
+  if (!BB) {
+    return 0;
+  }
+  uint64_t BlockID = 0;
+  for (const Instruction &I : *BB) {
+    if (isa<DbgInfoIntrinsic>(I)) {
+      continue;
+    }
+    uint64_t ID = getCheckID(&I);
+    if (!ID || (BlockID && BlockID != ID)) {
+      return 0;
+    }
+    BlockID = ID;
+  }
+  return BlockID;
+}
+
+uint64_t SanityCheckLabels::getUsersCheckID(const MachineInstr &MI) const {
+  if (MI.isPHI() || MI.isPosition() || MI.isDebugValue() ||
+      MI.isTerminator() || MI.isCall() || MI.mayStore() ||
+      MI.hasUnmodeledSideEffects()) {
+    return 0;
+  }
+
+  uint64_t ID = 0;
+  auto AddUser = [this, &ID](const MachineInstr &User) {
+    uint64_t UserID = CheckIDs.lookup(&User);
+    if (!UserID || (ID && ID != UserID)) {
+      return false;
+    }
+    ID = UserID;
+    return true;
+  };
+
+  for (const MachineOperand &MO : MI.operands()) {
+    if (!MO.isReg() || !MO.isDef() || MO.isDead() || !MO.getReg()) {
+      continue;
+    }
+    unsigned Reg = MO.getReg();
+    if (TargetRegisterInfo::isVirtualRegister(Reg)) {
+      for (const MachineInstr &User : MRI->use_nodbg_instructions(Reg)) {
+        if (!AddUser(User)) {
+          return 0;
+        }
+      }
+      continue;
+    }
+
+    // Physical registers, such as the flags that a compare sets for a
+    // branch, are used later in the same block.
+    const MachineBasicBlock &MBB = *MI.getParent();
+    auto It = std::next(MI.getIterator());
+    for (; It != MBB.end(); ++It) {
+      if (It->readsRegister(Reg, TRI)) {
+        if (!AddUser(*It)) {
+          return 0;
+        }
+        if (It->killsRegister(Reg, TRI)) {
+          break;
+        }
+      }
+      if (It->modifiesRegister(Reg, TRI)) {
+        break;
+      }
+    }
+    if (It == MBB.end()) {
+      for (const MachineBasicBlock *Succ : MBB.successors()) {
+        if (Succ->isLiveIn(Reg)) {
+          return 0;
+        }
+      }
+    }
+  }
+  return ID;
+}
+
+bool SanityCheckLabels::runOnMachineFunction(MachineFunction &MF) {
+  MRI = &MF.getRegInfo();
+  TRI = MF.getSubtarget().getRegisterInfo();
+  CheckIDs.clear();
+
+  // Blocks that only contain check code, e.g., calls to __asan_report_*,
+  // and memory accesses to check values belong to their check.
+  DenseMap<const MachineBasicBlock *, uint64_t> BlockIDs;
+  for (MachineBasicBlock &MBB : MF) {
+    uint64_t BlockID = getCheckID(MBB.getBasicBlock());
+    if (BlockID) {
+      BlockIDs[&MBB] = BlockID;
+    }
+    for (MachineInstr &MI : MBB) {
+      uint64_t ID = BlockID;
+      for (const MachineMemOperand *MMO : MI.memoperands()) {
+        if (!ID) {
+          ID = getCheckID(MMO->getValue());
+        }
+      }
+      if (ID) {
+        CheckIDs[&MI] = ID;
+      }
+    }
+  }
+
+  // A conditional branch to a check block belongs to the check. It is not
+  // part of the check's range, because labels cannot follow terminators, but
+  // the compare that it uses is.
+  for (MachineBasicBlock &MBB : MF) {
+    for (MachineInstr &MI : MBB.terminators()) {
+      if (!MI.isConditionalBranch() || CheckIDs.count(&MI)) {
+        continue;
+      }
+      for (const MachineOperand &MO : MI.operands()) {
+        if (MO.isMBB() && BlockIDs.count(MO.getMBB())) {
+          CheckIDs[&MI] = BlockIDs.lookup(MO.getMBB());
+        }
+      }
+    }
+  }
+
+  // Instructions whose results are only used by a check belong to it, too.
+  // Visiting blocks backwards finds most of them in a single iteration.
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (MachineBasicBlock &MBB : MF) {
+      for (MachineInstr &MI : make_range(MBB.rbegin(), MBB.rend())) {
+        if (CheckIDs.count(&MI)) {
+          continue;
+        }
+        if (uint64_t ID = getUsersCheckID(MI)) {
+          CheckIDs[&MI] = ID;
+          Changed = true;
+        }
+      }
+    }
+  }
+
+  // Bracket each run of instructions from the same check. Ranges end before
+  // the terminators of their block.
+  const TargetInstrInfo *TII = MF.getSubtarget().getInstrInfo();
+  bool Inserted = false;
+  for (MachineBasicBlock &MBB : MF) {
+    uint64_t CurrentID = 0;
+    MachineBasicBlock::iterator FirstTerminator = MBB.getFirstTerminator();
+    for (auto It = MBB.begin(); It != FirstTerminator; ++It) {
+      if (It->isPHI() || It->isDebugValue() || It->isPosition()) {
+        continue;
+      }
+      uint64_t ID = CheckIDs.lookup(&*It);
+      if (ID != CurrentID) {
+        BuildMI(MBB, It, DebugLoc(), TII->get(TargetOpcode::SANITY_CHECK_LABEL))
+            .addImm(ID);
+        CurrentID = ID;
+        NumSanityCheckRanges += ID != 0;
+        Inserted = true;
+      }
+    }
+    if (CurrentID) {
+      BuildMI(MBB, FirstTerminator, DebugLoc(),
+              TII->get(TargetOpcode::SANITY_CHECK_LABEL))
+          .addImm(0);
+    }
+  }
+
+  CheckIDs.clear();
+  return Inserted;
+}
+
+char SanityCheckLabels::ID = 0;
+char &llvm::SanityCheckLabelsID = SanityCheckLabels::ID;
+INITIALIZE_PASS(SanityCheckLabels, "sanity-check-labels",
+                "Label the machine code of sanity checks", false, false)
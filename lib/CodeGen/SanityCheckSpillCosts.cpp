@@ -0,0 +1,182 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+//
+// Estimates the spill and reload code that each sanity check causes, and
+// appends it to the file given by -asap-spill-cost-output. ASAP's cost passes
+// read that file (-asap-spill-costs) and add the spill cost to the cost of
+// each check.
+//
+// The pass runs right after register allocation, on code that
+// SanityCheckLabels has bracketed. Spill code inside a check's range belongs
+// to the check. So does spill code right before the range, or right after
+// it: the register allocator places spills next to the interference that
+// causes them, and checks in tight loops often force user values out of
+// registers for the duration of the check.
+//
+// Each line of the output contains a check ID and the number of spill and
+// reload instructions per execution of the check.
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineFrameInfo.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/Passes.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetInstrInfo.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "sanity-check-spill-costs"
+
+STATISTIC(NumSanityCheckSpills,
+          "Number of spill and reload instructions attributed to checks");
+
+cl::opt<std::string> SanityCheckSpillCostOutput(
+    "asap-spill-cost-output", cl::init(""),
+    cl::desc("Append the spill and reload cost of each sanity check to this "
+             "file (implies -asap-check-ranges)"));
+
+namespace {
+struct SanityCheckSpillCosts : public MachineFunctionPass {
+  static char ID;
+
+  SanityCheckSpillCosts() : MachineFunctionPass(ID) {
+    initializeSanityCheckSpillCostsPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool doInitialization(Module &M) override;
+  bool runOnMachineFunction(MachineFunction &MF) override;
+  bool doFinalization(Module &M) override;
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<MachineBlockFrequencyInfo>();
+    AU.setPreservesAll();
+    MachineFunctionPass::getAnalysisUsage(AU);
+  }
+
+private:
+  // Returns true if MI stores to or loads from a spill slot.
+  bool isSpillCode(const MachineInstr &MI) const;
+
+  const TargetInstrInfo *TII = nullptr;
+  const MachineFrameInfo *MFI = nullptr;
+
+  std::unique_ptr<raw_fd_ostream> Output;
+};
+
+// Spill code of a check, weighted by block frequency, and the frequency of
+// the check's most frequent range.
+struct CheckSpills {
+  double Spills = 0;
+  uint64_t MaxFreq = 0;
+};
+} // anonymous namespace
+
+bool SanityCheckSpillCosts::doInitialization(Module &M) {
+  if (SanityCheckSpillCostOutput.empty()) {
+    return false;
+  }
+  std::error_code EC;
+  Output.reset(new raw_fd_ostream(SanityCheckSpillCostOutput, EC,
+                                  sys::fs::F_Append | sys::fs::F_Text));
+  if (EC) {
+    report_fatal_error(SanityCheckSpillCostOutput + ": " + EC.message());
+  }
+  return false;
+}
+
+bool SanityCheckSpillCosts::doFinalization(Module &M) {
+  Output.reset();
+  return false;
+}
+
+bool SanityCheckSpillCosts::isSpillCode(const MachineInstr &MI) const {
+  int FI;
+  const MachineMemOperand *MMO;
+  if (TII->isLoadFromStackSlot(MI, FI) || TII->isStoreToStackSlot(MI, FI)) {
+    return MFI->isSpillSlotObjectIndex(FI);
+  }
+  // Reloads that were folded into their user.
+  return (TII->hasLoadFromStackSlot(MI, MMO, FI) ||
+          TII->hasStoreToStackSlot(MI, MMO, FI)) &&
+         MFI->isSpillSlotObjectIndex(FI);
+}
+
+bool SanityCheckSpillCosts::runOnMachineFunction(MachineFunction &MF) {
+  if (!Output) {
+    return false;
+  }
+  TII = MF.getSubtarget().getInstrInfo();
+  MFI = &MF.getFrameInfo();
+  const MachineBlockFrequencyInfo &MBFI =
+      getAnalysis<MachineBlockFrequencyInfo>();
+
+  std::map<uint64_t, CheckSpills> Checks;
+  for (const MachineBasicBlock &MBB : MF) {
+    uint64_t Freq = MBFI.getBlockFreq(&MBB).getFrequency();
+    // The check whose range we are in, the check whose range just ended, and
+    // the number of spill instructions since the last other instruction.
+    uint64_t CurrentID = 0;
+    uint64_t PreviousID = 0;
+    unsigned PendingSpills = 0;
+    for (const MachineInstr &MI : MBB) {
+      if (MI.isDebugValue()) {
+        continue;
+      }
+      if (MI.getOpcode() == TargetOpcode::SANITY_CHECK_LABEL) {
+        uint64_t ID = MI.getOperand(0).getImm();
+        if (ID) {
+          CheckSpills &CS = Checks[ID];
+          CS.MaxFreq = std::max(CS.MaxFreq, Freq);
+          CS.Spills += (double)PendingSpills * Freq;
+          NumSanityCheckSpills += PendingSpills;
+        }
+        PreviousID = CurrentID;
+        CurrentID = ID;
+        PendingSpills = 0;
+        continue;
+      }
+
+      if (!isSpillCode(MI)) {
+        PreviousID = 0;
+        PendingSpills = 0;
+        continue;
+      }
+      if (uint64_t ID = CurrentID ? CurrentID : PreviousID) {
+        Checks[ID].Spills += Freq;
+        NumSanityCheckSpills += 1;
+      } else {
+        PendingSpills += 1;
+      }
+    }
+  }
+
+  for (const auto &Check : Checks) {
+    if (Check.second.Spills > 0 && Check.second.MaxFreq > 0) {
+      *Output << Check.first << ' '
+              << format("%.3f", Check.second.Spills / Check.second.MaxFreq)
+              << '\n';
+    }
+  }
+  return false;
+}
+
+char SanityCheckSpillCosts::ID = 0;
+char &llvm::SanityCheckSpillCostsID = SanityCheckSpillCosts::ID;
+INITIALIZE_PASS_BEGIN(SanityCheckSpillCosts, "sanity-check-spill-costs",
+                      "Estimate the spill code caused by sanity checks", false,
+                      false)
+INITIALIZE_PASS_DEPENDENCY(MachineBlockFrequencyInfo)
+INITIALIZE_PASS_END(SanityCheckSpillCosts, "sanity-check-spill-costs",
+                    "Estimate the spill code caused by sanity checks", false,
+                    false)
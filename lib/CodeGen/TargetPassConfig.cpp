@@ -114,6 +114,12 @@ static cl::opt<int> EnableGlobalISelAbort(
 cl::opt<bool> MISchedPostRA("misched-postra", cl::Hidden,
   cl::desc("Run MachineScheduler post regalloc (independent of preRA sched)"));
 
+// Label sanity checks for ASAP, so that samples can be attributed to them.
+static cl::opt<bool> EmitSanityCheckRanges("asap-check-ranges",
+    cl::desc("Emit the address ranges of sanity checks into the "
+             "__asap_check_ranges section"));
+extern cl::opt<std::string> SanityCheckSpillCostOutput;
+
 // Experimental option to run live interval analysis early.
 static cl::opt<bool> EarlyLiveIntervals("early-live-intervals", cl::Hidden,
     cl::desc("Run live interval analysis earlier in the pipeline"));
@@ -603,6 +609,11 @@ void TargetPassConfig::addMachinePasses() {
   // Run pre-ra passes.
   addPreRegAlloc();
 
+  // Label sanity checks while registers are still virtual. The labels stay
+  // in the code through register allocation and scheduling.
+  if (EmitSanityCheckRanges || !SanityCheckSpillCostOutput.empty())
+    addPass(&SanityCheckLabelsID, false);
+
   // Run register allocation and passes that are tightly coupled with it,
   // including phi elimination and scheduling.
   if (getOptimizeRegAlloc())
@@ -610,6 +621,10 @@ void TargetPassConfig::addMachinePasses() {
   else
     addFastRegAlloc(createRegAllocPass(false));
 
+  // Spill slots are still frame indices here, so spill code is easy to find.
+  if (!SanityCheckSpillCostOutput.empty())
+    addPass(&SanityCheckSpillCostsID, false);
+
   // Run post-ra passes.
   addPostRegAlloc();
 
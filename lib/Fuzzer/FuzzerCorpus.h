@@ -37,11 +37,14 @@ struct InputInfo {
 
 class InputCorpus {
  public:
-  static const size_t kFeatureSetSize = 1 << 16;
-  InputCorpus(const std::string &OutputCorpus) : OutputCorpus(OutputCorpus) {
-    memset(InputSizesPerFeature, 0, sizeof(InputSizesPerFeature));
-    memset(SmallestElementPerFeature, 0, sizeof(SmallestElementPerFeature));
-  }
+  // Eight features per guard, followed by the value profile features. Guards
+  // of modules loaded later alias the existing features.
+  InputCorpus(const std::string &OutputCorpus)
+      : OutputCorpus(OutputCorpus),
+        FeatureSetSize((TPC.GetNumGuards() + 1) * 8 +
+                       ValueBitMap::kNumberOfItems),
+        InputSizesPerFeature(FeatureSetSize),
+        SmallestElementPerFeature(FeatureSetSize) {}
   ~InputCorpus() {
     for (auto II : Inputs)
       delete II;
@@ -105,7 +108,7 @@ class InputCorpus {
   }
 
   void PrintFeatureSet() {
-    for (size_t i = 0; i < kFeatureSetSize; i++) {
+    for (size_t i = 0; i < FeatureSetSize; i++) {
       if(size_t Sz = GetFeature(i))
         Printf("[%zd: id %zd sz%zd] ", i, SmallestElementPerFeature[i], Sz);
     }
@@ -127,7 +130,7 @@ class InputCorpus {
 
   bool AddFeature(size_t Idx, uint32_t NewSize, bool Shrink) {
     assert(NewSize);
-    Idx = Idx % kFeatureSetSize;
+    Idx = Idx % FeatureSetSize;
     uint32_t OldSize = GetFeature(Idx);
     if (OldSize == 0 || (Shrink && OldSize > NewSize)) {
       if (OldSize > 0) {
@@ -137,6 +140,8 @@ class InputCorpus {
         II.NumFeatures--;
         if (II.NumFeatures == 0)
           DeleteInput(OldIdx);
+      } else {
+        NumAddedFeatures++;
       }
       if (FeatureDebug)
         Printf("ADD FEATURE %zd sz %d\n", Idx, NewSize);
@@ -148,17 +153,13 @@ class InputCorpus {
     return false;
   }
 
-  size_t NumFeatures() const {
-    size_t Res = 0;
-    for (size_t i = 0; i < kFeatureSetSize; i++)
-      Res += GetFeature(i) != 0;
-    return Res;
-  }
+  size_t NumFeatures() const { return NumAddedFeatures; }
 
   void ResetFeatureSet() {
     assert(Inputs.empty());
-    memset(InputSizesPerFeature, 0, sizeof(InputSizesPerFeature));
-    memset(SmallestElementPerFeature, 0, sizeof(SmallestElementPerFeature));
+    NumAddedFeatures = 0;
+    InputSizesPerFeature.assign(FeatureSetSize, 0);
+    SmallestElementPerFeature.assign(FeatureSetSize, 0);
   }
 
 private:
@@ -167,11 +168,11 @@ private:
 
   size_t GetFeature(size_t Idx) const { return InputSizesPerFeature[Idx]; }
 
+  // Scans the whole feature set, so only runs when debugging.
   void ValidateFeatureSet() {
-    if (!CountingFeatures) return;
-    if (FeatureDebug)
-      PrintFeatureSet();
-    for (size_t Idx = 0; Idx < kFeatureSetSize; Idx++)
+    if (!FeatureDebug || !CountingFeatures) return;
+    PrintFeatureSet();
+    for (size_t Idx = 0; Idx < FeatureSetSize; Idx++)
       if (GetFeature(Idx))
         Inputs[SmallestElementPerFeature[Idx]]->Tmp++;
     for (auto II: Inputs) {
@@ -206,10 +207,13 @@ private:
   std::vector<InputInfo*> Inputs;
 
   bool CountingFeatures = false;
-  uint32_t InputSizesPerFeature[kFeatureSetSize];
-  uint32_t SmallestElementPerFeature[kFeatureSetSize];
+  size_t NumAddedFeatures = 0;
 
   std::string OutputCorpus;
+
+  size_t FeatureSetSize;
+  std::vector<uint32_t> InputSizesPerFeature;
+  std::vector<uint32_t> SmallestElementPerFeature;
 };
 
 }  // namespace fuzzer
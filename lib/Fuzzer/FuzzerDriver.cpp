@@ -438,6 +438,14 @@ int FuzzerDriver(int *argc, char ***argv, UserCallback Callback) {
   if (Flags.exit_on_item)
     Options.ExitOnItem = Flags.exit_on_item;
   Options.Benchmark = Flags.benchmark;
+  Options.PruneStableGuards = Flags.prune_stable_guards;
+  Options.PruneHotCount = Flags.prune_hot_count;
+  Options.PruneReenablePercent = Flags.prune_reenable_percent;
+  Options.ExactAllTimeCounters = Flags.exact_all_time_counters;
+  Options.EnableChecksAfter = Flags.enable_checks_after;
+  Options.CheckedVersionPeriod = Flags.checked_version_period;
+  if (Flags.disable_checks)
+    TPC.DisableChecks(Flags.disable_checks);
 
   unsigned Seed = Flags.seed;
   // Initialize Seed.
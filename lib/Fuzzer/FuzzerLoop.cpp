@@ -188,6 +188,9 @@ Fuzzer::Fuzzer(UserCallback CB, InputCorpus &Corpus, MutationDispatcher &MD,
   TPC.SetUseCounters(Options.UseCounters);
   TPC.SetUseValueProfile(Options.UseValueProfile);
   TPC.SetPrintNewPCs(Options.PrintNewCovPcs);
+  TPC.SetPruneStableGuards(Options.PruneStableGuards, Options.PruneHotCount,
+                           Options.PruneReenablePercent);
+  TPC.SetExactAllTimeCounters(Options.ExactAllTimeCounters);
 
   if (Options.Verbosity)
     TPC.PrintModuleInfo();
@@ -500,13 +503,21 @@ size_t Fuzzer::RunOne(const uint8_t *Data, size_t Size) {
   if (!Size) return 0;
   TotalNumberOfRuns++;
 
+  bool UseCheckedVersions =
+      Options.CheckedVersionPeriod &&
+      TotalNumberOfRuns % Options.CheckedVersionPeriod == 0;
+  if (UseCheckedVersions)
+    TPC.UseCheckedVersions(true);
   ExecuteCallback(Data, Size);
+  if (UseCheckedVersions)
+    TPC.UseCheckedVersions(false);
 
   size_t Res = 0;
   if (size_t NumFeatures = TPC.CollectFeatures([&](size_t Feature) -> bool {
         return Corpus.AddFeature(Feature, Size, Options.Shrink);
       }))
     Res = NumFeatures;
+  TPC.PruneStableGuards(MD.GetRand());
 
   if (!TPC.UsingTracePcGuard()) {
     if (TPC.UpdateValueProfileMap(&MaxCoverage.VPMap))
@@ -515,6 +526,18 @@ size_t Fuzzer::RunOne(const uint8_t *Data, size_t Size) {
       Res = 1;
   }
 
+  // Checks that were switched off might find bugs that coverage no longer
+  // leads to.
+  if (Res) {
+    LastRunWithNewFeatures = TotalNumberOfRuns;
+  } else if (Options.EnableChecksAfter &&
+             TotalNumberOfRuns - LastRunWithNewFeatures >=
+                 Options.EnableChecksAfter &&
+             TPC.EnableAllChecks()) {
+    Printf("#%zd\tENABLE_CHECKS no new coverage in %zd runs\n",
+           TotalNumberOfRuns, TotalNumberOfRuns - LastRunWithNewFeatures);
+  }
+
   if (Res) {
     auto KidHash = Hash({Data, Data + Size});
     Printf("ANCESTRY: %s -> %s\n", Sha1ToString(BaseSha1).c_str(), KidHash.c_str());
@@ -61,6 +61,12 @@ struct FuzzingOptions {
   bool HandleSegv = false;
   bool HandleTerm = false;
   bool Benchmark = false;
+  size_t PruneStableGuards = 0;
+  size_t PruneHotCount = 0;
+  int PruneReenablePercent = 0;
+  bool ExactAllTimeCounters = false;
+  size_t EnableChecksAfter = 0;
+  size_t CheckedVersionPeriod = 0;
 };
 
 }  // namespace fuzzer
@@ -17,12 +17,44 @@
 #include "FuzzerDictionary.h"
 #include "FuzzerExtFunctions.h"
 #include "FuzzerIO.h"
+#include "FuzzerRandom.h"
 #include "FuzzerTracePC.h"
 #include "FuzzerValueBitMap.h"
 #include <map>
 #include <set>
 #include <sstream>
 
+#ifdef FUSS
+#include <sys/mman.h>
+#endif
+
+#ifdef FUSS
+// Stable IDs of the trace_pc_guard callbacks in the main binary, in the same
+// order as the guards. The compiler emits them when given
+// -mllvm -sanitizer-coverage-check-ids.
+extern "C" {
+__attribute__((weak)) extern const uint64_t __start___sancov_check_ids[];
+__attribute__((weak)) extern const uint64_t __stop___sancov_check_ids[];
+}
+
+// Switches for sanity checks, and the IDs of the corresponding checks. ASAP
+// emits them with -sanity-check-switches; a check runs while its switch is
+// non-zero.
+extern "C" {
+__attribute__((weak)) extern uint8_t __start___asap_check_switches[];
+__attribute__((weak)) extern uint8_t __stop___asap_check_switches[];
+__attribute__((weak)) extern const uint64_t __start___asap_check_switch_ids[];
+__attribute__((weak)) extern const uint64_t __stop___asap_check_switch_ids[];
+}
+
+// Flags that select the fully checked copy of multiversioned functions. ASAP
+// emits them with -asap-multiversion.
+extern "C" {
+__attribute__((weak)) extern uint8_t __start___asap_checked_versions[];
+__attribute__((weak)) extern uint8_t __stop___asap_checked_versions[];
+}
+#endif
+
 namespace fuzzer {
 
 TracePC TPC;
@@ -30,10 +62,17 @@ TracePC TPC;
 void TracePC::HandleTrace(uint32_t *Guard, uintptr_t PC) {
   uint32_t Idx = *Guard;
   if (!Idx) return;
-  PCs[Idx % kNumPCs] = PC;
-  Counters[Idx % kNumCounters]++;
+  Counters[Idx]++;
 #ifdef FUSS
-  AllTimeCounters[Idx % kNumAllTimeCounters]++;
+  PCs[Idx] = PC;
+  if (!++AllTimeCounters[Idx]) {
+    if (AllTimeCounterWraps)
+      AllTimeCounterWraps[Idx]++;
+    else
+      AllTimeCounters[Idx] = UINT32_MAX;
+  }
+#else
+  PCs[Idx % kNumPCs] = PC;
 #endif
 }
 
@@ -53,6 +92,212 @@ void TracePC::HandleInit(uint32_t *Start, uint32_t *Stop) {
   Modules[NumModules].Start = Start;
   Modules[NumModules].Stop = Stop;
   NumModules++;
+
+  if (NumGuards + 1 > kMaxGuards) {
+    Printf("ERROR: %zd coverage guards; at most %zd are supported\n",
+           NumGuards, kMaxGuards - 1);
+    exit(1);
+  }
+#ifdef FUSS
+  MapGuardArrays();
+#endif
+  GuardArraysSize =
+      (NumGuards + 1 + kCounterBlock - 1) & ~(kCounterBlock - 1);  // Round up.
+}
+
+// Clears the counters of the last run. CollectFeatures has usually cleared
+// them already, but other threads may have run since. Only blocks with
+// non-zero counters are written, so that large programs do not slow down each
+// execution.
+void TracePC::ClearCounters() {
+  const size_t Step = 8;
+  for (size_t Block = 0; Block < GuardArraysSize; Block += kCounterBlock) {
+    const uint64_t *Bundles =
+        reinterpret_cast<const uint64_t *>(&Counters[Block]);
+    uint64_t Any = 0;
+    for (size_t j = 0; j < kCounterBlock / Step; j++)
+      Any |= Bundles[j];
+    if (Any)
+      memset(&Counters[Block], 0, kCounterBlock);
+  }
+}
+
+#ifdef FUSS
+// Returns an array of kMaxGuards elements. The memory is mapped without
+// reserving swap, and the kernel only populates the pages that are written.
+template <class T>
+static T *MapGuardArray() {
+  const size_t Size = TracePC::kMaxGuards * sizeof(T);
+  void *Array = mmap(nullptr, Size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (Array == MAP_FAILED) {
+    Printf("ERROR: failed to map %zd bytes for coverage data\n", Size);
+    exit(1);
+  }
+  return static_cast<T *>(Array);
+}
+
+// The arrays are mapped once, for all guards there can be, so that they never
+// move.
+void TracePC::MapGuardArrays() {
+  if (PCs) return;
+  PCs = MapGuardArray<uintptr_t>();
+  AllTimeCounters = MapGuardArray<uint32_t>();
+}
+
+uint64_t TracePC::GetAllTimeCounter(size_t Idx) const {
+  uint64_t Wraps = AllTimeCounterWraps ? AllTimeCounterWraps[Idx] : 0;
+  return (Wraps << 32) | AllTimeCounters[Idx];
+}
+
+uint32_t *TracePC::GetGuard(size_t Idx) {
+  // HandleInit numbers the guards of each module consecutively.
+  size_t First = 1;
+  for (size_t i = 0; i < NumModules; i++) {
+    size_t Size = Modules[i].Stop - Modules[i].Start;
+    if (Idx < First + Size)
+      return Modules[i].Start + (Idx - First);
+    First += Size;
+  }
+  return nullptr;
+}
+#endif
+
+// Counts all-time counters beyond UINT32_MAX, instead of saturating them.
+void TracePC::SetExactAllTimeCounters(bool Exact) {
+#ifdef FUSS
+  if (Exact && !AllTimeCounterWraps && GuardArraysSize)
+    AllTimeCounterWraps = MapGuardArray<uint32_t>();
+#else
+  if (Exact)
+    Printf("WARNING: -exact_all_time_counters requires a FUSS build of "
+           "libFuzzer; ignoring it\n");
+#endif
+}
+
+void TracePC::SetPruneStableGuards(size_t StableRuns, size_t HotCount,
+                                   int ReenablePercent) {
+#ifdef FUSS
+  PruneStableRuns = StableRuns;
+  PruneHotCount = HotCount;
+  PruneReenablePercent = ReenablePercent;
+  if (PruneStableRuns && !LastNewFeatureRun && GuardArraysSize) {
+    LastNewFeatureRun = MapGuardArray<size_t>();
+    PrunedGuards = new std::vector<uint32_t>;
+  }
+#else
+  if (StableRuns)
+    Printf("WARNING: -prune_stable_guards requires a FUSS build of "
+           "libFuzzer; ignoring it\n");
+#endif
+}
+
+// Disables the trace_pc_guard callbacks of hot edges that have not produced a
+// new feature in PruneStableRuns runs. HandleTrace returns right away for a
+// zero guard, so this saves most of the cost of coverage for hot code, like
+// recompiling with FUSS does, but without a profiling run. Pruned edges no
+// longer produce features; re-enabling a random sample of them from time to
+// time lets the fuzzer notice if they become interesting again.
+void TracePC::PruneStableGuards(Random &Rand) {
+#ifdef FUSS
+  // Scanning all guards takes a while, so we only do it once in a while.
+  const size_t kScanInterval = 1 << 12;
+  if (!PruneStableRuns || !LastNewFeatureRun || NumRuns % kScanInterval)
+    return;
+
+  size_t NumReenabled = 0;
+  if (PruneReenablePercent && NumRuns - LastReenableRun >= PruneStableRuns) {
+    LastReenableRun = NumRuns;
+    for (size_t i = 0; i < PrunedGuards->size();) {
+      if (Rand(100) >= static_cast<size_t>(PruneReenablePercent)) {
+        i++;
+        continue;
+      }
+      uint32_t Idx = (*PrunedGuards)[i];
+      *GetGuard(Idx) = Idx;
+      LastNewFeatureRun[Idx] = NumRuns;
+      (*PrunedGuards)[i] = PrunedGuards->back();
+      PrunedGuards->pop_back();
+      NumReenabled++;
+    }
+  }
+
+  size_t NumPruned = 0;
+  for (size_t i = 1; i < GetNumPCs(); i++) {
+    if (GetAllTimeCounter(i) < PruneHotCount ||
+        NumRuns - LastNewFeatureRun[i] < PruneStableRuns)
+      continue;
+    uint32_t *Guard = GetGuard(i);
+    if (!Guard || !*Guard) continue;
+    *Guard = 0;
+    PrunedGuards->push_back(i);
+    NumPruned++;
+  }
+
+  if (NumPruned || NumReenabled)
+    Printf("#%zd\tPRUNE pruned: %zd re-enabled: %zd disabled guards: %zd/%zd\n",
+           NumRuns, NumPruned, NumReenabled, PrunedGuards->size(), NumGuards);
+#endif
+}
+
+// Switches off the checks whose IDs are listed in IDsFile, one per line. IDs
+// are in the format that PrintAllTimeCounters uses, e.g., 0x1234abcd.
+void TracePC::DisableChecks(const std::string &IDsFile) {
+#ifdef FUSS
+  size_t NumSwitches =
+      __stop___asap_check_switches - __start___asap_check_switches;
+  size_t NumIDs =
+      __stop___asap_check_switch_ids - __start___asap_check_switch_ids;
+  if (!NumSwitches || NumSwitches != NumIDs) {
+    Printf("WARNING: %zd check switches for %zd IDs; not disabling checks\n",
+           NumSwitches, NumIDs);
+    return;
+  }
+  std::set<uint64_t> IDs;
+  std::istringstream ISS(FileToString(IDsFile));
+  std::string Line;
+  while (std::getline(ISS, Line))
+    if (!Line.empty())
+      IDs.insert(std::strtoull(Line.c_str(), nullptr, 0));
+  for (size_t i = 0; i < NumSwitches; i++) {
+    uint64_t ID = __start___asap_check_switch_ids[i];
+    if (ID && __start___asap_check_switches[i] && IDs.count(ID)) {
+      __start___asap_check_switches[i] = 0;
+      NumDisabledChecks++;
+    }
+  }
+  Printf("INFO: disabled %zd of %zd switchable checks\n", NumDisabledChecks,
+         NumSwitches);
+#else
+  Printf("WARNING: -disable_checks requires a FUSS build of libFuzzer; "
+         "ignoring it\n");
+#endif
+}
+
+// Switches all checks back on. Returns true if any were off.
+bool TracePC::EnableAllChecks() {
+#ifdef FUSS
+  if (!NumDisabledChecks)
+    return false;
+  size_t NumSwitches =
+      __stop___asap_check_switches - __start___asap_check_switches;
+  for (size_t i = 0; i < NumSwitches; i++)
+    __start___asap_check_switches[i] = 1;
+  NumDisabledChecks = 0;
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Makes multiversioned functions run their fully checked copy, or their lean
+// copy if Checked is false.
+void TracePC::UseCheckedVersions(bool Checked) {
+#ifdef FUSS
+  size_t NumFlags =
+      __stop___asap_checked_versions - __start___asap_checked_versions;
+  memset(__start___asap_checked_versions, Checked, NumFlags);
+#endif
 }
 
 void TracePC::PrintModuleInfo() {
@@ -60,6 +305,8 @@ void TracePC::PrintModuleInfo() {
   for (size_t i = 0; i < NumModules; i++)
     Printf("[%p, %p), ", Modules[i].Start, Modules[i].Stop);
   Printf("\n");
+  Printf("INFO: %zd guards in %zd modules, %zd bytes of counters per run\n",
+         NumGuards, NumModules, GuardArraysSize);
 }
 
 void TracePC::HandleCallerCallee(uintptr_t Caller, uintptr_t Callee) {
@@ -195,14 +442,31 @@ void TracePC::PrintAllTimeCounters() {
   uint64_t TotalTPCGCount = 0;
 
 #ifdef FUSS
+  // Check IDs can only be used if they match the guards one to one, i.e., if
+  // all guards are in the main binary and have IDs.
+  const uint64_t *CheckIDs = nullptr;
+  size_t NumCheckIDs = __stop___sancov_check_ids - __start___sancov_check_ids;
+  if (NumCheckIDs && NumCheckIDs == NumGuards)
+    CheckIDs = __start___sancov_check_ids;
+  else if (NumCheckIDs)
+    Printf("WARNING: %zd check IDs for %zd guards; not printing check IDs\n",
+           NumCheckIDs, NumGuards);
+
   if (UsingTracePcGuard()) {
     for (size_t i = 1; i < GetNumPCs(); i++) {
       if (!PCs[i]) continue;
 
-      Printf("AllTimeCounter: %p %zd %lld\n", PCs[i], i, AllTimeCounters[i]);
-      TotalTPCGCount += AllTimeCounters[i];
+      if (CheckIDs)
+        Printf("AllTimeCounter: %p %zd %lld 0x%llx\n", PCs[i], i,
+               GetAllTimeCounter(i), CheckIDs[i - 1]);
+      else
+        Printf("AllTimeCounter: %p %zd %lld\n", PCs[i], i,
+               GetAllTimeCounter(i));
+      TotalTPCGCount += GetAllTimeCounter(i);
     }
   }
+  if (PrunedGuards)
+    Printf("stat::pruned_guards:            %zd\n", PrunedGuards->size());
 #endif
   Printf("stat::total_tpcg_count:         %lld\n", TotalTPCGCount);
 }
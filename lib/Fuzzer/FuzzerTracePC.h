@@ -45,6 +45,8 @@ struct TableOfRecentCompares {
 class TracePC {
  public:
   static const size_t kFeatureSetSize = ValueBitMap::kNumberOfItems;
+  // The capacity of the arrays indexed by guard.
+  static const size_t kMaxGuards = 1 << 26;
 
   void HandleTrace(uint32_t *guard, uintptr_t PC);
   void HandleInit(uint32_t *start, uint32_t *stop);
@@ -55,6 +57,13 @@ class TracePC {
   void SetUseCounters(bool UC) { UseCounters = UC; }
   void SetUseValueProfile(bool VP) { UseValueProfile = VP; }
   void SetPrintNewPCs(bool P) { DoPrintNewPCs = P; }
+  void SetPruneStableGuards(size_t StableRuns, size_t HotCount,
+                            int ReenablePercent);
+  void SetExactAllTimeCounters(bool Exact);
+  void PruneStableGuards(Random &Rand);
+  void DisableChecks(const std::string &IDsFile);
+  bool EnableAllChecks();
+  void UseCheckedVersions(bool Checked);
   template <class Callback> size_t CollectFeatures(Callback CB);
   bool UpdateValueProfileMap(ValueBitMap *MaxValueProfileMap) {
     return UseValueProfile && MaxValueProfileMap->MergeFrom(ValueProfileMap);
@@ -62,7 +71,7 @@ class TracePC {
 
   void ResetMaps() {
     ValueProfileMap.Reset();
-    memset(Counters, 0, sizeof(Counters));
+    ClearCounters();
   }
 
   void UpdateFeatureSet(size_t CurrentElementIdx, size_t CurrentElementSize);
@@ -86,7 +95,12 @@ class TracePC {
   TableOfRecentCompares<uint64_t, kTORCSize> TORC8;
 
   void PrintNewPCs();
+#ifdef FUSS
+  size_t GetNumPCs() const { return Min(GuardArraysSize, NumGuards + 1); }
+#else
   size_t GetNumPCs() const { return Min(kNumPCs, NumGuards + 1); }
+#endif
+  size_t GetNumGuards() const { return NumGuards; }
   uintptr_t GetPC(size_t Idx) {
     assert(Idx < GetNumPCs());
     return PCs[Idx];
@@ -105,19 +119,53 @@ private:
   size_t NumModules;  // linker-initialized.
   size_t NumGuards;  // linker-initialized.
 
-  static const size_t kNumCounters = 1 << 14;
-  alignas(8) uint8_t Counters[kNumCounters];
+  // Arrays indexed by guard have room for kMaxGuards. Only their first
+  // GuardArraysSize entries are used, a multiple of kCounterBlock that covers
+  // all guards. The arrays never move, because other threads may run
+  // instrumented code while HandleInit adds a module.
+  static const size_t kCounterBlock = 64;
+  size_t GuardArraysSize;  // linker-initialized.
+  // Counts the executions of each guard in the current run.
+  alignas(kCounterBlock) uint8_t Counters[kMaxGuards];
 
-#ifdef FUSS
-  static const size_t kNumAllTimeCounters = 1 << 24;
-  uint64_t AllTimeCounters[kNumAllTimeCounters];
-#endif
+  void ClearCounters();
 
+#ifdef FUSS
+  // In FUSS builds, the other arrays indexed by guard are mapped, so that
+  // pages only take up memory once their guards run.
+  uintptr_t *PCs;  // linker-initialized.
+  // All-time counters saturate at UINT32_MAX, unless
+  // SetExactAllTimeCounters adds a table that counts their wrap-arounds.
+  uint32_t *AllTimeCounters;  // linker-initialized.
+  uint32_t *AllTimeCounterWraps;  // linker-initialized.
+
+  void MapGuardArrays();
+  uint64_t GetAllTimeCounter(size_t Idx) const;
+#else
   static const size_t kNumPCs = 1 << 24;
   uintptr_t PCs[kNumPCs];
+#endif
 
   std::set<uintptr_t> *PrintedPCs;
 
+#ifdef FUSS
+  // State for -prune_stable_guards. All of it is linker-initialized, because
+  // guards are set up before TPC's constructor runs.
+  size_t NumRuns;
+  size_t PruneStableRuns;
+  uint64_t PruneHotCount;
+  int PruneReenablePercent;
+  size_t LastReenableRun;
+  // The run in which each counter last produced a new feature.
+  size_t *LastNewFeatureRun;
+  std::vector<uint32_t> *PrunedGuards;
+
+  uint32_t *GetGuard(size_t Idx);
+
+  // The number of checks that DisableChecks switched off.
+  size_t NumDisabledChecks;
+#endif
+
   ValueBitMap ValueProfileMap;
 };
 
@@ -125,28 +173,44 @@ template <class Callback>
 size_t TracePC::CollectFeatures(Callback CB) {
   if (!UsingTracePcGuard()) return 0;
   size_t Res = 0;
+#ifdef FUSS
+  NumRuns++;
+#endif
+  // Most counters are zero in any given run. Skip whole blocks of them with
+  // a few loads, so that large programs do not slow down each execution.
   const size_t Step = 8;
   assert(reinterpret_cast<uintptr_t>(Counters) % Step == 0);
-  size_t N = Min(kNumCounters, NumGuards + 1);
-  N = (N + Step - 1) & ~(Step - 1);  // Round up.
-  for (size_t Idx = 0; Idx < N; Idx += Step) {
-    uint64_t Bundle = *reinterpret_cast<uint64_t*>(&Counters[Idx]);
-    if (!Bundle) continue;
-    for (size_t i = Idx; i < Idx + Step; i++) {
-      uint8_t Counter = (Bundle >> ((i - Idx) * 8)) & 0xff;
-      if (!Counter) continue;
-      Counters[i] = 0;
-      unsigned Bit = 0;
-      /**/ if (Counter >= 128) Bit = 7;
-      else if (Counter >= 32) Bit = 6;
-      else if (Counter >= 16) Bit = 5;
-      else if (Counter >= 8) Bit = 4;
-      else if (Counter >= 4) Bit = 3;
-      else if (Counter >= 3) Bit = 2;
-      else if (Counter >= 2) Bit = 1;
-      size_t Feature = (i * 8 + Bit);
-      if (CB(Feature))
-        Res++;
+  for (size_t Block = 0; Block < GuardArraysSize; Block += kCounterBlock) {
+    const uint64_t *Bundles =
+        reinterpret_cast<const uint64_t *>(&Counters[Block]);
+    uint64_t Any = 0;
+    for (size_t j = 0; j < kCounterBlock / Step; j++)
+      Any |= Bundles[j];
+    if (!Any) continue;
+    for (size_t Idx = Block; Idx < Block + kCounterBlock; Idx += Step) {
+      uint64_t Bundle = *reinterpret_cast<uint64_t*>(&Counters[Idx]);
+      if (!Bundle) continue;
+      for (size_t i = Idx; i < Idx + Step; i++) {
+        uint8_t Counter = (Bundle >> ((i - Idx) * 8)) & 0xff;
+        if (!Counter) continue;
+        Counters[i] = 0;
+        unsigned Bit = 0;
+        /**/ if (Counter >= 128) Bit = 7;
+        else if (Counter >= 32) Bit = 6;
+        else if (Counter >= 16) Bit = 5;
+        else if (Counter >= 8) Bit = 4;
+        else if (Counter >= 4) Bit = 3;
+        else if (Counter >= 3) Bit = 2;
+        else if (Counter >= 2) Bit = 1;
+        size_t Feature = (i * 8 + Bit);
+        if (CB(Feature)) {
+          Res++;
+#ifdef FUSS
+          if (LastNewFeatureRun)
+            LastNewFeatureRun[i] = NumRuns;
+#endif
+        }
+      }
     }
   }
   if (UseValueProfile)
@@ -0,0 +1,22 @@
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Test for -disable_checks. The tables stand in for those that ASAP emits
+// with -sanity-check-switches. The check with ID 0x1234 fails on inputs that
+// start with 'H', but only while its switch is on.
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+__attribute__((used, section("__asap_check_switches")))
+volatile uint8_t CheckSwitches[2] = {1, 1};
+__attribute__((used, section("__asap_check_switch_ids")))
+const uint64_t CheckSwitchIDs[2] = {0x1234, 0x5678};
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
+  if (Size > 0 && Data[0] == 'H' && CheckSwitches[0]) {
+    fprintf(stderr, "BINGO; check 0x1234 failed\n");
+    exit(1);
+  }
+  return 0;
+}
@@ -0,0 +1,23 @@
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Test for -checked_version_period. The flag stands in for the one that ASAP
+// emits with -asap-multiversion, which selects a fully checked copy.
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+__attribute__((used, section("__asap_checked_versions")))
+volatile uint8_t CheckedVersion = 0;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
+  static bool PrintedChecked, PrintedLean;
+  if (CheckedVersion && !PrintedChecked) {
+    PrintedChecked = true;
+    fprintf(stderr, "RAN CHECKED COPY\n");
+  } else if (!CheckedVersion && !PrintedLean) {
+    PrintedLean = true;
+    fprintf(stderr, "RAN LEAN COPY\n");
+  }
+  return 0;
+}
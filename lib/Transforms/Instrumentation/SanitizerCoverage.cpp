@@ -36,6 +36,7 @@
 #include "llvm/IR/CallSite.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
@@ -46,6 +47,7 @@
 #include "llvm/IR/Type.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Instrumentation.h"
 #include "llvm/Transforms/Scalar.h"
@@ -83,6 +85,8 @@ static const char *const SanCovTracePCGuardName =
     "__sanitizer_cov_trace_pc_guard";
 static const char *const SanCovTracePCGuardInitName =
     "__sanitizer_cov_trace_pc_guard_init";
+static const char *const SanCovCheckIDsSection = "__sancov_check_ids";
+static const char *const SanCovGuardTableSection = "__sancov_guard_table";
 
 static cl::opt<int> ClCoverageLevel(
     "sanitizer-coverage-level",
@@ -111,6 +115,21 @@ static cl::opt<bool> ClTracePCGuard("sanitizer-coverage-trace-pc-guard",
                                     cl::desc("pc tracing with a guard"),
                                     cl::Hidden, cl::init(false));
 
+static cl::opt<bool> ClCheckIDs(
+    "sanitizer-coverage-check-ids",
+    cl::desc("Attach stable IDs to trace-pc-guard callbacks, and emit them in "
+             "the __sancov_check_ids section, in the same order as the "
+             "guards"),
+    cl::Hidden, cl::init(false));
+
+static cl::opt<bool> ClGuardTable(
+    "sanitizer-coverage-guard-table",
+    cl::desc("Emit a __sancov_guard_table section with one record per "
+             "trace-pc-guard guard, in the same order as the guards: check "
+             "ID, function GUID, block ordinal, line and column. Implies "
+             "!checkid metadata on the callbacks"),
+    cl::Hidden, cl::init(false));
+
 static cl::opt<bool>
     ClCMPTracing("sanitizer-coverage-trace-compares",
                  cl::desc("Tracing of CMP and similar instructions"),
@@ -208,6 +227,9 @@ private:
                             ArrayRef<Instruction *> SwitchTraceTargets);
   bool InjectCoverage(Function &F, ArrayRef<BasicBlock *> AllBlocks);
   void CreateFunctionGuardArray(size_t NumGuards, Function &F);
+  void CreateFunctionCheckIDArray(Function &F);
+  void CreateFunctionGuardTable(Function &F);
+  void SetCheckID(Function &F, BasicBlock &BB, Instruction *I, size_t Idx);
   void SetNoSanitizeMetadata(Instruction *I);
   void InjectCoverageAtBlock(Function &F, BasicBlock &BB, size_t Idx,
                              bool UseCalls);
@@ -232,6 +254,10 @@ private:
 
   GlobalVariable *GuardArray;
   GlobalVariable *FunctionGuardArray;  // for trace-pc-guard.
+  SmallVector<uint64_t, 32> FunctionCheckIDs;  // for trace-pc-guard.
+  DenseMap<uint64_t, unsigned> FunctionCheckIDOrdinals;
+  SmallVector<Constant *, 32> FunctionGuardRecords;  // for trace-pc-guard.
+  DenseMap<const BasicBlock *, unsigned> FunctionBlockOrdinals;
   GlobalVariable *EightBitCounterArray;
   bool HasSancovGuardsSection;
 
@@ -518,6 +544,91 @@ void SanitizerCoverageModule::CreateFunctionGuardArray(size_t NumGuards,
   if (auto Comdat = F.getComdat())
     FunctionGuardArray->setComdat(Comdat);
   FunctionGuardArray->setSection(SanCovTracePCGuardSection);
+  if (ClCheckIDs || ClGuardTable) {
+    FunctionCheckIDs.assign(NumGuards, 0);
+    FunctionCheckIDOrdinals.clear();
+  }
+  if (ClGuardTable) {
+    FunctionGuardRecords.assign(NumGuards, nullptr);
+    FunctionBlockOrdinals.clear();
+    unsigned Ordinal = 0;
+    for (const BasicBlock &BB : F)
+      FunctionBlockOrdinals[&BB] = Ordinal++;
+  }
+}
+
+// Emits the IDs of the current function's guards into a side table, such that
+// tools can map guard indices to IDs.
+void SanitizerCoverageModule::CreateFunctionCheckIDArray(Function &F) {
+  if (!Options.TracePCGuard || !ClCheckIDs) return;
+  Constant *IDs = ConstantDataArray::get(*C, FunctionCheckIDs);
+  auto CheckIDArray = new GlobalVariable(
+      *CurModule, IDs->getType(), true, GlobalVariable::PrivateLinkage, IDs,
+      "__sancov_gen_check_ids");
+  if (auto Comdat = F.getComdat())
+    CheckIDArray->setComdat(Comdat);
+  CheckIDArray->setSection(SanCovCheckIDsSection);
+  CheckIDArray->setAlignment(8);
+  appendToUsed(*CurModule, {CheckIDArray});
+}
+
+// Emits one record per guard of the current function, so that tools can map
+// guard indices in a linked binary back to the code, without symbolizing it.
+// The record layout is { i64 check ID, i64 function GUID, i32 block ordinal,
+// i32 line, i32 column, i32 reserved }.
+void SanitizerCoverageModule::CreateFunctionGuardTable(Function &F) {
+  if (!Options.TracePCGuard || !ClGuardTable) return;
+  ArrayType *TableTy = ArrayType::get(FunctionGuardRecords[0]->getType(),
+                                      FunctionGuardRecords.size());
+  auto GuardTable = new GlobalVariable(
+      *CurModule, TableTy, true, GlobalVariable::PrivateLinkage,
+      ConstantArray::get(TableTy, FunctionGuardRecords),
+      "__sancov_gen_guard_table");
+  if (auto Comdat = F.getComdat())
+    GuardTable->setComdat(Comdat);
+  GuardTable->setSection(SanCovGuardTableSection);
+  GuardTable->setAlignment(8);
+  appendToUsed(*CurModule, {GuardTable});
+}
+
+// Attaches a stable ID to the callback I for guard Idx. Unlike the guard
+// index, the ID does not depend on the rest of the module: it hashes the
+// function's GUID, the callback's inlining stack and source location, the
+// callback's name, and an ordinal that distinguishes callbacks with equal
+// locations. BB is the instrumented block, whose ordinal goes into the guard
+// table.
+void SanitizerCoverageModule::SetCheckID(Function &F, BasicBlock &BB,
+                                         Instruction *I, size_t Idx) {
+  if (!ClCheckIDs && !ClGuardTable) return;
+  std::string Key;
+  raw_string_ostream OS(Key);
+  OS << F.getGUID() << ':' << cast<CallInst>(I)->getCalledFunction()->getName();
+  for (const DILocation *DIL = I->getDebugLoc(); DIL;
+       DIL = DIL->getInlinedAt()) {
+    OS << ':';
+    if (DISubprogram *SP = DIL->getScope()->getSubprogram())
+      OS << (SP->getLinkageName().empty() ? SP->getName()
+                                          : SP->getLinkageName());
+    OS << ':' << DIL->getLine() << ':' << DIL->getColumn() << ':'
+       << DIL->getDiscriminator();
+  }
+  unsigned Ordinal = FunctionCheckIDOrdinals[MD5Hash(OS.str())]++;
+  OS << ':' << Ordinal;
+  uint64_t ID = MD5Hash(OS.str());
+
+  FunctionCheckIDs[Idx] = ID;
+  if (ClGuardTable) {
+    const DILocation *DIL = I->getDebugLoc();
+    FunctionGuardRecords[Idx] = ConstantStruct::getAnon(
+        {ConstantInt::get(Int64Ty, ID), ConstantInt::get(Int64Ty, F.getGUID()),
+         ConstantInt::get(Int32Ty, FunctionBlockOrdinals.lookup(&BB)),
+         ConstantInt::get(Int32Ty, DIL ? DIL->getLine() : 0),
+         ConstantInt::get(Int32Ty, DIL ? DIL->getColumn() : 0),
+         ConstantInt::get(Int32Ty, 0)});
+  }
+  I->setMetadata(
+      "checkid",
+      MDNode::get(*C, ConstantAsMetadata::get(ConstantInt::get(Int64Ty, ID))));
 }
 
 bool SanitizerCoverageModule::InjectCoverage(Function &F,
@@ -529,12 +640,16 @@ bool SanitizerCoverageModule::InjectCoverage(Function &F,
   case SanitizerCoverageOptions::SCK_Function:
     CreateFunctionGuardArray(1, F);
     InjectCoverageAtBlock(F, F.getEntryBlock(), 0, false);
+    CreateFunctionCheckIDArray(F);
+    CreateFunctionGuardTable(F);
     return true;
   default: {
     bool UseCalls = ClCoverageBlockThreshold < AllBlocks.size();
     CreateFunctionGuardArray(AllBlocks.size(), F);
     for (size_t i = 0, N = AllBlocks.size(); i < N; i++)
       InjectCoverageAtBlock(F, *AllBlocks[i], i, UseCalls);
+    CreateFunctionCheckIDArray(F);
+    CreateFunctionGuardTable(F);
     return true;
   }
   }
@@ -708,7 +823,7 @@ void SanitizerCoverageModule::InjectCoverageAtBlock(Function &F, BasicBlock &BB,
       IRB.SetInsertPoint(Ins);
       IRB.SetCurrentDebugLocation(EntryLoc);
     }
-    IRB.CreateCall(SanCovTracePCGuard, GuardPtr);
+    SetCheckID(F, BB, IRB.CreateCall(SanCovTracePCGuard, GuardPtr), Idx);
     IRB.CreateCall(EmptyAsm, {}); // Avoids callback merge.
   } else {
     Value *GuardP = IRB.CreateAdd(
@@ -0,0 +1,166 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+//
+// Clones functions for their hottest call sites, so that ASAP can remove
+// checks in a hot calling context and keep them in all others.
+//
+// Check costs come from profile counts, which are per function. A helper that
+// is called from a hot loop and from many cold places has expensive checks,
+// and loses them for all callers. This pass gives each dominant call site its
+// own copy of the callee, and splits the callee's entry count between the
+// copy and the original. The cost passes then see a hot clone and a cold
+// original, and ASAP treats them separately. Branch weights within the callee
+// are shared by both copies; only the split between call sites is
+// context-sensitive.
+
+#include "llvm/Transforms/SanityChecks/SanityCheckInstructions.h"
+#include "llvm/Transforms/SanityChecks/utils.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#define DEBUG_TYPE "asap-clone-hot-callsites"
+
+using namespace llvm;
+
+STATISTIC(NumClones, "Number of functions cloned for hot call sites");
+
+static cl::opt<double> CloneHotFraction(
+    "asap-clone-hot-fraction",
+    cl::desc("Clone a function for each call site that makes at least this "
+             "fraction of its calls"),
+    cl::init(0.5));
+
+static cl::opt<unsigned long long> CloneMinCount(
+    "asap-clone-min-count",
+    cl::desc("Only clone functions for call sites that execute at least this "
+             "often"),
+    cl::init(1000));
+
+namespace {
+struct AsapCloneHotCallSites : public ModulePass {
+  static char ID;
+
+  AsapCloneHotCallSites() : ModulePass(ID) {
+    initializeAsapCloneHotCallSitesPass(*PassRegistry::getPassRegistry());
+  }
+
+  virtual bool runOnModule(Module &M) override;
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<BlockFrequencyInfoWrapperPass>();
+    AU.addRequired<SanityCheckInstructions>();
+  }
+};
+
+// A call site and the number of times it was executed.
+typedef std::pair<Instruction *, uint64_t> CallSiteCount;
+} // anonymous namespace
+
+// Returns true if F can be cloned for some of its call sites.
+static bool isCloningCandidate(const Function &F) {
+  return !F.isDeclaration() && !F.isInterposable() &&
+         F.getEntryCount().hasValue() && F.getEntryCount().getValue() > 0;
+}
+
+bool AsapCloneHotCallSites::runOnModule(Module &M) {
+  // Only functions that contain checks are worth cloning. Callees are visited
+  // in module order, so that clones are created in a deterministic order.
+  MapVector<Function *, std::vector<CallSiteCount>> CallSites;
+  for (Function &F : M) {
+    if (isCloningCandidate(F) &&
+        !getAnalysis<SanityCheckInstructions>(F).getSanityCheckRoots().empty()) {
+      CallSites[&F];
+    }
+  }
+  if (CallSites.empty()) {
+    return false;
+  }
+
+  // Count the executions of direct calls to these functions.
+  for (Function &Caller : M) {
+    if (Caller.isDeclaration() || !Caller.getEntryCount().hasValue()) {
+      continue;
+    }
+    BlockFrequencyInfo *BFI = nullptr;
+    for (Instruction &I : instructions(Caller)) {
+      CallSite CS(&I);
+      if (!CS || !CS.getCalledFunction() ||
+          CS.getCalledFunction() == &Caller) {
+        continue;
+      }
+      auto Sites = CallSites.find(CS.getCalledFunction());
+      if (Sites == CallSites.end()) {
+        continue;
+      }
+      if (!BFI) {
+        BFI = &getAnalysis<BlockFrequencyInfoWrapperPass>(Caller).getBFI();
+      }
+      Optional<uint64_t> Count = BFI->getBlockProfileCount(I.getParent());
+      if (Count.hasValue() && Count.getValue() > 0) {
+        Sites->second.push_back(CallSiteCount(&I, Count.getValue()));
+      }
+    }
+  }
+
+  bool Changed = false;
+  for (auto &Sites : CallSites) {
+    Function *Callee = Sites.first;
+    // Call sites are compared to all calls of the callee, not to those that
+    // remain after earlier clones.
+    const uint64_t OriginalEntryCount = Callee->getEntryCount().getValue();
+    uint64_t EntryCount = OriginalEntryCount;
+    std::stable_sort(Sites.second.begin(), Sites.second.end(),
+                     [](const CallSiteCount &a, const CallSiteCount &b) {
+                       return a.second > b.second;
+                     });
+    for (const CallSiteCount &Site : Sites.second) {
+      uint64_t Count = Site.second;
+      if (Count < CloneMinCount ||
+          Count < CloneHotFraction * OriginalEntryCount) {
+        break;
+      }
+      // There is no other context to keep checks for if this call site
+      // makes all calls.
+      if (Count >= OriginalEntryCount) {
+        continue;
+      }
+
+      Function *Clone = cloneFunction(Callee, ".asap.hot");
+      Clone->setEntryCount(Count);
+      CallSite(Site.first).setCalledFunction(Clone);
+      // Block counts are estimates; the original never gets a negative count.
+      EntryCount -= std::min(EntryCount, Count);
+      Callee->setEntryCount(EntryCount);
+
+      DEBUG(dbgs() << "AsapCloneHotCallSites: cloned " << Callee->getName()
+                   << " for a call from "
+                   << Site.first->getFunction()->getName() << " (" << Count
+                   << " calls)\n");
+      NumClones += 1;
+      Changed = true;
+    }
+  }
+  return Changed;
+}
+
+char AsapCloneHotCallSites::ID = 0;
+INITIALIZE_PASS_BEGIN(AsapCloneHotCallSites, "asap-clone-hot-callsites",
+                      "Clones functions with sanity checks for hot call sites",
+                      false, false)
+INITIALIZE_PASS_DEPENDENCY(BlockFrequencyInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_END(AsapCloneHotCallSites, "asap-clone-hot-callsites",
+                    "Clones functions with sanity checks for hot call sites",
+                    false, false)
@@ -0,0 +1,701 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+//
+// Finds sanity checks that may depend on fuzzer input, and marks each check
+// root with "inputdependent" metadata (see
+// SanityCheckInstructions::isInputDependent).
+//
+// When fuzzing, a check whose operands are the same for every input cannot be
+// triggered by mutations. This pass propagates input dependence from the
+// arguments of LLVMFuzzerTestOneInput through the whole module:
+// - along def-use chains, including call arguments and return values;
+// - through memory: values loaded from memory that may hold input depend on
+//   input. Stack objects whose address does not escape are tracked
+//   individually; all other memory is a single location. ASan moves stack
+//   objects into a frame, which it addresses as a base plus a constant
+//   offset; each such slot is tracked like an alloca. Writes to the frame's
+//   shadow and to other bookkeeping of ASan only matter to checks, and are
+//   ignored;
+// - through control dependence: if a branch depends on input, so do the phi
+//   nodes that merge its paths and the memory written by stores that are
+//   control dependent on it. This covers induction variables of loops with an
+//   input-dependent trip count, and variables assigned under input-dependent
+//   conditions. Control dependence is computed from the post-dominator tree.
+// Calls to external functions or through pointers are assumed to return
+// input, write it to their pointer arguments, and pass it on to all
+// address-taken functions.
+//
+// The analysis assumes that it sees the whole program, e.g., during LTO. If
+// the module does not define LLVMFuzzerTestOneInput, the arguments of all
+// externally visible functions are considered input.
+
+#include "llvm/Transforms/SanityChecks/SanityCheckInstructions.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+#include <map>
+#include <memory>
+#include <vector>
+#define DEBUG_TYPE "asap-input-dependence"
+
+using namespace llvm;
+
+STATISTIC(NumInputDependent, "Number of checks that may depend on input");
+STATISTIC(NumInputIndependent, "Number of checks that cannot depend on input");
+
+static cl::opt<std::string> InputFunction(
+    "asap-input-function",
+    cl::desc("The function whose arguments are the program's input"),
+    cl::init("LLVMFuzzerTestOneInput"));
+
+namespace {
+struct AsapInputDependence : public ModulePass {
+  static char ID;
+
+  AsapInputDependence() : ModulePass(ID) {
+    initializeAsapInputDependencePass(*PassRegistry::getPassRegistry());
+  }
+
+  virtual bool runOnModule(Module &M) override;
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<SanityCheckInstructions>();
+  }
+
+private:
+  const DataLayout *DL = nullptr;
+
+  // Values that may depend on input, and those whose users still need to be
+  // visited.
+  DenseSet<const Value *> Tainted;
+  std::vector<const Value *> Worklist;
+
+  // The instructions of each check, and of all checks together. Checks read
+  // shadow memory, but not program memory.
+  std::map<Instruction *, std::vector<Instruction *>> CheckInstructions;
+  DenseSet<const Instruction *> AllCheckInstructions;
+
+  // Stack objects whose address does not escape, with the instructions that
+  // read them.
+  DenseMap<const Value *, std::vector<Instruction *>> LocalReaders;
+  DenseSet<const Value *> TaintedLocals;
+  DenseMap<const Value *, bool> IsLocalCache;
+
+  // Slots of ASan stack frames, as (frame base, offset). Each slot is keyed
+  // by the first inttoptr that addresses it.
+  DenseMap<std::pair<const Value *, uint64_t>, const Value *> FrameSlotKeys;
+  DenseMap<const Value *, std::pair<const Value *, uint64_t>> FrameSlots;
+  DenseMap<const Value *, bool> IsFrameBaseCache;
+
+  // Instructions that read any other memory.
+  std::vector<Instruction *> NonLocalReaders;
+  bool NonLocalMemoryTainted = false;
+
+  // Functions that can be called through pointers, and calls whose callee
+  // we don't see.
+  std::vector<Function *> AddressTakenFunctions;
+  std::vector<Instruction *> UnknownCalls;
+  DenseSet<const Instruction *> TaintedUnknownCalls;
+  bool AddressTakenArgsTainted = false;
+  bool AddressTakenReturnsTainted = false;
+  DenseSet<const Function *> TaintedReturns;
+
+  // Post-dominator trees, built on demand, and blocks whose terminator
+  // depends on input.
+  DenseMap<const Function *, std::unique_ptr<PostDominatorTree>> PostDomTrees;
+  DenseSet<const BasicBlock *> TaintedBranches;
+
+  // Collects the check instructions and memory readers of F.
+  void collectInstructions(Function &F);
+
+  // Returns the stack object that Object is, or null if it is other memory.
+  // Object is an underlying object, as given by GetUnderlyingObject.
+  const Value *getStackObject(const Value *Object);
+
+  // Returns true if V is the base address of an ASan stack frame: a pointer
+  // to an alloca that is only used as an integer, or a fake stack from
+  // __asan_stack_malloc_*.
+  bool isFrameBase(const Value *V);
+
+  // Returns true if Object is ASan's bookkeeping for a stack frame, such as
+  // its shadow.
+  bool isFrameBookkeeping(const Value *Object);
+
+  // Returns true if the address of the stack object Object is only used to
+  // load and store.
+  bool isLocal(const Value *Object);
+
+  // Records that I reads the memory Ptr points to.
+  void addReader(Instruction *I, const Value *Ptr);
+
+  // Propagates input dependence from V to its users.
+  void visitUsers(const Value *V);
+
+  void taint(const Value *V);
+  void taintMemory(const Value *Ptr);
+  void taintNonLocalMemory();
+  void taintReader(Instruction *I);
+  void taintUnknownCall(Instruction *I);
+  void taintReturn(const Function *F);
+  void taintAddressTakenArgs();
+
+  // Taints everything that BB's terminator decides: phi nodes that merge its
+  // paths, and memory written in blocks that are control dependent on it.
+  void taintControlDependents(BasicBlock *BB);
+  PostDominatorTree &getPostDomTree(Function &F);
+};
+} // anonymous namespace
+
+bool AsapInputDependence::runOnModule(Module &M) {
+  DL = &M.getDataLayout();
+  for (Function &F : M) {
+    if (F.hasAddressTaken()) {
+      AddressTakenFunctions.push_back(&F);
+    }
+    if (!F.isDeclaration()) {
+      collectInstructions(F);
+    }
+  }
+  if (CheckInstructions.empty()) {
+    return false;
+  }
+
+  Function *Entry = M.getFunction(InputFunction);
+  for (Function &F : M) {
+    if (F.isDeclaration()) {
+      continue;
+    }
+    if (Entry && !Entry->isDeclaration() ? &F == Entry
+                                         : !F.hasLocalLinkage()) {
+      for (Argument &Arg : F.args()) {
+        taint(&Arg);
+      }
+    }
+  }
+  while (!Worklist.empty()) {
+    const Value *V = Worklist.back();
+    Worklist.pop_back();
+    visitUsers(V);
+  }
+
+  // A check depends on input if any of its instructions does.
+  bool Changed = false;
+  for (auto &CI : CheckInstructions) {
+    // Coverage guides the fuzzer; it matters regardless of input dependence.
+    Instruction *Root = CI.first;
+    if (isSanitizerCoverage(Root)) {
+      continue;
+    }
+    bool Dependent = false;
+    for (Instruction *I : CI.second) {
+      if (Tainted.count(I)) {
+        Dependent = true;
+        break;
+      }
+    }
+    LLVMContext &Ctx = Root->getContext();
+    Root->setMetadata(
+        "inputdependent",
+        MDNode::get(Ctx, ConstantAsMetadata::get(ConstantInt::get(
+                             Type::getInt1Ty(Ctx), Dependent))));
+    if (Dependent) {
+      NumInputDependent += 1;
+    } else {
+      NumInputIndependent += 1;
+      DEBUG(dbgs() << "AsapInputDependence: input-independent check at ";
+            printDebugLoc(getInstrumentationDebugLoc(Root), Ctx, dbgs());
+            dbgs() << "\n");
+    }
+    Changed = true;
+  }
+
+  Tainted.clear();
+  CheckInstructions.clear();
+  AllCheckInstructions.clear();
+  LocalReaders.clear();
+  TaintedLocals.clear();
+  IsLocalCache.clear();
+  FrameSlotKeys.clear();
+  FrameSlots.clear();
+  IsFrameBaseCache.clear();
+  NonLocalReaders.clear();
+  AddressTakenFunctions.clear();
+  UnknownCalls.clear();
+  TaintedUnknownCalls.clear();
+  TaintedReturns.clear();
+  PostDomTrees.clear();
+  TaintedBranches.clear();
+  NonLocalMemoryTainted = false;
+  AddressTakenArgsTainted = false;
+  AddressTakenReturnsTainted = false;
+  return Changed;
+}
+
+void AsapInputDependence::collectInstructions(Function &F) {
+  SanityCheckInstructions &SCI = getAnalysis<SanityCheckInstructions>(F);
+  for (Instruction *Root : SCI.getSanityCheckRoots()) {
+    const InstructionSet &Insts = SCI.getInstructionsBySanityCheck(Root);
+    CheckInstructions[Root].assign(Insts.begin(), Insts.end());
+    AllCheckInstructions.insert(Insts.begin(), Insts.end());
+  }
+
+  for (Instruction &I : instructions(F)) {
+    if (AllCheckInstructions.count(&I)) {
+      continue;
+    }
+    if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+      addReader(LI, LI->getPointerOperand());
+    } else if (VAArgInst *VAI = dyn_cast<VAArgInst>(&I)) {
+      addReader(VAI, VAI->getPointerOperand());
+    } else if (AtomicRMWInst *RMW = dyn_cast<AtomicRMWInst>(&I)) {
+      addReader(RMW, RMW->getPointerOperand());
+    } else if (AtomicCmpXchgInst *CX = dyn_cast<AtomicCmpXchgInst>(&I)) {
+      addReader(CX, CX->getPointerOperand());
+    } else if (MemTransferInst *MTI = dyn_cast<MemTransferInst>(&I)) {
+      addReader(MTI, MTI->getRawSource());
+    } else if (isa<IntrinsicInst>(&I)) {
+      continue;
+    } else if (CallSite CS = CallSite(&I)) {
+      Function *Callee = CS.getCalledFunction();
+      if (Callee && !Callee->isDeclaration()) {
+        continue;
+      }
+      if (!Callee) {
+        UnknownCalls.push_back(&I);
+      }
+      for (Value *Arg : CS.args()) {
+        if (Arg->getType()->isPointerTy()) {
+          addReader(&I, Arg);
+        }
+      }
+    }
+  }
+}
+
+const Value *AsapInputDependence::getStackObject(const Value *Object) {
+  if (isa<AllocaInst>(Object)) {
+    return Object;
+  }
+  const IntToPtrInst *ITP = dyn_cast<IntToPtrInst>(Object);
+  if (!ITP) {
+    return nullptr;
+  }
+  const Value *Base = ITP->getOperand(0);
+  uint64_t Offset = 0;
+  while (const BinaryOperator *BO = dyn_cast<BinaryOperator>(Base)) {
+    const ConstantInt *C = dyn_cast<ConstantInt>(BO->getOperand(1));
+    if (BO->getOpcode() != Instruction::Add || !C) {
+      break;
+    }
+    Offset += C->getZExtValue();
+    Base = BO->getOperand(0);
+  }
+  if (!isFrameBase(Base)) {
+    return nullptr;
+  }
+  const Value *Key =
+      FrameSlotKeys.insert(std::make_pair(std::make_pair(Base, Offset), ITP))
+          .first->second;
+  FrameSlots[Key] = std::make_pair(Base, Offset);
+  return Key;
+}
+
+bool AsapInputDependence::isFrameBase(const Value *V) {
+  auto Cached = IsFrameBaseCache.find(V);
+  if (Cached != IsFrameBaseCache.end()) {
+    return Cached->second;
+  }
+  bool Base = false;
+  if (const PtrToIntInst *PTI = dyn_cast<PtrToIntInst>(V)) {
+    const AllocaInst *AI = dyn_cast<AllocaInst>(PTI->getOperand(0));
+    Base = AI && AI->hasOneUse();
+  } else if (ImmutableCallSite CS = ImmutableCallSite(V)) {
+    const Function *Callee = CS.getCalledFunction();
+    Base = Callee && Callee->getName().startswith("__asan_stack_malloc_");
+  } else if (const PHINode *Phi = dyn_cast<PHINode>(V)) {
+    // The frame is on the fake stack if there is one, and on the real stack
+    // otherwise. Cycles through phis are not frame bases.
+    IsFrameBaseCache[V] = false;
+    Base = true;
+    for (const Value *Incoming : Phi->incoming_values()) {
+      const ConstantInt *C = dyn_cast<ConstantInt>(Incoming);
+      if (!(C && C->isZero()) && !isFrameBase(Incoming)) {
+        Base = false;
+        break;
+      }
+    }
+  }
+  IsFrameBaseCache[V] = Base;
+  return Base;
+}
+
+bool AsapInputDependence::isFrameBookkeeping(const Value *Object) {
+  // Shadow addresses are shifted frame addresses. ASan also loads the
+  // address of a flag from the fake stack, and clears it on return.
+  const IntToPtrInst *ITP = dyn_cast<IntToPtrInst>(Object);
+  if (!ITP) {
+    return false;
+  }
+  bool Derived = false;
+  const Value *V = ITP->getOperand(0);
+  while (true) {
+    if (const BinaryOperator *BO = dyn_cast<BinaryOperator>(V)) {
+      if (!isa<Constant>(BO->getOperand(1))) {
+        return false;
+      }
+      Derived |= BO->getOpcode() == Instruction::LShr;
+      V = BO->getOperand(0);
+    } else if (const LoadInst *LI = dyn_cast<LoadInst>(V)) {
+      const IntToPtrInst *Ptr = dyn_cast<IntToPtrInst>(LI->getPointerOperand());
+      if (!Ptr) {
+        return false;
+      }
+      Derived = true;
+      V = Ptr->getOperand(0);
+    } else {
+      return Derived && isFrameBase(V);
+    }
+  }
+}
+
+bool AsapInputDependence::isLocal(const Value *Object) {
+  auto Cached = IsLocalCache.find(Object);
+  if (Cached != IsLocalCache.end()) {
+    return Cached->second;
+  }
+  bool Local = true;
+  SmallVector<const Value *, 8> Pointers(1, Object);
+  // All addresses of a frame slot count, not only its key.
+  auto Slot = FrameSlots.find(Object);
+  if (Slot != FrameSlots.end()) {
+    const Value *Base = Slot->second.first;
+    uint64_t Offset = Slot->second.second;
+    for (const User *U : Base->users()) {
+      if (isa<IntToPtrInst>(U)) {
+        if (Offset == 0 && U != Object) {
+          Pointers.push_back(U);
+        }
+        continue;
+      }
+      const BinaryOperator *BO = dyn_cast<BinaryOperator>(U);
+      const ConstantInt *C =
+          BO ? dyn_cast<ConstantInt>(BO->getOperand(1)) : nullptr;
+      if (!BO || BO->getOpcode() != Instruction::Add || !C ||
+          C->getZExtValue() != Offset) {
+        continue;
+      }
+      for (const User *UU : BO->users()) {
+        if (isa<IntToPtrInst>(UU) && UU != Object) {
+          Pointers.push_back(UU);
+        }
+      }
+    }
+  }
+  while (Local && !Pointers.empty()) {
+    const Value *V = Pointers.pop_back_val();
+    for (const User *U : V->users()) {
+      const Instruction *I = dyn_cast<Instruction>(U);
+      if (!I || AllCheckInstructions.count(I) || isa<LoadInst>(I) ||
+          isa<DbgInfoIntrinsic>(I)) {
+        continue;
+      }
+      if (isa<GetElementPtrInst>(I) || isa<BitCastInst>(I)) {
+        Pointers.push_back(I);
+      } else if (const StoreInst *SI = dyn_cast<StoreInst>(I)) {
+        Local &= SI->getValueOperand() != V;
+      } else if (const IntrinsicInst *II = dyn_cast<IntrinsicInst>(I)) {
+        Local &= isa<MemIntrinsic>(II) ||
+                 II->getIntrinsicID() == Intrinsic::lifetime_start ||
+                 II->getIntrinsicID() == Intrinsic::lifetime_end;
+      } else {
+        Local = false;
+      }
+    }
+  }
+  IsLocalCache[Object] = Local;
+  return Local;
+}
+
+void AsapInputDependence::addReader(Instruction *I, const Value *Ptr) {
+  const Value *Object = GetUnderlyingObject(Ptr, *DL, 0);
+  if (const Value *Local = getStackObject(Object)) {
+    if (isLocal(Local)) {
+      LocalReaders[Local].push_back(I);
+      return;
+    }
+  }
+  if (isFrameBookkeeping(Object)) {
+    return;
+  }
+  // Constant globals never hold input.
+  if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(Object)) {
+    if (GV->isConstant()) {
+      return;
+    }
+  }
+  NonLocalReaders.push_back(I);
+}
+
+void AsapInputDependence::visitUsers(const Value *V) {
+  for (const User *U : V->users()) {
+    Instruction *I = const_cast<Instruction *>(dyn_cast<Instruction>(U));
+    if (!I) {
+      continue;
+    }
+    if (AllCheckInstructions.count(I)) {
+      taint(I);
+      continue;
+    }
+
+    if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+      // Storing to an input-dependent address does not make the stored value
+      // depend on input.
+      if (SI->getValueOperand() == V) {
+        taintMemory(SI->getPointerOperand());
+      }
+    } else if (AtomicRMWInst *RMW = dyn_cast<AtomicRMWInst>(I)) {
+      if (RMW->getPointerOperand() != V) {
+        taintMemory(RMW->getPointerOperand());
+      }
+      taint(I);
+    } else if (AtomicCmpXchgInst *CX = dyn_cast<AtomicCmpXchgInst>(I)) {
+      if (CX->getPointerOperand() != V) {
+        taintMemory(CX->getPointerOperand());
+      }
+      taint(I);
+    } else if (MemIntrinsic *MI = dyn_cast<MemIntrinsic>(I)) {
+      if (MI->getRawDest() != V) {
+        taintMemory(MI->getRawDest());
+      }
+    } else if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(I)) {
+      if (II->getIntrinsicID() != Intrinsic::lifetime_start &&
+          II->getIntrinsicID() != Intrinsic::lifetime_end) {
+        taint(I);
+      }
+    } else if (CallSite CS = CallSite(I)) {
+      Function *Callee = CS.getCalledFunction();
+      if (!Callee || Callee->isDeclaration()) {
+        taintUnknownCall(I);
+        continue;
+      }
+      for (unsigned i = 0, e = CS.arg_size(); i != e; ++i) {
+        if (CS.getArgument(i) != V) {
+          continue;
+        }
+        if (i < Callee->arg_size()) {
+          taint(&*std::next(Callee->arg_begin(), i));
+        } else {
+          // Variable arguments are read through a va_list.
+          taintNonLocalMemory();
+        }
+      }
+    } else if (isa<ReturnInst>(I)) {
+      taintReturn(I->getFunction());
+    } else if (isa<TerminatorInst>(I)) {
+      taint(I);
+      taintControlDependents(I->getParent());
+    } else {
+      taint(I);
+    }
+  }
+}
+
+void AsapInputDependence::taint(const Value *V) {
+  if (Tainted.insert(V).second) {
+    Worklist.push_back(V);
+  }
+}
+
+void AsapInputDependence::taintMemory(const Value *Ptr) {
+  const Value *Object = GetUnderlyingObject(Ptr, *DL, 0);
+  if (isFrameBookkeeping(Object)) {
+    return;
+  }
+  const Value *Local = getStackObject(Object);
+  auto Readers = Local ? LocalReaders.find(Local) : LocalReaders.end();
+  if (Readers == LocalReaders.end()) {
+    // Objects without readers need no tracking, unless they might be read
+    // through other pointers.
+    if (!Local || !isLocal(Local)) {
+      taintNonLocalMemory();
+    }
+    return;
+  }
+  if (TaintedLocals.insert(Local).second) {
+    for (Instruction *I : Readers->second) {
+      taintReader(I);
+    }
+  }
+}
+
+void AsapInputDependence::taintNonLocalMemory() {
+  if (NonLocalMemoryTainted) {
+    return;
+  }
+  NonLocalMemoryTainted = true;
+  for (Instruction *I : NonLocalReaders) {
+    taintReader(I);
+  }
+}
+
+void AsapInputDependence::taintReader(Instruction *I) {
+  if (MemTransferInst *MTI = dyn_cast<MemTransferInst>(I)) {
+    taintMemory(MTI->getRawDest());
+  } else if (isa<LoadInst>(I) || isa<VAArgInst>(I) || isa<AtomicRMWInst>(I) ||
+             isa<AtomicCmpXchgInst>(I)) {
+    taint(I);
+  } else {
+    taintUnknownCall(I);
+  }
+}
+
+void AsapInputDependence::taintUnknownCall(Instruction *I) {
+  if (!TaintedUnknownCalls.insert(I).second) {
+    return;
+  }
+  taint(I);
+  for (Value *Arg : CallSite(I).args()) {
+    if (Arg->getType()->isPointerTy()) {
+      taintMemory(Arg);
+    }
+  }
+  taintAddressTakenArgs();
+}
+
+void AsapInputDependence::taintReturn(const Function *F) {
+  if (!TaintedReturns.insert(F).second) {
+    return;
+  }
+  for (const User *U : F->users()) {
+    ImmutableCallSite CS(U);
+    if (CS && CS.getCalledFunction() == F) {
+      taint(CS.getInstruction());
+    }
+  }
+  if (F->hasAddressTaken() && !AddressTakenReturnsTainted) {
+    AddressTakenReturnsTainted = true;
+    for (Instruction *I : UnknownCalls) {
+      taint(I);
+    }
+  }
+}
+
+void AsapInputDependence::taintAddressTakenArgs() {
+  if (AddressTakenArgsTainted) {
+    return;
+  }
+  AddressTakenArgsTainted = true;
+  for (Function *F : AddressTakenFunctions) {
+    for (Argument &Arg : F->args()) {
+      taint(&Arg);
+    }
+  }
+}
+
+void AsapInputDependence::taintControlDependents(BasicBlock *BB) {
+  SmallVector<BasicBlock *, 8> Branches(1, BB);
+  while (!Branches.empty()) {
+    BasicBlock *Branch = Branches.pop_back_val();
+    if (!TaintedBranches.insert(Branch).second) {
+      continue;
+    }
+
+    // A block is control dependent on Branch if it post-dominates one of
+    // Branch's successors, but not Branch itself. These blocks lie on the
+    // post-dominator tree paths from the successors up to Branch's immediate
+    // post-dominator. Blocks that cannot reach an exit have no node in the
+    // tree; in that case, the whole function is considered dependent.
+    Function &F = *Branch->getParent();
+    PostDominatorTree &PDT = getPostDomTree(F);
+    SmallPtrSet<BasicBlock *, 16> Dependents;
+    DomTreeNode *BranchNode = PDT.getNode(Branch);
+    for (BasicBlock *Succ : successors(Branch)) {
+      DomTreeNode *Node = PDT.getNode(Succ);
+      if (!BranchNode || !Node) {
+        for (BasicBlock &B : F) {
+          Dependents.insert(&B);
+        }
+        break;
+      }
+      for (; Node && Node != BranchNode->getIDom(); Node = Node->getIDom()) {
+        if (Node->getBlock()) {
+          Dependents.insert(Node->getBlock());
+        }
+      }
+    }
+
+    // Phi nodes that merge paths from Branch or its dependents select
+    // between values depending on input. This includes the phi nodes at
+    // Branch's immediate post-dominator.
+    SmallPtrSet<BasicBlock *, 16> Merges(Dependents.begin(), Dependents.end());
+    for (BasicBlock *B : Dependents) {
+      Merges.insert(succ_begin(B), succ_end(B));
+    }
+    Merges.insert(succ_begin(Branch), succ_end(Branch));
+    for (BasicBlock *B : Merges) {
+      for (Instruction &Phi : *B) {
+        if (!isa<PHINode>(&Phi)) {
+          break;
+        }
+        taint(&Phi);
+      }
+    }
+
+    // Whether dependent stores and returns run depends on input, and so do
+    // the memory and return values they write. Branches in dependent blocks
+    // are dependent, too.
+    for (BasicBlock *B : Dependents) {
+      for (Instruction &I : *B) {
+        if (AllCheckInstructions.count(&I)) {
+          continue;
+        }
+        if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+          taintMemory(SI->getPointerOperand());
+        } else if (MemIntrinsic *MI = dyn_cast<MemIntrinsic>(&I)) {
+          taintMemory(MI->getRawDest());
+        } else if (isa<ReturnInst>(&I)) {
+          taintReturn(&F);
+        }
+      }
+      if (B->getTerminator()->getNumSuccessors() > 1) {
+        Branches.push_back(B);
+      }
+    }
+  }
+}
+
+PostDominatorTree &AsapInputDependence::getPostDomTree(Function &F) {
+  std::unique_ptr<PostDominatorTree> &PDT = PostDomTrees[&F];
+  if (!PDT) {
+    PDT.reset(new PostDominatorTree());
+    PDT->recalculate(F);
+  }
+  return *PDT;
+}
+
+char AsapInputDependence::ID = 0;
+INITIALIZE_PASS_BEGIN(AsapInputDependence, "asap-input-dependence",
+                      "Finds sanity checks that may depend on program input",
+                      false, false)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_END(AsapInputDependence, "asap-input-dependence",
+                    "Finds sanity checks that may depend on program input",
+                    false, false)
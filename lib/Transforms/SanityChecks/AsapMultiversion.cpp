@@ -0,0 +1,193 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+//
+// Keeps a fully checked copy of the hottest functions, so that a fuzzer can
+// choose at runtime between speed and safety.
+//
+// For each selected function F, this pass creates an internal clone
+// F.asap.checked, which ASAP leaves alone. The original F stays in place for
+// all its callers, and ASAP removes its expensive checks as usual; it becomes
+// the lean copy. On entry, F tests a per-function flag, and forwards the call
+// to the checked copy if the flag is non-zero. The flags are bytes in the
+// __asap_checked_versions section, initialized to zero; libFuzzer sets them
+// for some executions (see -checked_version_period).
+//
+// The dispatch happens in the callee rather than at each call site. This
+// costs the same load and branch per call, and also covers indirect calls
+// and calls from other modules.
+
+#include "llvm/Transforms/SanityChecks/SanityCheckInstructions.h"
+#include "llvm/Transforms/SanityChecks/utils.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <algorithm>
+#include <vector>
+#define DEBUG_TYPE "asap-multiversion"
+
+using namespace llvm;
+
+STATISTIC(NumMultiversioned, "Number of functions with a fully checked copy");
+
+static cl::opt<unsigned> MultiversionCount(
+    "asap-multiversion-count",
+    cl::desc("Keep a fully checked copy of this many of the hottest functions"),
+    cl::init(16));
+
+static cl::opt<unsigned long long> MultiversionMinCount(
+    "asap-multiversion-min-count",
+    cl::desc("Only keep a checked copy of functions that are called at least "
+             "this often"),
+    cl::init(1000));
+
+static const char *const CheckedVersionsSection = "__asap_checked_versions";
+
+namespace {
+struct AsapMultiversion : public ModulePass {
+  static char ID;
+
+  AsapMultiversion() : ModulePass(ID) {
+    initializeAsapMultiversionPass(*PassRegistry::getPassRegistry());
+  }
+
+  virtual bool runOnModule(Module &M) override;
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<SanityCheckInstructions>();
+  }
+
+private:
+  // Returns true if F contains checks other than SanitizerCoverage.
+  bool hasChecks(Function &F);
+
+  // Creates the checked copy of F, and makes F dispatch to it.
+  void multiversion(Function &F);
+};
+} // anonymous namespace
+
+// Returns true if calls to F can be forwarded to a copy of F.
+static bool isMultiversioningCandidate(const Function &F) {
+  if (F.isDeclaration() || F.isInterposable() || F.isVarArg() ||
+      isCheckedVersion(F) || F.hasFnAttribute(Attribute::Naked) ||
+      !F.getEntryCount().hasValue() ||
+      F.getEntryCount().getValue() < MultiversionMinCount ||
+      F.getEntryCount().getValue() == 0) {
+    return false;
+  }
+  for (const Argument &Arg : F.args()) {
+    if (Arg.hasInAllocaAttr()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool AsapMultiversion::hasChecks(Function &F) {
+  for (Instruction *Root :
+       getAnalysis<SanityCheckInstructions>(F).getSanityCheckRoots()) {
+    if (!isSanitizerCoverage(Root)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AsapMultiversion::runOnModule(Module &M) {
+  std::vector<Function *> Candidates;
+  for (Function &F : M) {
+    if (isMultiversioningCandidate(F) && hasChecks(F)) {
+      Candidates.push_back(&F);
+    }
+  }
+
+  std::stable_sort(Candidates.begin(), Candidates.end(),
+                   [](Function *a, Function *b) {
+                     return a->getEntryCount().getValue() >
+                            b->getEntryCount().getValue();
+                   });
+  if (Candidates.size() > MultiversionCount) {
+    Candidates.resize(MultiversionCount);
+  }
+
+  for (Function *F : Candidates) {
+    multiversion(*F);
+  }
+  return !Candidates.empty();
+}
+
+void AsapMultiversion::multiversion(Function &F) {
+  Module *M = F.getParent();
+  LLVMContext &Ctx = M->getContext();
+
+  // The checked copy only runs when the fuzzer asks for it; inlining it into
+  // the dispatch would make the lean copy larger.
+  Function *Clone = cloneFunction(&F, ".asap.checked");
+  Clone->addFnAttr("asap-checked-version");
+  Clone->removeFnAttr(Attribute::AlwaysInline);
+  Clone->addFnAttr(Attribute::NoInline);
+
+  IntegerType *Int8Ty = Type::getInt8Ty(Ctx);
+  GlobalVariable *Flag = new GlobalVariable(
+      *M, Int8Ty, false, GlobalValue::PrivateLinkage,
+      ConstantInt::get(Int8Ty, 0), "__asap_checked_version");
+  Flag->setSection(CheckedVersionsSection);
+  Flag->setComdat(F.getComdat());
+  appendToUsed(*M, {Flag});
+
+  // Static allocas must stay in the entry block, so the dispatch goes after
+  // them.
+  BasicBlock &Entry = F.getEntryBlock();
+  BasicBlock::iterator IP = Entry.getFirstInsertionPt();
+  while (isa<AllocaInst>(IP)) {
+    ++IP;
+  }
+  BasicBlock *Lean = Entry.splitBasicBlock(IP, "asap.lean");
+  BasicBlock *Checked = BasicBlock::Create(Ctx, "asap.checked", &F, Lean);
+
+  IRBuilder<> IRB(Checked);
+  IRB.SetCurrentDebugLocation(getFunctionDebugLoc(F));
+  SmallVector<Value *, 8> Args;
+  for (Argument &Arg : F.args()) {
+    Args.push_back(&Arg);
+  }
+  CallInst *Call = IRB.CreateCall(Clone, Args);
+  Call->setCallingConv(F.getCallingConv());
+  Call->setAttributes(F.getAttributes());
+  Call->setTailCall();
+  if (F.getReturnType()->isVoidTy()) {
+    IRB.CreateRetVoid();
+  } else {
+    IRB.CreateRet(Call);
+  }
+
+  // The fuzzer runs most executions on the lean copy.
+  Entry.getTerminator()->eraseFromParent();
+  IRB.SetInsertPoint(&Entry);
+  Value *UseChecked =
+      IRB.CreateICmpNE(IRB.CreateLoad(Flag), ConstantInt::get(Int8Ty, 0));
+  IRB.CreateCondBr(UseChecked, Checked, Lean,
+                   MDBuilder(Ctx).createBranchWeights(1, 1000));
+
+  DEBUG(dbgs() << "AsapMultiversion: added a checked copy of " << F.getName()
+               << " (" << F.getEntryCount().getValue() << " calls)\n");
+  NumMultiversioned += 1;
+}
+
+char AsapMultiversion::ID = 0;
+INITIALIZE_PASS_BEGIN(AsapMultiversion, "asap-multiversion",
+                      "Keeps a fully checked copy of hot functions", false,
+                      false)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_END(AsapMultiversion, "asap-multiversion",
+                    "Keeps a fully checked copy of hot functions", false, false)
@@ -4,13 +4,17 @@
 #include "llvm/Transforms/SanityChecks/AsapPass.h"
 #include "llvm/Transforms/SanityChecks/SanityCheckCoverageCost.h"
 #include "llvm/Transforms/SanityChecks/SanityCheckGcovCost.h"
+#include "llvm/Transforms/SanityChecks/SanityCheckInstrProfCost.h"
 #include "llvm/Transforms/SanityChecks/SanityCheckSampledCost.h"
 #include "llvm/Transforms/SanityChecks/SanityCheckInstructions.h"
 #include "llvm/Transforms/SanityChecks/utils.h"
 
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/Support/CommandLine.h"
@@ -21,16 +25,57 @@
 
 using namespace llvm;
 
+template <class PassT>
+void AsapPassBase::getFunctionAnalyses(PassT &P, Function &F) {
+  // Every call to getAnalysis(F) re-runs all function analyses that P
+  // requires. Thus, we first obtain all passes, and only then read their
+  // results, which all belong to the last run.
+  ScalarEvolutionWrapperPass *SEWP = nullptr;
+  LoopInfoWrapperPass *LIWP = nullptr;
+  DominatorTreeWrapperPass *DTWP = nullptr;
+  if (needsLoopAnalyses()) {
+    SEWP = &P.template getAnalysis<ScalarEvolutionWrapperPass>(F);
+    LIWP = &P.template getAnalysis<LoopInfoWrapperPass>(F);
+    DTWP = &P.template getAnalysis<DominatorTreeWrapperPass>(F);
+  }
+  SCI = &P.template getAnalysis<SanityCheckInstructions>(F);
+  SE = SEWP ? &SEWP->getSE() : nullptr;
+  LI = LIWP ? &LIWP->getLoopInfo() : nullptr;
+  DT = DTWP ? &DTWP->getDomTree() : nullptr;
+}
+
+template <class PassT> void AsapPassBase::getLoopAnalyses(PassT &P) {
+  if (needsLoopAnalyses()) {
+    DT = &P.template getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+    LI = &P.template getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+    SE = &P.template getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+  } else {
+    DT = nullptr;
+    LI = nullptr;
+    SE = nullptr;
+  }
+}
+
+void AsapPassBase::addRequiredLoopAnalyses(AnalysisUsage &AU) const {
+  if (needsLoopAnalyses()) {
+    AU.addRequired<DominatorTreeWrapperPass>();
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<ScalarEvolutionWrapperPass>();
+  }
+}
+
 bool AsapPass::runOnFunction(Function &F) {
   SCC = &getAnalysis<SanityCheckSampledCost>();
   SCI = &getAnalysis<SanityCheckInstructions>();
-  
+  getLoopAnalyses(*this);
+
   return removeExpensiveChecks(F);
 }
 
 void AsapPass::getAnalysisUsage(AnalysisUsage &AU) const {
   AU.addRequired<SanityCheckSampledCost>();
   AU.addRequired<SanityCheckInstructions>();
+  addRequiredLoopAnalyses(AU);
 }
 
 FunctionPass *createAsapPass() {
@@ -42,6 +87,9 @@ INITIALIZE_PASS_BEGIN(AsapPass, "asap",
                       "Removes too costly sanity checks", false, false)
 INITIALIZE_PASS_DEPENDENCY(SanityCheckSampledCost)
 INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ScalarEvolutionWrapperPass)
 INITIALIZE_PASS_END(AsapPass, "asap",
                     "Removes too costly sanity checks", false, false)
 
@@ -49,13 +97,15 @@ INITIALIZE_PASS_END(AsapPass, "asap",
 bool AsapGcovPass::runOnFunction(Function &F) {
   SCC = &getAnalysis<SanityCheckGcovCost>();
   SCI = &getAnalysis<SanityCheckInstructions>();
-  
+  getLoopAnalyses(*this);
+
   return removeExpensiveChecks(F);
 }
 
 void AsapGcovPass::getAnalysisUsage(AnalysisUsage &AU) const {
   AU.addRequired<SanityCheckGcovCost>();
   AU.addRequired<SanityCheckInstructions>();
+  addRequiredLoopAnalyses(AU);
 }
 
 FunctionPass *createAsapGcovPass() {
@@ -67,6 +117,9 @@ INITIALIZE_PASS_BEGIN(AsapGcovPass, "asap-gcov",
                       "Removes too costly sanity checks", false, false)
 INITIALIZE_PASS_DEPENDENCY(SanityCheckGcovCost)
 INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ScalarEvolutionWrapperPass)
 INITIALIZE_PASS_END(AsapGcovPass, "asap-gcov",
                     "Removes too costly sanity checks", false, false)
 
@@ -74,13 +127,15 @@ INITIALIZE_PASS_END(AsapGcovPass, "asap-gcov",
 bool AsapCoveragePass::runOnFunction(Function &F) {
   SCC = &getAnalysis<SanityCheckCoverageCost>();
   SCI = &getAnalysis<SanityCheckInstructions>();
-  
+  getLoopAnalyses(*this);
+
   return removeExpensiveChecks(F);
 }
 
 void AsapCoveragePass::getAnalysisUsage(AnalysisUsage &AU) const {
   AU.addRequired<SanityCheckCoverageCost>();
   AU.addRequired<SanityCheckInstructions>();
+  addRequiredLoopAnalyses(AU);
 }
 
 FunctionPass *createAsapCoveragePass() {
@@ -92,5 +147,170 @@ INITIALIZE_PASS_BEGIN(AsapCoveragePass, "asap-coverage",
                       "Removes too costly sanity checks", false, false)
 INITIALIZE_PASS_DEPENDENCY(SanityCheckCoverageCost)
 INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ScalarEvolutionWrapperPass)
 INITIALIZE_PASS_END(AsapCoveragePass, "asap-coverage",
                     "Removes too costly sanity checks", false, false)
+
+
+bool AsapInstrProfPass::runOnFunction(Function &F) {
+  SCC = &getAnalysis<SanityCheckInstrProfCost>();
+  SCI = &getAnalysis<SanityCheckInstructions>();
+  getLoopAnalyses(*this);
+
+  return removeExpensiveChecks(F);
+}
+
+void AsapInstrProfPass::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<SanityCheckInstrProfCost>();
+  AU.addRequired<SanityCheckInstructions>();
+  addRequiredLoopAnalyses(AU);
+}
+
+FunctionPass *createAsapInstrProfPass() {
+  return new AsapInstrProfPass();
+}
+
+char AsapInstrProfPass::ID = 0;
+INITIALIZE_PASS_BEGIN(AsapInstrProfPass, "asap-instrprof",
+                      "Removes too costly sanity checks", false, false)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstrProfCost)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ScalarEvolutionWrapperPass)
+INITIALIZE_PASS_END(AsapInstrProfPass, "asap-instrprof",
+                    "Removes too costly sanity checks", false, false)
+
+
+bool AsapModulePass::runOnModule(Module &M) {
+  return removeExpensiveChecks(
+      M,
+      [this](Function &F) -> SanityCheckCost * {
+        return &getAnalysis<SanityCheckSampledCost>(F);
+      },
+      [this](Function &F) { getFunctionAnalyses(*this, F); });
+}
+
+void AsapModulePass::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<SanityCheckSampledCost>();
+  AU.addRequired<SanityCheckInstructions>();
+  AU.addRequired<DominatorTreeWrapperPass>();
+  AU.addRequired<LoopInfoWrapperPass>();
+  AU.addRequired<ScalarEvolutionWrapperPass>();
+}
+
+ModulePass *createAsapModulePass() {
+  return new AsapModulePass();
+}
+
+char AsapModulePass::ID = 0;
+INITIALIZE_PASS_BEGIN(AsapModulePass, "asap-module",
+                      "Removes too costly sanity checks module-wide", false, false)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckSampledCost)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ScalarEvolutionWrapperPass)
+INITIALIZE_PASS_END(AsapModulePass, "asap-module",
+                    "Removes too costly sanity checks module-wide", false, false)
+
+
+bool AsapGcovModulePass::runOnModule(Module &M) {
+  return removeExpensiveChecks(
+      M,
+      [this](Function &F) -> SanityCheckCost * {
+        return &getAnalysis<SanityCheckGcovCost>(F);
+      },
+      [this](Function &F) { getFunctionAnalyses(*this, F); });
+}
+
+void AsapGcovModulePass::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<SanityCheckGcovCost>();
+  AU.addRequired<SanityCheckInstructions>();
+  AU.addRequired<DominatorTreeWrapperPass>();
+  AU.addRequired<LoopInfoWrapperPass>();
+  AU.addRequired<ScalarEvolutionWrapperPass>();
+}
+
+ModulePass *createAsapGcovModulePass() {
+  return new AsapGcovModulePass();
+}
+
+char AsapGcovModulePass::ID = 0;
+INITIALIZE_PASS_BEGIN(AsapGcovModulePass, "asap-module-gcov",
+                      "Removes too costly sanity checks module-wide", false, false)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckGcovCost)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ScalarEvolutionWrapperPass)
+INITIALIZE_PASS_END(AsapGcovModulePass, "asap-module-gcov",
+                    "Removes too costly sanity checks module-wide", false, false)
+
+
+bool AsapCoverageModulePass::runOnModule(Module &M) {
+  return removeExpensiveChecks(
+      M,
+      [this](Function &F) -> SanityCheckCost * {
+        return &getAnalysis<SanityCheckCoverageCost>(F);
+      },
+      [this](Function &F) { getFunctionAnalyses(*this, F); });
+}
+
+void AsapCoverageModulePass::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<SanityCheckCoverageCost>();
+  AU.addRequired<SanityCheckInstructions>();
+  AU.addRequired<DominatorTreeWrapperPass>();
+  AU.addRequired<LoopInfoWrapperPass>();
+  AU.addRequired<ScalarEvolutionWrapperPass>();
+}
+
+ModulePass *createAsapCoverageModulePass() {
+  return new AsapCoverageModulePass();
+}
+
+char AsapCoverageModulePass::ID = 0;
+INITIALIZE_PASS_BEGIN(AsapCoverageModulePass, "asap-module-coverage",
+                      "Removes too costly sanity checks module-wide", false, false)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckCoverageCost)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ScalarEvolutionWrapperPass)
+INITIALIZE_PASS_END(AsapCoverageModulePass, "asap-module-coverage",
+                    "Removes too costly sanity checks module-wide", false, false)
+
+
+bool AsapInstrProfModulePass::runOnModule(Module &M) {
+  return removeExpensiveChecks(
+      M,
+      [this](Function &F) -> SanityCheckCost * {
+        return &getAnalysis<SanityCheckInstrProfCost>(F);
+      },
+      [this](Function &F) { getFunctionAnalyses(*this, F); });
+}
+
+void AsapInstrProfModulePass::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<SanityCheckInstrProfCost>();
+  AU.addRequired<SanityCheckInstructions>();
+  AU.addRequired<DominatorTreeWrapperPass>();
+  AU.addRequired<LoopInfoWrapperPass>();
+  AU.addRequired<ScalarEvolutionWrapperPass>();
+}
+
+ModulePass *createAsapInstrProfModulePass() {
+  return new AsapInstrProfModulePass();
+}
+
+char AsapInstrProfModulePass::ID = 0;
+INITIALIZE_PASS_BEGIN(AsapInstrProfModulePass, "asap-module-instrprof",
+                      "Removes too costly sanity checks module-wide", false, false)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstrProfCost)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ScalarEvolutionWrapperPass)
+INITIALIZE_PASS_END(AsapInstrProfModulePass, "asap-module-instrprof",
+                    "Removes too costly sanity checks module-wide", false, false)
@@ -2,20 +2,41 @@
 // Please see LICENSE.txt for copyright and licensing information.
 
 #include "llvm/Transforms/SanityChecks/AsapPassBase.h"
+#include "llvm/Transforms/SanityChecks/CostModel.h"
 #include "llvm/Transforms/SanityChecks/SanityCheckCost.h"
 #include "llvm/Transforms/SanityChecks/SanityCheckInstructions.h"
 #include "llvm/Transforms/SanityChecks/utils.h"
 
+#include "llvm/ADT/SmallSet.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
 #define DEBUG_TYPE "asap"
 
 using namespace llvm;
@@ -25,6 +46,62 @@ static cl::opt<unsigned long long>
                   cl::desc("Remove checks costing this or more"),
                   cl::init((unsigned long long)(-1)));
 
+static cl::opt<double>
+    CostLevel("asap-cost-level",
+              cl::desc("Keep the cheapest checks that fit into this fraction "
+                       "of the module's total check cost"),
+              cl::init(-1.0));
+
+static cl::opt<double>
+    SanityLevel("asap-sanity-level",
+                cl::desc("Keep this fraction of the module's checks, "
+                         "preferring cheap ones"),
+                cl::init(-1.0));
+
+// Checks in hot functions cost instruction cache space, even when they are
+// cheap to execute. A function is hot if the total cost of its checks reaches
+// -asap-hot-min-cost, and its profile entry count (if any) is non-zero.
+static cl::opt<unsigned long long> HotSizeBudget(
+    "asap-hot-size-budget",
+    cl::desc("Keep at most this many bytes of estimated check code in each "
+             "hot function, preferring cheap checks"),
+    cl::init((unsigned long long)(-1)));
+
+static cl::opt<unsigned long long> HotMinCost(
+    "asap-hot-min-cost",
+    cl::desc("Only functions whose checks cost at least this much in total "
+             "are hot, for -asap-hot-size-budget"),
+    cl::init(1));
+
+namespace {
+enum AsapActionKind { ActionRemove, ActionHoist, ActionSample };
+} // anonymous namespace
+
+static cl::opt<AsapActionKind> AsapAction(
+    "asap-action", cl::desc("What to do with checks that are too costly"),
+    cl::values(clEnumValN(ActionRemove, "remove", "Remove them (default)"),
+               clEnumValN(ActionHoist, "hoist",
+                          "Replace checks in loops by a range check before "
+                          "the loop, and remove those that can't be hoisted"),
+               clEnumValN(ActionSample, "sample",
+                          "Run them only once every N executions, such that "
+                          "their cost fits into the budget")),
+    cl::init(ActionRemove));
+
+// For fuzzing: checks whose operands are the same for every input cannot be
+// triggered by mutations. This needs -asap-input-dependence to run first.
+static cl::opt<bool> PreferInputDependent(
+    "asap-prefer-input-dependent",
+    cl::desc("Remove checks that cannot depend on program input first, "
+             "regardless of their cost"),
+    cl::init(false));
+
+static cl::opt<bool> RemoveRedundantChecks(
+    "asap-remove-redundant-checks",
+    cl::desc("Remove checks that are dominated by an identical check, before "
+             "selecting checks by cost"),
+    cl::init(false));
+
 static cl::opt<bool>
     AsapVerbose("asap-verbose",
                 cl::desc("Print a list of checks with their costs"),
@@ -35,8 +112,22 @@ bool AsapPassBase::removeExpensiveChecks(Function &F) {
   if (CostThreshold == (unsigned long long)(-1)) {
     report_fatal_error("Please specify -asap-cost-threshold");
   }
+  if (isCheckedVersion(F)) {
+    return false;
+  }
 
-  size_t TotalChecks = SCC->getCheckCosts().size();
+  SmallPtrSet<Instruction *, 16> RedundantChecks;
+  if (RemoveRedundantChecks) {
+    removeRedundantChecks(F, *SCC, RedundantChecks);
+  }
+
+  // Statistics count checks, even if they are removed in groups.
+  size_t TotalChecks = 0;
+  for (const SanityCheckCost::CheckCost &I : SCC->getCheckCosts()) {
+    if (!RedundantChecks.count(I.first)) {
+      TotalChecks += 1 + SCC->getCheckGroup(I.first).size();
+    }
+  }
   if (TotalChecks == 0) {
     if (AsapVerbose) {
       dbgs() << "AsapPass: ran on " << F.getName() << " at ";
@@ -51,7 +142,34 @@ bool AsapPassBase::removeExpensiveChecks(Function &F) {
 
   uint64_t TotalCost = 0;
   for (const SanityCheckCost::CheckCost &I : SCC->getCheckCosts()) {
-    TotalCost += I.second;
+    if (!RedundantChecks.count(I.first)) {
+      TotalCost += I.second;
+    }
+  }
+  bool IsHot = isHot(F, TotalCost);
+
+  // Among the checks below the threshold, keep the cheapest ones that fit
+  // into the size budget. Checks are given in order of decreasing cost.
+  SmallPtrSet<Instruction *, 16> OverSizeBudget;
+  uint64_t TotalSize = 0;
+  uint64_t KeptSize = 0;
+  if (usesSizeBudget() && IsHot) {
+    const std::vector<SanityCheckCost::CheckCost> &Costs = SCC->getCheckCosts();
+    for (auto I = Costs.rbegin(), E = Costs.rend(); I != E; ++I) {
+      if (RedundantChecks.count(I->first)) {
+        continue;
+      }
+      uint64_t Size = getCheckSize(I->first, *SCC);
+      TotalSize += Size;
+      if (I->second >= CostThreshold || isRemovedAsInputIndependent(I->first)) {
+        continue;
+      }
+      if (KeptSize + Size > HotSizeBudget) {
+        OverSizeBudget.insert(I->first);
+      } else {
+        KeptSize += Size;
+      }
+    }
   }
 
   // Start removing checks. They are given in order of decreasing cost, so we
@@ -59,14 +177,31 @@ bool AsapPassBase::removeExpensiveChecks(Function &F) {
   uint64_t RemovedCost = 0;
   size_t NChecksRemoved = 0;
   for (const SanityCheckCost::CheckCost &I : SCC->getCheckCosts()) {
-    if (I.second >= CostThreshold) {
-      if (optimizeCheckAway(I.first)) {
+    if (RedundantChecks.count(I.first)) {
+      continue;
+    }
+    bool IsOverSizeBudget = OverSizeBudget.count(I.first);
+    bool IsInputIndependent = isRemovedAsInputIndependent(I.first);
+    if (I.second >= CostThreshold || IsOverSizeBudget || IsInputIndependent) {
+      // When sampling, a check costing c that runs every N-th time costs
+      // c/N, which must be below the threshold. Sampled checks still take
+      // up space, so checks that are too large are removed. So are checks
+      // that input cannot trigger.
+      uint64_t SamplingPeriod =
+          CostThreshold > 0 && !IsOverSizeBudget && !IsInputIndependent
+              ? I.second / CostThreshold + 1
+              : 0;
+      const std::vector<Instruction *> &Group = SCC->getCheckGroup(I.first);
+      if (optimizeCheckAway(I.first, SamplingPeriod, Group)) {
         RemovedCost += I.second;
-        NChecksRemoved += 1;
+        NChecksRemoved += 1 + Group.size();
       }
     } else {
       if (AsapVerbose) {
         logSanityCheck(I.first, "keeping", dbgs());
+        for (Instruction *Member : SCC->getCheckGroup(I.first)) {
+          logSanityCheck(Member, "keeping", dbgs());
+        }
       }
     }
   }
@@ -87,24 +222,771 @@ bool AsapPassBase::removeExpensiveChecks(Function &F) {
              << ", kept " << (TotalCost - RemovedCost) << ", cost level "
              << format("%0.2f", 100.0 - 100.0 * RemovedCost / TotalCost) << "%\n";
     }
+    if (usesSizeBudget() && IsHot) {
+      dbgs() << "  Code size: total " << TotalSize << ", removed "
+             << (TotalSize - KeptSize) << ", kept " << KeptSize << ", budget "
+             << HotSizeBudget << "\n";
+    }
   }
   return false;
 }
 
+bool AsapPassBase::needsLoopAnalyses() const {
+  return AsapAction == ActionHoist || RemoveRedundantChecks;
+}
+
+bool AsapPassBase::isRemovedAsInputIndependent(Instruction *Inst) const {
+  return PreferInputDependent &&
+         !SanityCheckInstructions::isInputDependent(Inst);
+}
+
+bool AsapPassBase::usesSizeBudget() const {
+  return HotSizeBudget != (unsigned long long)(-1);
+}
+
+bool AsapPassBase::isHot(const Function &F, uint64_t TotalCost) const {
+  Optional<uint64_t> EntryCount = F.getEntryCount();
+  if (EntryCount.hasValue() && EntryCount.getValue() == 0) {
+    return false;
+  }
+  return TotalCost > 0 && TotalCost >= HotMinCost;
+}
+
+uint64_t AsapPassBase::getCheckSize(Instruction *Inst,
+                                    const SanityCheckCost &FunctionSCC) const {
+  std::vector<Instruction *> Roots(1, Inst);
+  const std::vector<Instruction *> &Group = FunctionSCC.getCheckGroup(Inst);
+  Roots.insert(Roots.end(), Group.begin(), Group.end());
+
+  // Use the size of the check's machine code if we have it. The measured
+  // ranges end before terminators, so we estimate those.
+  uint64_t Size = 0;
+  SmallPtrSet<Instruction *, 32> Estimated;
+  SmallSet<uint64_t, 4> MeasuredIDs;
+  for (Instruction *Root : Roots) {
+    const InstructionSet &Instrs = SCI->getInstructionsBySanityCheck(Root);
+    uint64_t CheckID = SCI->getCheckID(Root);
+    uint64_t MeasuredSize;
+    if (sanitychecks::getMeasuredCheckSize(CheckID, MeasuredSize)) {
+      if (MeasuredIDs.insert(CheckID).second) {
+        Size += MeasuredSize;
+      }
+      for (Instruction *I : Instrs) {
+        if (isa<TerminatorInst>(I)) {
+          Estimated.insert(I);
+        }
+      }
+    } else {
+      Estimated.insert(Instrs.begin(), Instrs.end());
+    }
+  }
+  for (Instruction *I : Estimated) {
+    Size += sanitychecks::getInstructionSize(I);
+  }
+  return Size;
+}
+
+bool AsapPassBase::removeExpensiveChecks(
+    Module &M, function_ref<SanityCheckCost *(Function &)> GetSCC,
+    function_ref<void(Function &)> GetFunctionAnalyses) {
+  bool UseCostLevel = CostLevel >= 0;
+  bool UseSanityLevel = SanityLevel >= 0;
+  if (UseCostLevel == UseSanityLevel) {
+    report_fatal_error("Please specify either -asap-cost-level or -asap-sanity-level");
+  }
+  if (CostLevel > 1 || SanityLevel > 1) {
+    report_fatal_error("-asap-cost-level and -asap-sanity-level must be in [0, 1]");
+  }
+
+  // Collect the checks of all functions, in program order. The cost passes
+  // return checks in an arbitrary order; we want the selection to be
+  // deterministic even if many checks have equal cost.
+  std::vector<SanityCheckCost::CheckCost> Checks;
+  std::map<Instruction *, std::vector<Instruction *>> CheckGroups;
+  // The sizes of checks in hot functions, with -asap-hot-size-budget.
+  DenseMap<Instruction *, uint64_t> CheckSizes;
+  for (Function &F : M) {
+    if (F.isDeclaration() || isCheckedVersion(F)) {
+      continue;
+    }
+    SanityCheckCost *FunctionSCC = GetSCC(F);
+    SmallPtrSet<Instruction *, 16> RedundantChecks;
+    if (RemoveRedundantChecks || usesSizeBudget()) {
+      // This re-runs the cost analysis, which yields the same result.
+      GetFunctionAnalyses(F);
+    }
+    if (RemoveRedundantChecks) {
+      removeRedundantChecks(F, *FunctionSCC, RedundantChecks);
+    }
+    DenseMap<Instruction *, uint64_t> CostByCheck;
+    uint64_t FunctionCost = 0;
+    for (const SanityCheckCost::CheckCost &I : FunctionSCC->getCheckCosts()) {
+      if (RedundantChecks.count(I.first)) {
+        continue;
+      }
+      CostByCheck[I.first] = I.second;
+      FunctionCost += I.second;
+      const std::vector<Instruction *> &Group = FunctionSCC->getCheckGroup(I.first);
+      if (!Group.empty()) {
+        CheckGroups[I.first] = Group;
+      }
+    }
+    if (CostByCheck.empty()) {
+      continue;
+    }
+    if (usesSizeBudget() && isHot(F, FunctionCost)) {
+      for (const auto &CBC : CostByCheck) {
+        CheckSizes[CBC.first] = getCheckSize(CBC.first, *FunctionSCC);
+      }
+    }
+    for (Instruction &I : instructions(F)) {
+      auto CBC = CostByCheck.find(&I);
+      if (CBC != CostByCheck.end()) {
+        Checks.push_back(*CBC);
+      }
+    }
+  }
+
+  // Sanity levels and statistics count checks, even though a group of
+  // checks (-asap-shared-cost=group) is kept or removed as one unit.
+  auto NumChecksIn = [&](Instruction *Inst) -> size_t {
+    auto CG = CheckGroups.find(Inst);
+    return 1 + (CG != CheckGroups.end() ? CG->second.size() : 0);
+  };
+  uint64_t TotalCost = 0;
+  size_t TotalChecks = 0;
+  for (const SanityCheckCost::CheckCost &I : Checks) {
+    TotalCost += I.second;
+    TotalChecks += NumChecksIn(I.first);
+  }
+
+  // Keep the cheapest checks. Given that every check counts the same, filling
+  // the budget in order of increasing cost keeps the largest possible number
+  // of checks, so this solves the knapsack problem exactly. With a size
+  // budget, we skip checks that no longer fit into their function; this is
+  // a greedy approximation. With -asap-prefer-input-dependent, checks that
+  // input cannot trigger only get what remains of the budget.
+  std::stable_sort(Checks.begin(), Checks.end(),
+                   [this](const SanityCheckCost::CheckCost &a,
+                          const SanityCheckCost::CheckCost &b) {
+                     bool aLast = isRemovedAsInputIndependent(a.first);
+                     bool bLast = isRemovedAsInputIndependent(b.first);
+                     return aLast != bLast ? bLast : a.second < b.second;
+                   });
+  std::vector<bool> Keep(Checks.size(), false);
+  std::map<Function *, uint64_t> KeptSizes;
+  SmallPtrSet<Instruction *, 16> OverSizeBudget;
+  auto FitsSizeBudget = [&](Instruction *Inst) {
+    auto CS = CheckSizes.find(Inst);
+    if (CS == CheckSizes.end()) {
+      return true;
+    }
+    uint64_t &KeptSize = KeptSizes[Inst->getParent()->getParent()];
+    if (KeptSize + CS->second > HotSizeBudget) {
+      OverSizeBudget.insert(Inst);
+      return false;
+    }
+    KeptSize += CS->second;
+    return true;
+  };
+  size_t NChecksKept = 0;
+  uint64_t KeptCost = 0;
+  uint64_t OverSizeBudgetCost = 0;
+  if (UseSanityLevel) {
+    size_t NChecksWanted = std::min(
+        TotalChecks, (size_t)std::ceil(SanityLevel * TotalChecks));
+    for (size_t i = 0; i < Checks.size() && NChecksKept < NChecksWanted; ++i) {
+      if (FitsSizeBudget(Checks[i].first)) {
+        Keep[i] = true;
+        KeptCost += Checks[i].second;
+        NChecksKept += NumChecksIn(Checks[i].first);
+      }
+    }
+  } else {
+    double Budget = CostLevel * TotalCost;
+    for (size_t i = 0; i < Checks.size(); ++i) {
+      if (KeptCost + Checks[i].second > Budget) {
+        break;
+      }
+      if (FitsSizeBudget(Checks[i].first)) {
+        Keep[i] = true;
+        KeptCost += Checks[i].second;
+        NChecksKept += NumChecksIn(Checks[i].first);
+      } else {
+        OverSizeBudgetCost += Checks[i].second;
+      }
+    }
+  }
+
+  // Input-independent checks that did not fit are removed, not sampled.
+  uint64_t InputIndependentCost = 0;
+  size_t NInputDependent = 0;
+  size_t NInputDependentKept = 0;
+  for (size_t i = 0; i < Checks.size(); ++i) {
+    if (!isRemovedAsInputIndependent(Checks[i].first)) {
+      NInputDependent += NumChecksIn(Checks[i].first);
+      NInputDependentKept += Keep[i] ? NumChecksIn(Checks[i].first) : 0;
+    } else if (!Keep[i]) {
+      InputIndependentCost += Checks[i].second;
+    }
+  }
+
+  // When sampling, all checks that don't fit into the budget run once every
+  // N-th time, such that their total cost fits into the remaining budget.
+  // There is no budget for the cost with -asap-sanity-level, so checks are
+  // removed in that case. Checks that exceed the size budget are removed,
+  // too, because sampled checks still take up space.
+  uint64_t SamplingPeriod = 0;
+  if (UseCostLevel) {
+    double RemainingBudget = CostLevel * TotalCost - KeptCost;
+    if (RemainingBudget >= 1) {
+      SamplingPeriod =
+          (uint64_t)((TotalCost - KeptCost - OverSizeBudgetCost -
+                      InputIndependentCost) /
+                     RemainingBudget) + 1;
+    }
+  }
+
+  // Group the checks to remove by function, because instruction analyses are
+  // only available for one function at a time.
+  std::map<Function *, std::vector<Instruction *>> ChecksToRemove;
+  for (size_t i = 0; i < Checks.size(); ++i) {
+    if (Keep[i]) {
+      if (AsapVerbose) {
+        logSanityCheck(Checks[i].first, "keeping", dbgs());
+        auto CG = CheckGroups.find(Checks[i].first);
+        if (CG != CheckGroups.end()) {
+          for (Instruction *Member : CG->second) {
+            logSanityCheck(Member, "keeping", dbgs());
+          }
+        }
+      }
+    } else {
+      Instruction *Inst = Checks[i].first;
+      ChecksToRemove[Inst->getParent()->getParent()].push_back(Inst);
+    }
+  }
+
+  uint64_t RemovedCost = 0;
+  size_t NChecksRemoved = 0;
+  for (Function &F : M) {
+    auto CTR = ChecksToRemove.find(&F);
+    if (CTR == ChecksToRemove.end()) {
+      continue;
+    }
+    GetFunctionAnalyses(F);
+    for (Instruction *Inst : CTR->second) {
+      ConstantAsMetadata *CostMD =
+          cast<ConstantAsMetadata>(Inst->getMetadata("cost")->getOperand(0));
+      uint64_t Cost = cast<ConstantInt>(CostMD->getValue())->getZExtValue();
+      uint64_t Period = OverSizeBudget.count(Inst) ||
+                                isRemovedAsInputIndependent(Inst)
+                            ? 0
+                            : SamplingPeriod;
+      auto CG = CheckGroups.find(Inst);
+      ArrayRef<Instruction *> Group;
+      if (CG != CheckGroups.end()) {
+        Group = CG->second;
+      }
+      if (optimizeCheckAway(Inst, Period, Group)) {
+        RemovedCost += Cost;
+        NChecksRemoved += 1 + Group.size();
+      }
+    }
+  }
+  SCI = nullptr;
+  DT = nullptr;
+  LI = nullptr;
+  SE = nullptr;
+
+  if (AsapVerbose) {
+    dbgs() << "AsapPass: ran on module " << M.getModuleIdentifier() << "\n";
+    if (TotalChecks == 0) {
+      dbgs() << "  Static checks: total 0, removed 0, kept 0, sanity level nan%\n";
+    } else {
+      dbgs() << "  Static checks: total " << TotalChecks << ", removed "
+             << NChecksRemoved << ", kept " << (TotalChecks - NChecksRemoved)
+             << ", sanity level "
+             << format("%0.2f", 100.0 - 100.0 * NChecksRemoved / TotalChecks) << "%\n";
+    }
+    if (TotalCost == 0) {
+      dbgs() << "  Cost: total 0, removed 0, kept 0, cost level nan%\n";
+    } else {
+      dbgs() << "  Cost: total " << TotalCost << ", removed " << RemovedCost
+             << ", kept " << (TotalCost - RemovedCost) << ", cost level "
+             << format("%0.2f", 100.0 - 100.0 * RemovedCost / TotalCost) << "%\n";
+    }
+    if (usesSizeBudget()) {
+      uint64_t TotalSize = 0;
+      uint64_t KeptSize = 0;
+      for (const auto &CS : CheckSizes) {
+        TotalSize += CS.second;
+      }
+      for (const auto &KS : KeptSizes) {
+        KeptSize += KS.second;
+      }
+      dbgs() << "  Code size in hot functions: total " << TotalSize
+             << ", removed " << (TotalSize - KeptSize) << ", kept " << KeptSize
+             << ", budget per function " << HotSizeBudget << "\n";
+    }
+    if (PreferInputDependent) {
+      dbgs() << "  Input-dependent checks: total " << NInputDependent
+             << ", kept " << NInputDependentKept << "\n";
+    }
+  }
+  return NChecksRemoved > 0;
+}
+
+// Computes a key that is equal for checks that test the same condition. For
+// ASan checks, this is the accessed address and size; other checks must
+// branch on the same value. Returns false for checks of unknown shape.
+typedef std::tuple<Value *, uint64_t, Value *> RedundancyKey;
+static bool getRedundancyKey(Instruction *Inst, BranchInst *CheckBranch,
+                             BasicBlock *Continue, RedundancyKey &Key);
+
+size_t AsapPassBase::removeRedundantChecks(
+    Function &F, const SanityCheckCost &FunctionSCC,
+    SmallPtrSetImpl<Instruction *> &Removed) {
+  assert(SCI && DT && "Removing redundant checks requires SCI and DT");
+
+  // Group candidate checks by their key, in program order.
+  DenseMap<Instruction *, BranchInst *> CheckBranches;
+  for (const SanityCheckCost::CheckCost &I : FunctionSCC.getCheckCosts()) {
+    if (FunctionSCC.getCheckGroup(I.first).empty()) {
+      CheckBranches[I.first] = nullptr;
+    }
+  }
+  std::map<RedundancyKey, std::vector<Instruction *>> ChecksByKey;
+  for (Instruction &I : instructions(F)) {
+    auto CB = CheckBranches.find(&I);
+    if (CB == CheckBranches.end()) {
+      continue;
+    }
+    BasicBlock *Continue;
+    RedundancyKey Key;
+    CB->second = findCheckBranch(&I, Continue);
+    if (CB->second && getRedundancyKey(&I, CB->second, Continue, Key)) {
+      ChecksByKey[Key].push_back(&I);
+    }
+  }
+
+  // A check is redundant if an identical check dominates it, and no
+  // instruction between them writes to memory. Stores could change the
+  // value being checked, and calls could free or poison memory.
+  auto HasInterveningWrites = [&](BasicBlock *From, BasicBlock *To) {
+    SmallVector<BasicBlock *, 8> Worklist(1, To);
+    SmallPtrSet<BasicBlock *, 8> Visited;
+    while (!Worklist.empty()) {
+      BasicBlock *BB = Worklist.pop_back_val();
+      if (BB == From || !Visited.insert(BB).second) {
+        continue;
+      }
+      for (Instruction &I : *BB) {
+        if (I.mayWriteToMemory() && !isInstrumentation(&I) &&
+            !isAsmForSideEffect(&I)) {
+          return true;
+        }
+      }
+      Worklist.append(pred_begin(BB), pred_end(BB));
+    }
+    return false;
+  };
+
+  size_t NRemoved = 0;
+  for (auto &CBK : ChecksByKey) {
+    std::vector<Instruction *> &Checks = CBK.second;
+    for (Instruction *Check : Checks) {
+      BasicBlock *CheckBB = CheckBranches[Check]->getParent();
+      for (Instruction *Dominating : Checks) {
+        if (Dominating == Check || Removed.count(Dominating)) {
+          continue;
+        }
+        BasicBlock *DominatingBB = CheckBranches[Dominating]->getParent();
+        if (DominatingBB != CheckBB && DT->dominates(DominatingBB, CheckBB) &&
+            !HasInterveningWrites(DominatingBB, CheckBB)) {
+          if (AsapVerbose) {
+            logSanityCheck(Check, "redundant", dbgs());
+          }
+          Removed.insert(Check);
+          eraseCheck(Check);
+          NRemoved += 1;
+          break;
+        }
+      }
+    }
+  }
+  return NRemoved;
+}
+
 // Tries to remove a sanity check; returns true if it worked.
-bool AsapPassBase::optimizeCheckAway(llvm::Instruction *Inst) {
+bool AsapPassBase::optimizeCheckAway(llvm::Instruction *Inst,
+                                     uint64_t SamplingPeriod,
+                                     ArrayRef<Instruction *> Group) {
+  // Checks in a group share instructions, so they are sampled as one unit.
+  // Changing them one by one would guard or erase the shared parts twice.
+  InstructionSet CheckInsts;
+  CheckInsts.insert(SCI->getInstructionsBySanityCheck(Inst).begin(),
+                    SCI->getInstructionsBySanityCheck(Inst).end());
+  for (Instruction *Member : Group) {
+    CheckInsts.insert(SCI->getInstructionsBySanityCheck(Member).begin(),
+                      SCI->getInstructionsBySanityCheck(Member).end());
+  }
+
+  if (AsapAction == ActionSample && sampleCheck(CheckInsts, SamplingPeriod)) {
+    if (AsapVerbose) {
+      logSanityCheck(Inst, "sampling", dbgs());
+      for (Instruction *Member : Group) {
+        logSanityCheck(Member, "sampling", dbgs());
+      }
+      dbgs() << "  sampling period: " << SamplingPeriod << "\n";
+    }
+    return true;
+  }
+
+  // We only hoist single checks; hoistCheck replaces the check's condition,
+  // which group members might share.
+  StringRef Action = "removing";
+  if (AsapAction == ActionHoist && Group.empty() && hoistCheck(Inst)) {
+    Action = "hoisting";
+  }
   if (AsapVerbose) {
-    logSanityCheck(Inst, "removing", dbgs());
+    logSanityCheck(Inst, Action, dbgs());
+    for (Instruction *Member : Group) {
+      logSanityCheck(Member, Action, dbgs());
+    }
+  }
+  eraseCheck(Inst, Group);
+  return true;
+}
+
+static bool getRedundancyKey(Instruction *Inst, BranchInst *CheckBranch,
+                             BasicBlock *Continue, RedundancyKey &Key) {
+  CallInst *CI = dyn_cast<CallInst>(Inst);
+  if (!CI || !CI->getCalledFunction()) {
+    return false;
+  }
+
+  // ASan checks compute shadow memory addresses themselves, so we compare
+  // the accessed memory. Loads and stores are checked in the same way.
+  bool IsWrite, Recover;
+  uint64_t AccessSize;
+  if (CI->getNumArgOperands() == 1 &&
+      parseAsanReport(CI->getCalledFunction()->getName(), IsWrite, AccessSize,
+                      Recover)) {
+    PtrToIntInst *AddrLong = dyn_cast<PtrToIntInst>(CI->getArgOperand(0));
+    if (!AddrLong) {
+      return false;
+    }
+    Key = RedundancyKey(AddrLong->getPointerOperand()->stripPointerCasts(),
+                        AccessSize, nullptr);
+    return true;
+  }
+
+  Key = RedundancyKey(CheckBranch->getCondition(),
+                      CheckBranch->getSuccessor(0) == Continue,
+                      CI->getCalledFunction());
+  return true;
+}
+
+bool AsapPassBase::hoistCheck(Instruction *Inst) {
+  assert(DT && LI && SE && "Hoisting checks requires loop analyses");
+
+  // We only know how to hoist ASan checks: these report an access of a
+  // fixed size, given the address as an integer.
+  CallInst *CI = dyn_cast<CallInst>(Inst);
+  if (!CI || !CI->getCalledFunction() || CI->getNumArgOperands() != 1) {
+    return false;
+  }
+  bool IsWrite, Recover;
+  uint64_t AccessSize;
+  if (!parseAsanReport(CI->getCalledFunction()->getName(), IsWrite, AccessSize,
+                       Recover)) {
+    return false;
+  }
+  PtrToIntInst *AddrLong = dyn_cast<PtrToIntInst>(CI->getArgOperand(0));
+  if (!AddrLong) {
+    return false;
+  }
+  Value *Addr = AddrLong->getPointerOperand();
+
+  // The check must be in a simple loop, where the latch is the only exit. If
+  // the access executes on every iteration, then the whole range of
+  // addresses will be accessed once the loop is entered.
+  Loop *L = LI->getLoopFor(Inst->getParent());
+  if (!L) {
+    return false;
+  }
+  BasicBlock *Preheader = L->getLoopPreheader();
+  BasicBlock *Latch = L->getLoopLatch();
+  if (!Preheader || !Latch || L->getExitingBlock() != Latch) {
+    return false;
+  }
+  Instruction *Access = nullptr;
+  for (User *U : Addr->users()) {
+    Instruction *UI = dyn_cast<Instruction>(U);
+    if (UI && L->contains(UI) && DT->dominates(UI->getParent(), Latch) &&
+        ((!IsWrite && isa<LoadInst>(UI)) ||
+         (IsWrite && isa<StoreInst>(UI) &&
+          cast<StoreInst>(UI)->getPointerOperand() == Addr))) {
+      Access = UI;
+      break;
+    }
+  }
+  if (!Access) {
+    return false;
+  }
+
+  // Calls that might not return could stop the loop before it accesses the
+  // whole range; we would then report errors that the program never
+  // triggers. Calls that free memory could invalidate the range check.
+  for (BasicBlock *BB : L->blocks()) {
+    for (Instruction &I : *BB) {
+      if (!isa<CallInst>(&I) && !isa<InvokeInst>(&I)) {
+        continue;
+      }
+      if (isInstrumentation(&I) || isAsmForSideEffect(&I) ||
+          isa<DbgInfoIntrinsic>(&I)) {
+        continue;
+      }
+      if (!isGuaranteedToTransferExecutionToSuccessor(&I)) {
+        return false;
+      }
+    }
+  }
+
+  // The address must be an affine function of the induction variable, and
+  // the loop's trip count must be known before entering the loop.
+  const SCEVAddRecExpr *AR = dyn_cast<SCEVAddRecExpr>(SE->getSCEV(Addr));
+  if (!AR || AR->getLoop() != L || !AR->isAffine()) {
+    return false;
+  }
+  const SCEV *BackedgeTakenCount = SE->getBackedgeTakenCount(L);
+  if (isa<SCEVCouldNotCompute>(BackedgeTakenCount)) {
+    return false;
+  }
+
+  // Compute the lowest and highest address, similar to what
+  // LoopAccessAnalysis does for runtime pointer checks.
+  const SCEV *Low = AR->getStart();
+  const SCEV *High = AR->evaluateAtIteration(BackedgeTakenCount, *SE);
+  if (const SCEVConstant *Step =
+          dyn_cast<SCEVConstant>(AR->getStepRecurrence(*SE))) {
+    if (Step->getValue()->isNegative()) {
+      std::swap(Low, High);
+    }
+  } else {
+    Low = SE->getUMinExpr(AR->getStart(), High);
+    High = SE->getUMaxExpr(AR->getStart(), High);
+  }
+  if (!SE->isLoopInvariant(Low, L) || !SE->isLoopInvariant(High, L) ||
+      !isSafeToExpand(Low, *SE) || !isSafeToExpand(High, *SE)) {
+    return false;
+  }
+
+  // Emit the range check in the preheader:
+  //   if (__asan_region_is_poisoned(Low, High - Low + AccessSize))
+  //     __asan_report_{load,store}_n(Low, High - Low + AccessSize);
+  Module *M = Inst->getModule();
+  LLVMContext &Ctx = M->getContext();
+  const DataLayout &DL = M->getDataLayout();
+  Type *IntptrTy = DL.getIntPtrType(Ctx);
+  Instruction *InsertPt = Preheader->getTerminator();
+
+  SCEVExpander Expander(*SE, DL, "asap.hoist");
+  Value *LowV = Expander.expandCodeFor(Low, Low->getType(), InsertPt);
+  Value *HighV = Expander.expandCodeFor(High, High->getType(), InsertPt);
+
+  IRBuilder<> IRB(InsertPt);
+  IRB.SetCurrentDebugLocation(Inst->getDebugLoc());
+  Value *Begin = IRB.CreatePointerCast(LowV, IntptrTy);
+  Value *Size = IRB.CreateAdd(
+      IRB.CreateSub(IRB.CreatePointerCast(HighV, IntptrTy), Begin),
+      ConstantInt::get(IntptrTy, AccessSize));
+  Constant *RegionIsPoisoned = M->getOrInsertFunction(
+      "__asan_region_is_poisoned", IntptrTy, IntptrTy, IntptrTy, nullptr);
+  Value *Poisoned = IRB.CreateCall(RegionIsPoisoned, {Begin, Size});
+  Value *Cmp = IRB.CreateICmpNE(Poisoned, ConstantInt::get(IntptrTy, 0));
+
+  TerminatorInst *ReportTerm = SplitBlockAndInsertIfThen(
+      Cmp, InsertPt, !Recover,
+      MDBuilder(Ctx).createBranchWeights(1, 100000), DT, LI);
+  std::string ReportName = std::string("__asan_report_") +
+                           (IsWrite ? "store" : "load") + "_n" +
+                           (Recover ? "_noabort" : "");
+  Constant *Report = M->getOrInsertFunction(
+      ReportName, Type::getVoidTy(Ctx), IntptrTy, IntptrTy, nullptr);
+  IRBuilder<> ReportIRB(ReportTerm);
+  ReportIRB.SetCurrentDebugLocation(Inst->getDebugLoc());
+  ReportIRB.CreateCall(Report, {Begin, Size});
+  return true;
+}
+
+// Returns whether all instructions in BB belong to the given check.
+static bool isCheckBlock(BasicBlock *BB,
+                         const SmallPtrSetImpl<Instruction *> &CheckInsts) {
+  return std::all_of(BB->begin(), BB->end(), [&](Instruction &I) {
+    return CheckInsts.count(&I) != 0;
+  });
+}
+
+BranchInst *AsapPassBase::findCheckBranch(Instruction *Inst,
+                                          BasicBlock *&Continue) const {
+  return findCheckBranch(SCI->getInstructionsBySanityCheck(Inst), Continue);
+}
+
+BranchInst *
+AsapPassBase::findCheckBranch(const SmallPtrSetImpl<Instruction *> &CheckInsts,
+                              BasicBlock *&Continue) const {
+  // Find the branch where program code enters the check. Its block contains
+  // instructions that don't belong to the check.
+  BranchInst *CheckBranch = nullptr;
+  for (Instruction *I : CheckInsts) {
+    BranchInst *BI = dyn_cast<BranchInst>(I);
+    if (!BI || !BI->isConditional() || isCheckBlock(BI->getParent(), CheckInsts)) {
+      continue;
+    }
+    if (CheckBranch) {
+      return nullptr;
+    }
+    CheckBranch = BI;
+  }
+  if (!CheckBranch) {
+    return nullptr;
+  }
+
+  // One successor continues the program, the other one leads into the rest
+  // of the check.
+  Continue = nullptr;
+  for (BasicBlock *Succ : CheckBranch->successors()) {
+    if (!CheckInsts.count(Succ->getFirstNonPHI())) {
+      if (Continue) {
+        return nullptr;
+      }
+      Continue = Succ;
+    }
+  }
+  return Continue ? CheckBranch : nullptr;
+}
+
+bool AsapPassBase::sampleCheck(const SmallPtrSetImpl<Instruction *> &CheckInsts,
+                               uint64_t SamplingPeriod) {
+  if (SamplingPeriod < 2 || SamplingPeriod > INT32_MAX) {
+    return false;
+  }
+
+  // Replace the branch into the check by a per-site countdown:
+  //   if (Counter == 0) { Counter = N - 1; check(); } else { --Counter; }
+  Module *M = (*CheckInsts.begin())->getModule();
+  LLVMContext &Ctx = M->getContext();
+  IntegerType *Int32Ty = Type::getInt32Ty(Ctx);
+  auto MakeCondition = [&](Instruction *InsertBefore) -> Value * {
+    GlobalVariable *Counter = new GlobalVariable(
+        *M, Int32Ty, false, GlobalValue::PrivateLinkage,
+        ConstantInt::get(Int32Ty, 0), "__asap_sample_counter");
+    IRBuilder<> IRB(InsertBefore);
+    Value *Count = IRB.CreateLoad(Counter);
+    Value *IsZero = IRB.CreateICmpEQ(Count, ConstantInt::get(Int32Ty, 0));
+    IRB.CreateStore(
+        IRB.CreateSelect(IsZero, ConstantInt::get(Int32Ty, SamplingPeriod - 1),
+                         IRB.CreateSub(Count, ConstantInt::get(Int32Ty, 1))),
+        Counter);
+    return IsZero;
+  };
+  return guardCheck(CheckInsts, MakeCondition,
+                    MDBuilder(Ctx).createBranchWeights(1, SamplingPeriod - 1));
+}
+
+bool AsapPassBase::guardCheck(
+    Instruction *Inst, function_ref<Value *(Instruction *)> MakeCondition,
+    MDNode *Weights) {
+  return guardCheck(SCI->getInstructionsBySanityCheck(Inst), MakeCondition,
+                    Weights);
+}
+
+bool AsapPassBase::guardCheck(
+    const SmallPtrSetImpl<Instruction *> &CheckInsts,
+    function_ref<Value *(Instruction *)> MakeCondition, MDNode *Weights) {
+  BasicBlock *Continue;
+  BranchInst *CheckBranch = findCheckBranch(CheckInsts, Continue);
+  if (!CheckBranch) {
+    return false;
+  }
+  BasicBlock *BB = CheckBranch->getParent();
+
+  // Collect the check's instructions in BB. We will move them to the end of
+  // BB, so that the check becomes a separate block that can be skipped. This
+  // requires that the instructions are only used by this check, and that
+  // moving them does not change the result of loads.
+  SmallVector<Instruction *, 8> ToMove;
+  bool ReadsMemory = false;
+  for (Instruction &I : *BB) {
+    if (&I == CheckBranch) {
+      break;
+    }
+    if (!CheckInsts.count(&I)) {
+      if (ReadsMemory && I.mayWriteToMemory()) {
+        return false;
+      }
+      continue;
+    }
+    if (isa<PHINode>(&I) || I.mayHaveSideEffects()) {
+      return false;
+    }
+    for (User *U : I.users()) {
+      Instruction *UI = cast<Instruction>(U);
+      if (!CheckInsts.count(UI) ||
+          (UI->getParent() != BB && !isCheckBlock(UI->getParent(), CheckInsts))) {
+        return false;
+      }
+    }
+    ReadsMemory |= I.mayReadFromMemory();
+    ToMove.push_back(&I);
+  }
+  for (Instruction *I : ToMove) {
+    I->moveBefore(CheckBranch);
+  }
+  BasicBlock *CheckBB = BB->splitBasicBlock(
+      ToMove.empty() ? CheckBranch : ToMove.front(), "asap.guard");
+
+  TerminatorInst *OldTerm = BB->getTerminator();
+  Value *Cond = MakeCondition(OldTerm);
+  BranchInst::Create(CheckBB, Continue, Cond, OldTerm)
+      ->setMetadata(LLVMContext::MD_prof, Weights);
+  OldTerm->eraseFromParent();
+
+  // The values that Continue's phi nodes receive from CheckBB are not
+  // computed by the check, so they are available in BB, too.
+  for (Instruction &I : *Continue) {
+    PHINode *PN = dyn_cast<PHINode>(&I);
+    if (!PN) {
+      break;
+    }
+    PN->addIncoming(PN->getIncomingValueForBlock(CheckBB), BB);
+  }
+  return true;
+}
+
+// Removes a sanity check's instructions, leaving the rest to DCE.
+void AsapPassBase::eraseCheck(llvm::Instruction *Inst,
+                              ArrayRef<Instruction *> Group) {
+  // Instructions shared by checks in a group must only be visited once.
+  InstructionSet CheckInsts;
+  CheckInsts.insert(SCI->getInstructionsBySanityCheck(Inst).begin(),
+                    SCI->getInstructionsBySanityCheck(Inst).end());
+  for (Instruction *Member : Group) {
+    CheckInsts.insert(SCI->getInstructionsBySanityCheck(Member).begin(),
+                      SCI->getInstructionsBySanityCheck(Member).end());
   }
 
   // We'd like to simply remove the check root, and let dead code elimination
   // handle the rest. However, instrumentation tools add things like inline
   // assembly to prevent checks from getting DCE'd, so we need to remove that,
   // too.
-  for (auto I : SCI->getInstructionsBySanityCheck(Inst)) {
+  for (auto I : CheckInsts) {
     if (isAsmForSideEffect(I)) {
       assert(I->use_empty() && "AsmForSideEffect is being used?");
       I->eraseFromParent();
+      continue;
     }
 
     // We also remove atomic qualifiers from loads. Such qualifiers are used
@@ -116,7 +998,10 @@ bool AsapPassBase::optimizeCheckAway(llvm::Instruction *Inst) {
   }
   assert(Inst->use_empty() && "Sanity check is being used?");
   Inst->eraseFromParent();
-  return true;
+  for (Instruction *Member : Group) {
+    assert(Member->use_empty() && "Sanity check is being used?");
+    Member->eraseFromParent();
+  }
 }
 
 void AsapPassBase::logSanityCheck(Instruction *Inst, StringRef Action,
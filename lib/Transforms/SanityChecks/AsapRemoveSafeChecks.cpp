@@ -0,0 +1,289 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+//
+// Removes ASan checks that can never fail, because the checked access is
+// provably within the bounds of a global or stack object.
+//
+// ASan itself only skips accesses at constant offsets. This pass also handles
+// variable offsets: ScalarEvolution bounds induction variables in loops, and
+// LazyValueInfo bounds indices that are guarded by a comparison. It should
+// run before ASAP selects checks by cost; the remaining budget then goes to
+// checks that can fail.
+//
+// Heap objects are not considered: an access within bounds of a freed object
+// is still an error. Neither are globals with a dynamic initializer: ASan's
+// check_initialization_order reports accesses to them, in bounds or not,
+// while they are not yet initialized.
+
+#include "llvm/Transforms/SanityChecks/AsapPassBase.h"
+#include "llvm/Transforms/SanityChecks/SanityCheckInstructions.h"
+#include "llvm/Transforms/SanityChecks/utils.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LazyValueInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/ConstantRange.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GetElementPtrTypeIterator.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/Debug.h"
+
+#include <vector>
+#define DEBUG_TYPE "asap-remove-safe-checks"
+
+using namespace llvm;
+
+STATISTIC(NumSafeChecks, "Number of checks removed because they cannot fail");
+
+namespace {
+struct AsapRemoveSafeChecks : public FunctionPass, public AsapPassBase {
+  static char ID;
+
+  AsapRemoveSafeChecks() : FunctionPass(ID) {
+    initializeAsapRemoveSafeChecksPass(*PassRegistry::getPassRegistry());
+  }
+
+  virtual bool doInitialization(Module &M) override;
+  virtual bool runOnFunction(Function &F) override;
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<SanityCheckInstructions>();
+    AU.addRequired<ScalarEvolutionWrapperPass>();
+    AU.addRequired<LazyValueInfoWrapperPass>();
+  }
+
+private:
+  LazyValueInfo *LVI = nullptr;
+
+  // Globals that ASan marks as dynamically initialized.
+  SmallPtrSet<const GlobalVariable *, 8> DynInitGlobals;
+
+  // Returns the global variable or alloca that Addr points into, and sets
+  // Size to its size. Returns null if there is no such object, if its size is
+  // unknown, or if in-bounds accesses to it can still fail.
+  Value *getAccessedObject(Value *Addr, const DataLayout &DL,
+                           uint64_t &Size) const;
+
+  // Returns true if Inst is an ASan check whose access is in bounds.
+  bool isCheckSafe(Instruction *Inst) const;
+
+  // Returns a range containing the offset of Addr from Object. CxtI is where
+  // the offset is used.
+  ConstantRange getOffsetRange(Value *Addr, Value *Object,
+                               Instruction *CxtI) const;
+};
+} // anonymous namespace
+
+// Returns true if the lifetime of AI might end before the function returns.
+static bool hasLifetimeMarkers(const AllocaInst *AI) {
+  SmallVector<const Value *, 4> Worklist(1, AI);
+  while (!Worklist.empty()) {
+    const Value *V = Worklist.pop_back_val();
+    for (const User *U : V->users()) {
+      if (isa<BitCastInst>(U)) {
+        Worklist.push_back(U);
+      } else if (const IntrinsicInst *II = dyn_cast<IntrinsicInst>(U)) {
+        if (II->getIntrinsicID() == Intrinsic::lifetime_start ||
+            II->getIntrinsicID() == Intrinsic::lifetime_end) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+bool AsapRemoveSafeChecks::doInitialization(Module &M) {
+  // Each entry of llvm.asan.globals holds a global and, as its fourth
+  // operand, whether the global is dynamically initialized. ASan may already
+  // have replaced the global by a cast of one with a redzone.
+  DynInitGlobals.clear();
+  NamedMDNode *Globals = M.getNamedMetadata("llvm.asan.globals");
+  if (!Globals) {
+    return false;
+  }
+  for (MDNode *MDN : Globals->operands()) {
+    if (MDN->getNumOperands() != 5) {
+      continue;
+    }
+    Constant *C = mdconst::extract_or_null<Constant>(MDN->getOperand(0));
+    ConstantInt *IsDynInit =
+        mdconst::extract_or_null<ConstantInt>(MDN->getOperand(3));
+    if (!C || !IsDynInit || !IsDynInit->isOne()) {
+      continue;
+    }
+    if (GlobalVariable *GV = dyn_cast<GlobalVariable>(C->stripPointerCasts())) {
+      DynInitGlobals.insert(GV);
+    }
+  }
+  return false;
+}
+
+Value *AsapRemoveSafeChecks::getAccessedObject(Value *Addr,
+                                               const DataLayout &DL,
+                                               uint64_t &Size) const {
+  Value *Object = GetUnderlyingObject(Addr, DL);
+  if (GlobalVariable *GV = dyn_cast<GlobalVariable>(Object)) {
+    // Like ASan, only trust globals that are initialized by the linker.
+    if (GV->isDeclaration() || GV->isInterposable() ||
+        DynInitGlobals.count(GV)) {
+      return nullptr;
+    }
+    // ASan wraps globals in a struct that appends a redzone. Accesses to the
+    // redzone are errors, so only the first member counts.
+    Type *Ty = GV->getValueType();
+    StructType *STy = dyn_cast<StructType>(Ty);
+    if (STy && STy->getNumElements() == 2 &&
+        isa<ArrayType>(STy->getElementType(1))) {
+      Ty = STy->getElementType(0);
+    }
+    Size = DL.getTypeAllocSize(Ty);
+    return GV;
+  }
+  if (AllocaInst *AI = dyn_cast<AllocaInst>(Object)) {
+    if (!AI->isStaticAlloca() || hasLifetimeMarkers(AI)) {
+      return nullptr;
+    }
+    Size = DL.getTypeAllocSize(AI->getAllocatedType()) *
+           cast<ConstantInt>(AI->getArraySize())->getZExtValue();
+    return AI;
+  }
+  return nullptr;
+}
+
+bool AsapRemoveSafeChecks::runOnFunction(Function &F) {
+  SCI = &getAnalysis<SanityCheckInstructions>();
+  SE = &getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+  LVI = &getAnalysis<LazyValueInfoWrapperPass>().getLVI();
+
+  std::vector<Instruction *> SafeChecks;
+  for (Instruction *Inst : SCI->getSanityCheckRoots()) {
+    if (isCheckSafe(Inst)) {
+      SafeChecks.push_back(Inst);
+    }
+  }
+  for (Instruction *Inst : SafeChecks) {
+    DEBUG(dbgs() << "AsapRemoveSafeChecks: removing ";
+          printDebugLoc(getInstrumentationDebugLoc(Inst), F.getContext(),
+                        dbgs());
+          dbgs() << "\n");
+    eraseCheck(Inst);
+  }
+  NumSafeChecks += SafeChecks.size();
+
+  SCI = nullptr;
+  SE = nullptr;
+  LVI = nullptr;
+  return !SafeChecks.empty();
+}
+
+bool AsapRemoveSafeChecks::isCheckSafe(Instruction *Inst) const {
+  CallInst *CI = dyn_cast<CallInst>(Inst);
+  if (!CI || !CI->getCalledFunction() || CI->getNumArgOperands() != 1) {
+    return false;
+  }
+  bool IsWrite, Recover;
+  uint64_t AccessSize;
+  if (!parseAsanReport(CI->getCalledFunction()->getName(), IsWrite, AccessSize,
+                       Recover)) {
+    return false;
+  }
+  PtrToIntInst *AddrLong = dyn_cast<PtrToIntInst>(CI->getArgOperand(0));
+  if (!AddrLong) {
+    return false;
+  }
+  Value *Addr = AddrLong->getPointerOperand();
+
+  const DataLayout &DL = Inst->getModule()->getDataLayout();
+  uint64_t ObjectSize;
+  Value *Object = getAccessedObject(Addr, DL, ObjectSize);
+  if (!Object || ObjectSize < AccessSize) {
+    return false;
+  }
+
+  ConstantRange Offset = getOffsetRange(Addr, Object, AddrLong);
+  if (Offset.isFullSet() || Offset.isEmptySet()) {
+    return false;
+  }
+  unsigned BitWidth = Offset.getBitWidth();
+  return Offset.getSignedMin().sge(0) &&
+         Offset.getSignedMax().sle(
+             APInt(BitWidth, ObjectSize - AccessSize, /*isSigned=*/false));
+}
+
+ConstantRange AsapRemoveSafeChecks::getOffsetRange(Value *Addr, Value *Object,
+                                                   Instruction *CxtI) const {
+  const DataLayout &DL = CxtI->getModule()->getDataLayout();
+  unsigned BitWidth = DL.getPointerTypeSizeInBits(Addr->getType());
+  ConstantRange Range(BitWidth, /*isFullSet=*/true);
+
+  // ScalarEvolution knows the range of induction variables, and of
+  // expressions derived from them.
+  const SCEV *Offset =
+      SE->getMinusSCEV(SE->getSCEV(Addr), SE->getSCEV(Object));
+  if (!isa<SCEVCouldNotCompute>(Offset) &&
+      SE->getTypeSizeInBits(Offset->getType()) == BitWidth) {
+    Range = SE->getSignedRange(Offset);
+  }
+
+  // LazyValueInfo knows about comparisons that guard the access. We ask it
+  // about the index of an array access, i.e., a GEP with a single variable
+  // index, and compute the offset ourselves.
+  GEPOperator *GEP = dyn_cast<GEPOperator>(Addr->stripPointerCasts());
+  if (!GEP) {
+    return Range;
+  }
+  int64_t BaseOffset;
+  if (GetPointerBaseWithConstantOffset(GEP->getPointerOperand(), BaseOffset,
+                                      DL) != Object) {
+    return Range;
+  }
+  APInt ConstOffset(BitWidth, BaseOffset, /*isSigned=*/true);
+  Value *Index = nullptr;
+  uint64_t Scale = 0;
+  for (auto GTI = gep_type_begin(GEP), E = gep_type_end(GEP); GTI != E; ++GTI) {
+    if (StructType *STy = GTI.getStructTypeOrNull()) {
+      unsigned Field = cast<ConstantInt>(GTI.getOperand())->getZExtValue();
+      ConstOffset += DL.getStructLayout(STy)->getElementOffset(Field);
+      continue;
+    }
+    uint64_t ElementSize = DL.getTypeAllocSize(GTI.getIndexedType());
+    if (ConstantInt *C = dyn_cast<ConstantInt>(GTI.getOperand())) {
+      ConstOffset += C->getValue().sextOrTrunc(BitWidth) * APInt(BitWidth, ElementSize);
+      continue;
+    }
+    if (Index) {
+      return Range;
+    }
+    Index = GTI.getOperand();
+    Scale = ElementSize;
+  }
+  if (!Index) {
+    return Range;
+  }
+  ConstantRange IndexRange =
+      LVI->getConstantRange(Index, CxtI->getParent(), CxtI);
+  ConstantRange GuardedRange =
+      IndexRange.sextOrTrunc(BitWidth)
+          .multiply(ConstantRange(APInt(BitWidth, Scale)))
+          .add(ConstantRange(ConstOffset));
+  return Range.intersectWith(GuardedRange);
+}
+
+char AsapRemoveSafeChecks::ID = 0;
+INITIALIZE_PASS_BEGIN(AsapRemoveSafeChecks, "asap-remove-safe-checks",
+                      "Removes sanity checks that cannot fail", false, false)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_DEPENDENCY(ScalarEvolutionWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(LazyValueInfoWrapperPass)
+INITIALIZE_PASS_END(AsapRemoveSafeChecks, "asap-remove-safe-checks",
+                    "Removes sanity checks that cannot fail", false, false)
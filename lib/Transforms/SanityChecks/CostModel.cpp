@@ -21,18 +21,38 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Transforms/SanityChecks/CostModel.h"
+#include "llvm/Transforms/SanityChecks/SanityCheckInstructions.h"
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/Passes.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
 #include "llvm/IR/Value.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCSchedule.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Object/ObjectFile.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+
 using namespace llvm;
 
 #define CM_NAME "cost-model"
@@ -42,6 +62,145 @@ static cl::opt<bool> EnableReduxCost("sanity-check-costmodel-reduxcost",
                                      cl::init(false), cl::Hidden,
                                      cl::desc("Recognize reduction patterns."));
 
+static cl::opt<std::string> CostTableFile(
+    "asap-cost-table", cl::init(""),
+    cl::desc("Path to a table of measured instruction and callback costs, "
+             "as written by asap/scripts/cost-table/calibrate_costs.sh"));
+
+enum CostModelKind { CostModelTTI, CostModelSched };
+
+static cl::opt<CostModelKind> CostModel(
+    "asap-cost-model", cl::init(CostModelTTI),
+    cl::desc("How to estimate the cost of sanity check instructions"),
+    cl::values(clEnumValN(CostModelTTI, "tti",
+                          "Throughput costs from TargetTransformInfo"),
+               clEnumValN(CostModelSched, "sched",
+                          "Critical-path latencies from the target's "
+                          "scheduling model")));
+
+static cl::opt<std::string> SchedCPU(
+    "asap-sched-cpu", cl::init(""),
+    cl::desc("CPU whose scheduling model -asap-cost-model=sched uses "
+             "(default: the function's target-cpu, or the host CPU)"));
+
+namespace {
+// Costs from -asap-cost-table, by function or opcode name. Functions that a
+// check calls when it fails (such as __asan_report_load4) name the cost of
+// the whole check; other entries are costs of single instructions.
+struct CostTable {
+  StringMap<unsigned> Costs;
+
+  CostTable() {
+    if (CostTableFile.empty())
+      return;
+    auto BufOrErr = MemoryBuffer::getFile(CostTableFile);
+    if (std::error_code EC = BufOrErr.getError())
+      report_fatal_error(CostTableFile + ": " + EC.message());
+
+    // Each line contains a name and a cost, separated by whitespace.
+    for (line_iterator LineIt(**BufOrErr, /*SkipBlanks=*/true, '#');
+         !LineIt.is_at_eof(); ++LineIt) {
+      StringRef Line = LineIt->trim();
+      size_t Separator = Line.find_first_of(" \t");
+      StringRef Name = Line.substr(0, Separator);
+      unsigned Cost;
+      if (Line.substr(Separator).trim().getAsInteger(10, Cost))
+        report_fatal_error(CostTableFile + ":" + Twine(LineIt.line_number()) +
+                           ": expected <name> <cost>, got: " + *LineIt);
+      Costs[Name] = Cost;
+    }
+  }
+};
+} // anonymous namespace
+
+static ManagedStatic<CostTable> CalibratedCosts;
+
+static cl::opt<std::string> CheckSizesBinary(
+    "asap-check-sizes", cl::init(""),
+    cl::desc("Linked binary built with llc -asap-check-ranges, whose "
+             "__asap_check_ranges section gives the size of each check"));
+
+namespace {
+// Machine code sizes from -asap-check-sizes, by check ID.
+struct CheckSizeTable {
+  std::map<uint64_t, uint64_t> Sizes;
+
+  CheckSizeTable() {
+    if (CheckSizesBinary.empty())
+      return;
+    auto ObjOrErr = object::ObjectFile::createObjectFile(CheckSizesBinary);
+    if (!ObjOrErr)
+      report_fatal_error(CheckSizesBinary + ": " +
+                         toString(ObjOrErr.takeError()));
+    object::ObjectFile *Obj = ObjOrErr->getBinary();
+
+    StringRef Ranges;
+    for (const object::SectionRef &Section : Obj->sections()) {
+      StringRef Name;
+      if (!Section.getName(Name) && Name == "__asap_check_ranges" &&
+          Section.getContents(Ranges))
+        report_fatal_error(CheckSizesBinary +
+                           ": could not read __asap_check_ranges");
+    }
+    if (Ranges.empty())
+      report_fatal_error(CheckSizesBinary + ": no __asap_check_ranges "
+                                            "section; was it built with llc "
+                                            "-asap-check-ranges?");
+
+    // Inlined checks have a copy in each function that they were inlined
+    // into. We keep the largest copy, and find the function of each range
+    // from the symbol table.
+    std::vector<uint64_t> FunctionStarts;
+    for (const object::SymbolRef &Symbol : Obj->symbols()) {
+      Expected<object::SymbolRef::Type> Type = Symbol.getType();
+      Expected<uint64_t> Address = Symbol.getAddress();
+      if (Type && Address && *Type == object::SymbolRef::ST_Function)
+        FunctionStarts.push_back(*Address);
+      if (!Type)
+        consumeError(Type.takeError());
+      if (!Address)
+        consumeError(Address.takeError());
+    }
+    std::sort(FunctionStarts.begin(), FunctionStarts.end());
+
+    // Records are {i64 check ID, i64 begin, i64 end}; see
+    // AsmPrinter::emitSanityCheckRanges.
+    const size_t RecordSize = 24;
+    bool IsLittleEndian = Obj->isLittleEndian();
+    auto Read64 = [IsLittleEndian](const char *P) {
+      return IsLittleEndian ? support::endian::read64le(P)
+                            : support::endian::read64be(P);
+    };
+    std::map<std::pair<uint64_t, uint64_t>, uint64_t> SizesByFunction;
+    bool Linked = false;
+    for (size_t Offset = 0; Offset + RecordSize <= Ranges.size();
+         Offset += RecordSize) {
+      const char *Record = Ranges.data() + Offset;
+      uint64_t CheckID = Read64(Record);
+      uint64_t Begin = Read64(Record + 8);
+      uint64_t End = Read64(Record + 16);
+      Linked |= Begin != 0;
+      if (End < Begin)
+        continue;
+      auto FS = std::upper_bound(FunctionStarts.begin(), FunctionStarts.end(),
+                                 Begin);
+      uint64_t Function = FS == FunctionStarts.begin() ? 0 : *(FS - 1);
+      SizesByFunction[std::make_pair(CheckID, Function)] += End - Begin;
+    }
+    if (!Linked)
+      report_fatal_error(CheckSizesBinary + ": __asap_check_ranges has no "
+                                            "addresses; please pass a linked "
+                                            "binary");
+    for (const auto &SBF : SizesByFunction) {
+      uint64_t &Size = Sizes[SBF.first.first];
+      Size = std::max(Size, SBF.second);
+    }
+  }
+};
+} // anonymous namespace
+
+static ManagedStatic<CheckSizeTable> CheckSizes;
+
 namespace sanitychecks {
 
 static bool isReverseVectorMask(SmallVectorImpl<int> &Mask) {
@@ -330,6 +489,28 @@ static bool matchVectorSplittingReduction(const ExtractElementInst *ReduxRoot,
   return true;
 }
 
+bool getCalibratedCost(const Instruction *I, unsigned &Cost) {
+  if (CostTableFile.empty())
+    return false;
+
+  StringRef Name = I->getOpcodeName();
+  if (auto *CI = dyn_cast<CallInst>(I)) {
+    if (Function *Callee = CI->getCalledFunction())
+      Name = Callee->getName();
+  }
+  auto It = CalibratedCosts->Costs.find(Name);
+  if (It == CalibratedCosts->Costs.end())
+    return false;
+  Cost = It->second;
+  return true;
+}
+
+bool getCalibratedCheckCost(const Instruction *Root, unsigned &Cost) {
+  if (CostTableFile.empty() || !isa<CallInst>(Root))
+    return false;
+  return getCalibratedCost(Root, Cost);
+}
+
 unsigned getInstructionCost(const Instruction *I, const TargetTransformInfo *TTI) {
   if (!TTI)
     return -1;
@@ -473,4 +654,347 @@ unsigned getInstructionCost(const Instruction *I, const TargetTransformInfo *TTI
   }
 }
 
+// The subtarget and instruction tables for -asap-cost-model=sched.
+struct SchedCostModel::SchedTarget {
+  std::unique_ptr<MCSubtargetInfo> STI;
+  std::unique_ptr<MCInstrInfo> MII;
+  // Machine opcodes by name, for the instructions in getSchedClass.
+  StringMap<unsigned> Opcodes;
+};
+
+// Targets by triple, CPU and features. Creating a subtarget parses the feature
+// string, so we do it once per module, not per function.
+static ManagedStatic<StringMap<std::unique_ptr<SchedCostModel::SchedTarget>>>
+    SchedTargets;
+
+const SchedCostModel::SchedTarget *
+SchedCostModel::getSchedTarget(const Function &F) {
+  std::string TripleName = F.getParent()->getTargetTriple();
+  if (TripleName.empty())
+    TripleName = sys::getDefaultTargetTriple();
+
+  std::string CPU = SchedCPU;
+  if (CPU.empty() && F.hasFnAttribute("target-cpu"))
+    CPU = F.getFnAttribute("target-cpu").getValueAsString();
+  if (CPU.empty() || CPU == "native")
+    CPU = sys::getHostCPUName();
+  std::string Features;
+  if (F.hasFnAttribute("target-features"))
+    Features = F.getFnAttribute("target-features").getValueAsString();
+
+  auto &ST = (*SchedTargets)[TripleName + "/" + CPU + "/" + Features];
+  if (!ST) {
+    std::string Error;
+    const Target *T = TargetRegistry::lookupTarget(TripleName, Error);
+    if (!T)
+      report_fatal_error("-asap-cost-model=sched: " + Error);
+    ST.reset(new SchedTarget);
+    ST->STI.reset(T->createMCSubtargetInfo(TripleName, CPU, Features));
+    if (!ST->STI)
+      report_fatal_error("-asap-cost-model=sched: no subtarget for " +
+                         TripleName + " " + CPU);
+    ST->MII.reset(T->createMCInstrInfo());
+    if (ST->MII) {
+      for (unsigned Opcode = 0, e = ST->MII->getNumOpcodes(); Opcode < e;
+           ++Opcode)
+        ST->Opcodes[ST->MII->getName(Opcode)] = Opcode;
+    }
+  }
+  return ST.get();
+}
+
+SchedCostModel::SchedCostModel(const Function &F,
+                               const SanityCheckInstructions &SCI) {
+  if (CostModel != CostModelSched)
+    return;
+  Subtarget = getSchedTarget(F);
+  SchedModel = &Subtarget->STI->getSchedModel();
+
+  for (Instruction *Root : SCI.getSanityCheckRoots()) {
+    const InstructionSet &Instrs = SCI.getInstructionsBySanityCheck(Root);
+
+    // Find the longest dependency chain in each block. Instructions in a
+    // block are visited in program order, so operands come first.
+    DenseMap<const Instruction *, unsigned> Depth;
+    DenseMap<const Instruction *, const Instruction *> Pred;
+    SmallPtrSet<const BasicBlock *, 4> Blocks;
+    for (Instruction *I : Instrs)
+      Blocks.insert(I->getParent());
+    SmallVector<const Instruction *, 4> ChainEnds;
+    for (const BasicBlock *BB : Blocks) {
+      const Instruction *End = nullptr;
+      for (const Instruction &I : *BB) {
+        if (!Instrs.count(const_cast<Instruction *>(&I)))
+          continue;
+        unsigned OperandDepth = 0;
+        for (const Value *Op : I.operands()) {
+          auto *OpI = dyn_cast<Instruction>(Op);
+          if (OpI && OpI->getParent() == BB && Depth.count(OpI) &&
+              Depth[OpI] >= OperandDepth) {
+            OperandDepth = Depth[OpI];
+            Pred[&I] = OpI;
+          }
+        }
+        Depth[&I] = OperandDepth + getLatency(&I);
+        if (!End || Depth[&I] >= Depth[End])
+          End = &I;
+      }
+      ChainEnds.push_back(End);
+    }
+
+    // Instructions on the chain delay the program by their latency. The
+    // others execute in parallel, and only occupy issue slots and execution
+    // units.
+    SmallPtrSet<const Instruction *, 16> Critical;
+    for (const Instruction *I : ChainEnds)
+      for (; I; I = Pred.lookup(I))
+        Critical.insert(I);
+    for (Instruction *I : Instrs) {
+      unsigned Latency = getLatency(I);
+      double Cost =
+          Critical.count(I) ? Latency : (Latency ? getThroughputCost(I) : 0);
+      double &OldCost = Costs[I];
+      OldCost = std::max(OldCost, Cost);
+    }
+  }
+}
+
+double SchedCostModel::getCost(const Instruction *I) const {
+  auto It = Costs.find(I);
+  assert(It != Costs.end() && "Instruction does not belong to a check");
+  return It->second;
+}
+
+// Returns the x86-64 instruction that I typically lowers to, or an empty
+// string for instructions that have no single representative.
+static std::string getX86Instruction(const Instruction *I) {
+  Type *Ty = I->getType();
+  if (auto *SI = dyn_cast<StoreInst>(I))
+    Ty = SI->getValueOperand()->getType();
+  else if (isa<CmpInst>(I) || isa<CastInst>(I))
+    Ty = I->getOperand(0)->getType();
+  unsigned Bits = Ty->isIntegerTy() ? Ty->getIntegerBitWidth() : 64;
+  std::string Width = Bits <= 8 ? "8" : Bits <= 16 ? "16" : Bits <= 32 ? "32"
+                                                                      : "64";
+  std::string FP = Ty->isFloatTy() ? "SS" : "SD";
+
+  switch (I->getOpcode()) {
+  case Instruction::Add:
+    return "ADD" + Width + "rr";
+  case Instruction::Sub:
+    return "SUB" + Width + "rr";
+  case Instruction::And:
+    return "AND" + Width + "rr";
+  case Instruction::Or:
+    return "OR" + Width + "rr";
+  case Instruction::Xor:
+    return "XOR" + Width + "rr";
+  case Instruction::Shl:
+    return "SHL" + Width + "ri";
+  case Instruction::LShr:
+    return "SHR" + Width + "ri";
+  case Instruction::AShr:
+    return "SAR" + Width + "ri";
+  case Instruction::Mul:
+    return "IMUL" + (Bits <= 16 ? std::string("16") : Width) + "rr";
+  case Instruction::UDiv:
+  case Instruction::URem:
+    return "DIV" + Width + "r";
+  case Instruction::SDiv:
+  case Instruction::SRem:
+    return "IDIV" + Width + "r";
+  case Instruction::Load:
+    return Ty->isFloatingPointTy() ? "MOV" + FP + "rm" : "MOV" + Width + "rm";
+  case Instruction::Store:
+    return Ty->isFloatingPointTy() ? "MOV" + FP + "mr" : "MOV" + Width + "mr";
+  case Instruction::ICmp:
+    return "CMP" + Width + "rr";
+  case Instruction::FAdd:
+    return "ADD" + FP + "rr";
+  case Instruction::FSub:
+    return "SUB" + FP + "rr";
+  case Instruction::FMul:
+    return "MUL" + FP + "rr";
+  case Instruction::FDiv:
+    return "DIV" + FP + "rr";
+  case Instruction::FCmp:
+    return "UCOMI" + FP + "rr";
+  case Instruction::ZExt:
+    return "MOVZX32rr8";
+  case Instruction::SExt:
+    return "MOVSX64rr32";
+  case Instruction::Trunc:
+    return "MOV32rr";
+  case Instruction::Select:
+    return "CMOVE" + (Bits <= 16 ? std::string("16") : Width) + "rr";
+  case Instruction::GetElementPtr:
+    return "LEA64r";
+  case Instruction::Br:
+    return cast<BranchInst>(I)->isConditional() ? "JNE_1" : "JMP_1";
+  default:
+    return "";
+  }
+}
+
+const MCSchedClassDesc *
+SchedCostModel::getSchedClass(const Instruction *I) const {
+  if (!Subtarget->MII || !SchedModel->hasInstrSchedModel() ||
+      Subtarget->STI->getTargetTriple().getArch() != Triple::x86_64)
+    return nullptr;
+  auto It = Subtarget->Opcodes.find(getX86Instruction(I));
+  if (It == Subtarget->Opcodes.end())
+    return nullptr;
+  unsigned SchedClass = Subtarget->MII->get(It->second).getSchedClass();
+  const MCSchedClassDesc *SC = SchedModel->getSchedClassDesc(SchedClass);
+  // Variant classes depend on operands that IR does not have.
+  if (!SC->isValid() || SC->isVariant())
+    return nullptr;
+  return SC;
+}
+
+unsigned SchedCostModel::getLatency(const Instruction *I) const {
+  switch (I->getOpcode()) {
+  case Instruction::PHI:
+  case Instruction::Unreachable:
+  case Instruction::PtrToInt:
+  case Instruction::IntToPtr:
+  case Instruction::BitCast:
+  case Instruction::AddrSpaceCast:
+    // These are free, or folded into their users.
+    return 0;
+  case Instruction::GetElementPtr:
+    if (cast<GetElementPtrInst>(I)->hasAllZeroIndices())
+      return 0;
+    break;
+  case Instruction::Call:
+    if (isa<DbgInfoIntrinsic>(I))
+      return 0;
+    if (isa<IntrinsicInst>(I))
+      return 1;
+    // A call and return, plus whatever the callee does. We cannot see the
+    // callee, so this is as rough as it gets.
+    return SchedModel->HighLatency;
+  default:
+    break;
+  }
+
+  // The latency of the longest write of the representative machine
+  // instruction, if the model has one. Otherwise, use model-wide values.
+  unsigned Latency = 1;
+  if (const MCSchedClassDesc *SC = getSchedClass(I)) {
+    // Stores and branches define no registers; they take at least a cycle.
+    Latency = SC->NumWriteLatencyEntries ? 0 : 1;
+    for (unsigned Def = 0; Def < SC->NumWriteLatencyEntries; ++Def) {
+      int Cycles = Subtarget->STI->getWriteLatencyEntry(SC, Def)->Cycles;
+      Latency = std::max(Latency, Cycles < 0 ? SchedModel->HighLatency
+                                             : (unsigned)Cycles);
+    }
+  } else {
+    switch (I->getOpcode()) {
+    case Instruction::Load:
+      Latency = SchedModel->LoadLatency;
+      break;
+    case Instruction::Mul:
+    case Instruction::FAdd:
+    case Instruction::FSub:
+    case Instruction::FMul:
+    case Instruction::FCmp:
+      Latency = 3;
+      break;
+    case Instruction::UDiv:
+    case Instruction::SDiv:
+    case Instruction::URem:
+    case Instruction::SRem:
+    case Instruction::FDiv:
+    case Instruction::FRem:
+      Latency = SchedModel->HighLatency;
+      break;
+    }
+  }
+
+  // Conditional branches also cost the mispredict penalty when they go the
+  // unlikely way. ASan marks its slow paths as very unlikely.
+  uint64_t TrueWeight, FalseWeight;
+  if (isa<BranchInst>(I) && cast<BranchInst>(I)->isConditional() &&
+      I->extractProfMetadata(TrueWeight, FalseWeight) &&
+      TrueWeight + FalseWeight > 0) {
+    double Mispredicted = (double)std::min(TrueWeight, FalseWeight) /
+                          (TrueWeight + FalseWeight);
+    Latency += (unsigned)(Mispredicted * SchedModel->MispredictPenalty);
+  }
+  return Latency;
+}
+
+double SchedCostModel::getThroughputCost(const Instruction *I) const {
+  double IssueWidth = std::max(1u, SchedModel->IssueWidth);
+  const MCSchedClassDesc *SC = getSchedClass(I);
+  if (!SC)
+    return 1 / IssueWidth;
+
+  // The instruction takes its micro-ops' share of the issue width, or the
+  // cycles it keeps its busiest execution units occupied, whichever is more.
+  double Cost = SC->NumMicroOps / IssueWidth;
+  for (const MCWriteProcResEntry *WPR = Subtarget->STI->getWriteProcResBegin(SC),
+                                 *WEnd = Subtarget->STI->getWriteProcResEnd(SC);
+       WPR != WEnd; ++WPR) {
+    const MCProcResourceDesc *PRD =
+        SchedModel->getProcResource(WPR->ProcResourceIdx);
+    Cost = std::max(Cost, (double)WPR->Cycles / std::max(1u, PRD->NumUnits));
+  }
+  return Cost;
+}
+
+bool getMeasuredCheckSize(uint64_t CheckID, uint64_t &Size) {
+  if (CheckSizesBinary.empty())
+    return false;
+  auto It = CheckSizes->Sizes.find(CheckID);
+  if (It == CheckSizes->Sizes.end())
+    return false;
+  Size = It->second;
+  return true;
+}
+
+unsigned getInstructionSize(const Instruction *I) {
+  // Rough x86-64 encoding sizes, assuming that operands are in registers or
+  // small immediates, and that compares fuse with their branch.
+  switch (I->getOpcode()) {
+  case Instruction::PHI:
+  case Instruction::Unreachable:
+  case Instruction::PtrToInt:
+  case Instruction::IntToPtr:
+  case Instruction::BitCast:
+  case Instruction::AddrSpaceCast:
+    return 0;
+  case Instruction::GetElementPtr:
+    return cast<GetElementPtrInst>(I)->hasAllZeroIndices() ? 0 : 4;
+  case Instruction::Trunc:
+  case Instruction::ZExt:
+  case Instruction::SExt:
+  case Instruction::ICmp:
+    return 3;
+  case Instruction::UDiv:
+  case Instruction::SDiv:
+  case Instruction::URem:
+  case Instruction::SRem:
+    // Sign or zero extension of the dividend, plus the division.
+    return 6;
+  case Instruction::Select:
+    return 7;
+  case Instruction::Br:
+    // Branches to the slow path of a check usually need a 32-bit offset.
+    return cast<BranchInst>(I)->isConditional() ? 6 : 5;
+  case Instruction::Call: {
+    if (isa<DbgInfoIntrinsic>(I))
+      return 0;
+    const CallInst *CI = cast<CallInst>(I);
+    if (CI->isInlineAsm())
+      return 0;
+    // The call itself, plus moving each argument into its register.
+    return 5 + 3 * CI->getNumArgOperands();
+  }
+  default:
+    return 4;
+  }
+}
+
 } // namespace sanitychecks
@@ -51,6 +51,8 @@ bool GCOVFile::readGCNO(GCOVBuffer &Buffer) {
     auto GFun = make_unique<GCOVFunction>(*this);
     if (!GFun->readGCNO(Buffer, Version))
       return false;
+    // Like gcov, we use the first function if several have the same name.
+    FunctionsByName.insert(std::make_pair(GFun->getName(), GFun.get()));
     Functions.push_back(std::move(GFun));
   }
 
@@ -127,63 +129,54 @@ void GCOVFile::collectLineCounts(FileInfo &FI) {
   FI.setProgramCount(ProgramCount);
 }
 
-uint64_t GCOVFile::getCount(Instruction *Inst) const {
-  BasicBlock *ParentB = Inst->getParent();
-  Function *ParentF = Inst->getParent()->getParent();
-  const GCOVFunction *F = getFunction(ParentF);
-  if (!F) {
+bool GCOVFile::getBlockCounts(
+    const Function &F, DenseMap<const BasicBlock *, uint64_t> &Counts) const {
+  Counts.clear();
+  const GCOVFunction *GF = getFunction(&F);
+  if (!GF) {
     // FIXME: Sometimes GCOV data seems to be missing some functions.
     // I haven't yet found out why this is so. I currently silently ignore
     // the issue, but this might cause problems.
-    DEBUG(dbgs() << "Warning: could not find function " << ParentF->getName()
+    DEBUG(dbgs() << "Warning: could not find function " << F.getName()
                  << " in GCOV data\n");
-    return 0;
+    return false;
   }
 
-  // Find the offset of the block inside its function, and take the GCOV block
-  // at the same offset.
+  // Each block gets the count of the GCOV block at the same offset.
   // FIXME: This could break very easily, if the order in which GCOV handles
-  //        blocks changes... we try to assert on the shape of the CFG, but
-  //        there is no real guarantee.
+  //        blocks changes... we check the shape of the CFG, but there is no
+  //        real guarantee.
 
   // GCOVProfiler::emitProfileNotes() splits the entry block of the function.
   // It also adds a "return block", which is always the last block.
   // Hence the first and last block of the GCOVFunction are unused, and hence
   // the +2.
-  assert(ParentF->size() + 2 == F->getNumBlocks() &&
-         "Function size does not match GCOV data?");
-  Function::iterator ParentBI = ParentF->begin();
-  GCOVFunction::BlockIterator BI = F->block_begin();
+  if (F.size() + 2 != GF->getNumBlocks()) {
+    errs() << "Warning: " << F.getName() << " has " << F.size()
+           << " blocks, but GCOV data has " << GF->getNumBlocks() - 2
+           << "; ignoring its counts.\n";
+    return false;
+  }
+  GCOVFunction::BlockIterator BI = GF->block_begin();
   ++BI; // Skip split entry block
-  while (ParentBI != ParentF->end() && &(*ParentBI) != ParentB) {
-    assert(((isa<ReturnInst>(ParentBI->getTerminator()) &&
-             BI->getNumDstEdges() == 1) ||
-            (ParentBI->getTerminator()->getNumSuccessors() ==
-             BI->getNumDstEdges())) &&
-           "CFG mismatch: dst edges");
-    ++ParentBI;
+  for (const BasicBlock &BB : F) {
+    if (!((isa<ReturnInst>(BB.getTerminator()) && BI->getNumDstEdges() == 1) ||
+          BB.getTerminator()->getNumSuccessors() == BI->getNumDstEdges())) {
+      errs() << "Warning: block " << Counts.size() << " of " << F.getName()
+             << " has " << BB.getTerminator()->getNumSuccessors()
+             << " successors, but GCOV data has " << BI->getNumDstEdges()
+             << "; ignoring its counts.\n";
+      Counts.clear();
+      return false;
+    }
+    Counts[&BB] = BI->getCount();
     ++BI;
   }
-  assert(ParentBI != ParentF->end() &&
-         "Basic block not a member of its parent function?.");
-  assert(((isa<ReturnInst>(ParentBI->getTerminator()) &&
-           BI->getNumDstEdges() == 1) ||
-          (ParentBI->getTerminator()->getNumSuccessors() ==
-           BI->getNumDstEdges())) &&
-         "CFG mismatch: dst edges");
-
-  return BI->getCount();
+  return true;
 }
 
 const GCOVFunction *GCOVFile::getFunction(const Function *F) const {
-  for (const auto &Fptr : Functions) {
-    // FIXME: somehow returning a pointer defeats the use of std::unique_ptr
-    // here. Is there a way to do this properly?
-    if (Fptr->getName() == F->getName())
-      return Fptr.get();
-  }
-
-  return nullptr;
+  return FunctionsByName.lookup(F->getName());
 }
 
 //===----------------------------------------------------------------------===//
@@ -0,0 +1,228 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+//
+// Moves the failure paths of sanity checks out of the way of program code.
+//
+// A check's failure path is a block that only contains check code, such as a
+// call to __asan_report_load4 followed by unreachable. This pass marks the
+// branches into these blocks as very unlikely, and the reporting calls as
+// cold, so that the code generator places failure blocks at the end of their
+// function. Failure blocks that are larger than a call are outlined into
+// functions in .text.unlikely. This makes checks that ASAP keeps cheaper, as
+// they take up less space in hot code.
+
+#include "llvm/Transforms/SanityChecks/CostModel.h"
+#include "llvm/Transforms/SanityChecks/SanityCheckInstructions.h"
+
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/CodeExtractor.h"
+
+#include <vector>
+#define DEBUG_TYPE "sanity-check-cold-paths"
+
+using namespace llvm;
+
+STATISTIC(NumColdBranches, "Number of branches into check failure paths");
+STATISTIC(NumOutlined, "Number of outlined check failure paths");
+
+static cl::opt<bool> OutlineColdPaths(
+    "asap-outline-cold-paths",
+    cl::desc("Outline check failure paths that are larger than a call into "
+             ".text.unlikely"),
+    cl::init(true));
+
+// Branch weights for entering a failure path. These are stronger than the
+// 1:100000 that ASan uses; weaker weights are replaced.
+static const uint32_t ColdWeight = 1;
+static const uint32_t HotWeight = (1 << 20) - 1;
+
+static const char *const ColdSection = ".text.unlikely";
+
+namespace {
+struct SanityCheckColdPaths : public ModulePass {
+  static char ID;
+
+  SanityCheckColdPaths() : ModulePass(ID) {
+    initializeSanityCheckColdPathsPass(*PassRegistry::getPassRegistry());
+  }
+
+  virtual bool runOnModule(Module &M) override;
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<SanityCheckInstructions>();
+  }
+
+private:
+  // Marks branches into BB as very unlikely. Returns true if it changed any.
+  bool setColdBranchWeights(BasicBlock *BB);
+
+  // Moves BB, which ends in unreachable, into a new cold function, if that
+  // makes the calling function smaller. Returns true if it worked.
+  bool outlineFailurePath(BasicBlock *BB);
+};
+} // anonymous namespace
+
+// Returns true if BB only contains instructions of the given check.
+static bool isFailurePath(BasicBlock *BB, const InstructionSet &CheckInsts) {
+  if (BB == &BB->getParent()->getEntryBlock()) {
+    return false;
+  }
+  for (Instruction &I : *BB) {
+    if (!isa<DbgInfoIntrinsic>(&I) && !CheckInsts.count(&I)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SanityCheckColdPaths::runOnModule(Module &M) {
+  // Outlining adds functions to the module, so we collect the existing ones
+  // first.
+  std::vector<Function *> Functions;
+  for (Function &F : M) {
+    if (!F.isDeclaration() && F.getSection() != ColdSection) {
+      Functions.push_back(&F);
+    }
+  }
+
+  bool Changed = false;
+  for (Function *F : Functions) {
+    SanityCheckInstructions &SCI = getAnalysis<SanityCheckInstructions>(*F);
+
+    SetVector<BasicBlock *> FailurePaths;
+    for (Instruction *Root : SCI.getSanityCheckRoots()) {
+      BasicBlock *BB = Root->getParent();
+      if (!isFailurePath(BB, SCI.getInstructionsBySanityCheck(Root))) {
+        continue;
+      }
+      FailurePaths.insert(BB);
+      if (CallInst *CI = dyn_cast<CallInst>(Root)) {
+        CI->addAttribute(AttributeSet::FunctionIndex, Attribute::Cold);
+        Changed = true;
+      }
+    }
+
+    for (BasicBlock *BB : FailurePaths) {
+      Changed |= setColdBranchWeights(BB);
+      if (OutlineColdPaths && isa<UnreachableInst>(BB->getTerminator())) {
+        Changed |= outlineFailurePath(BB);
+      }
+    }
+  }
+  return Changed;
+}
+
+bool SanityCheckColdPaths::setColdBranchWeights(BasicBlock *BB) {
+  bool Changed = false;
+  MDBuilder MDB(BB->getContext());
+  for (auto PI = pred_begin(BB), E = pred_end(BB); PI != E; ++PI) {
+    BranchInst *BI = dyn_cast<BranchInst>((*PI)->getTerminator());
+    if (!BI || !BI->isConditional() ||
+        BI->getSuccessor(0) == BI->getSuccessor(1)) {
+      continue;
+    }
+    bool ColdIsTrue = BI->getSuccessor(0) == BB;
+
+    // Keep existing weights that are already strong enough.
+    uint64_t TrueWeight, FalseWeight;
+    if (BI->extractProfMetadata(TrueWeight, FalseWeight)) {
+      uint64_t Cold = ColdIsTrue ? TrueWeight : FalseWeight;
+      uint64_t Hot = ColdIsTrue ? FalseWeight : TrueWeight;
+      if (Cold * HotWeight <= Hot * ColdWeight) {
+        continue;
+      }
+    }
+    BI->setMetadata(LLVMContext::MD_prof,
+                    ColdIsTrue ? MDB.createBranchWeights(ColdWeight, HotWeight)
+                               : MDB.createBranchWeights(HotWeight, ColdWeight));
+    NumColdBranches += 1;
+    Changed = true;
+  }
+  return Changed;
+}
+
+bool SanityCheckColdPaths::outlineFailurePath(BasicBlock *BB) {
+  if (!CodeExtractor::isBlockValidForExtraction(*BB)) {
+    return false;
+  }
+
+  // Outlining only pays off if the failure path is larger than the call
+  // that replaces it.
+  CodeExtractor CE(BB);
+  SetVector<Value *> Inputs, Outputs;
+  CE.findInputsOutputs(Inputs, Outputs);
+  if (!Outputs.empty()) {
+    return false;
+  }
+  unsigned Size = 0;
+  DebugLoc DL;
+  for (Instruction &I : *BB) {
+    Size += sanitychecks::getInstructionSize(&I);
+    if (!DL && isa<CallInst>(&I)) {
+      DL = I.getDebugLoc();
+    }
+  }
+  unsigned CallSize = 5 + 3 * Inputs.size();
+  if (Size <= CallSize) {
+    return false;
+  }
+
+  Function *F = BB->getParent();
+  Function *ColdF = CE.extractCodeRegion();
+  if (!ColdF) {
+    return false;
+  }
+  ColdF->setSection(ColdSection);
+  ColdF->setComdat(F->getComdat());
+  ColdF->addFnAttr(Attribute::Cold);
+  ColdF->addFnAttr(Attribute::NoInline);
+  ColdF->addFnAttr(Attribute::MinSize);
+  ColdF->addFnAttr(Attribute::OptimizeForSize);
+  ColdF->setDoesNotReturn();
+
+  // The cold function has no debug info of its own. Error reports still
+  // point to the check, through the location of the call.
+  for (BasicBlock &ColdBB : *ColdF) {
+    for (auto I = ColdBB.begin(), E = ColdBB.end(); I != E;) {
+      Instruction *Inst = &*I++;
+      if (isa<DbgInfoIntrinsic>(Inst)) {
+        Inst->eraseFromParent();
+      } else {
+        Inst->setDebugLoc(DebugLoc());
+      }
+    }
+  }
+
+  // CodeExtractor ends the calling block with a return, because the failure
+  // path had no successors. It does not return, though.
+  CallInst *Call = cast<CallInst>(*ColdF->user_begin());
+  Call->setDebugLoc(DL);
+  Call->setDoesNotReturn();
+  TerminatorInst *OldTerm = Call->getParent()->getTerminator();
+  new UnreachableInst(F->getContext(), OldTerm);
+  OldTerm->eraseFromParent();
+
+  DEBUG(dbgs() << "Outlined failure path of " << F->getName() << " into "
+               << ColdF->getName() << "\n");
+  NumOutlined += 1;
+  return true;
+}
+
+char SanityCheckColdPaths::ID = 0;
+INITIALIZE_PASS_BEGIN(SanityCheckColdPaths, "sanity-check-cold-paths",
+                      "Moves sanity check failure paths out of hot code",
+                      false, false)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_END(SanityCheckColdPaths, "sanity-check-cold-paths",
+                    "Moves sanity check failure paths out of hot code",
+                    false, false)
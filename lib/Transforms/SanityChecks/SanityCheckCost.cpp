@@ -0,0 +1,242 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+
+#include "llvm/Transforms/SanityChecks/SanityCheckCost.h"
+#include "llvm/Transforms/SanityChecks/CostModel.h"
+#include "llvm/Transforms/SanityChecks/SanityCheckInstructions.h"
+#include "llvm/Transforms/SanityChecks/utils.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/EquivalenceClasses.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <string>
+#define DEBUG_TYPE "sanity-check-cost"
+
+using namespace llvm;
+
+namespace {
+enum SharedCostMode { SharedCostSum, SharedCostSplit, SharedCostGroup };
+
+bool largerCost(const SanityCheckCost::CheckCost &a,
+                const SanityCheckCost::CheckCost &b) {
+  return a.second > b.second;
+}
+
+const std::vector<Instruction *> kEmptyCheckGroup;
+} // anonymous namespace
+
+static cl::opt<SharedCostMode> SharedCost(
+    "asap-shared-cost",
+    cl::desc("How to attribute the cost of instructions shared by checks"),
+    cl::values(clEnumValN(SharedCostSum, "sum",
+                          "Charge shared instructions to every check"),
+               clEnumValN(SharedCostSplit, "split",
+                          "Split the cost of shared instructions evenly"),
+               clEnumValN(SharedCostGroup, "group",
+                          "Treat checks sharing instructions as one unit")),
+    cl::init(SharedCostSum));
+
+static cl::opt<std::string> SpillCostFile(
+    "asap-spill-costs", cl::init(""),
+    cl::desc("Path to the spill costs of checks, as written by "
+             "llc -asap-spill-cost-output"));
+
+namespace {
+// Spill and reload instructions per execution, by check ID.
+struct SpillCostTable {
+  std::map<uint64_t, double> Costs;
+
+  SpillCostTable() {
+    if (SpillCostFile.empty())
+      return;
+    auto BufOrErr = MemoryBuffer::getFile(SpillCostFile);
+    if (std::error_code EC = BufOrErr.getError())
+      report_fatal_error(SpillCostFile + ": " + EC.message());
+
+    // Each line contains a check ID and a cost. IDs may also be signed, as
+    // they appear in IR. Inline functions appear in several translation
+    // units; we keep the largest estimate.
+    for (line_iterator LineIt(**BufOrErr, /*SkipBlanks=*/true);
+         !LineIt.is_at_eof(); ++LineIt) {
+      StringRef ID, Cost;
+      std::tie(ID, Cost) = LineIt->trim().split(' ');
+      uint64_t CheckID;
+      int64_t SignedCheckID;
+      bool InvalidID = false;
+      if (!ID.getAsInteger(10, SignedCheckID))
+        CheckID = SignedCheckID;
+      else
+        InvalidID = ID.getAsInteger(10, CheckID);
+      std::string CostStr = Cost.trim();
+      char *CostEnd;
+      double SpillCost = strtod(CostStr.c_str(), &CostEnd);
+      if (InvalidID || CostStr.empty() || *CostEnd)
+        report_fatal_error(SpillCostFile + ":" + Twine(LineIt.line_number()) +
+                           ": expected <check ID> <cost>, got: " + *LineIt);
+      Costs[CheckID] = std::max(Costs[CheckID], SpillCost);
+    }
+  }
+};
+} // anonymous namespace
+
+static ManagedStatic<SpillCostTable> SpillCosts;
+
+const std::vector<Instruction *> &
+SanityCheckCost::getCheckGroup(Instruction *Inst) const {
+  auto CG = CheckGroups.find(Inst);
+  return CG != CheckGroups.end() ? CG->second : kEmptyCheckGroup;
+}
+
+void SanityCheckCost::computeCheckCosts(
+    Function &F, const SanityCheckInstructions &SCI,
+    function_ref<double(Instruction *)> InstructionCost,
+    function_ref<double(Instruction *)> ExecutionCount) {
+  CheckCosts.clear();
+  CheckGroups.clear();
+
+  // Visit checks in program order, so that group leaders do not depend on
+  // pointer values.
+  std::vector<Instruction *> Roots;
+  for (Instruction &I : instructions(F)) {
+    if (SCI.getSanityCheckRoots().count(&I)) {
+      Roots.push_back(&I);
+    }
+  }
+
+  // A check runs as often as its most frequently executed instruction.
+  auto CheckExecutions = [&](Instruction *Root) {
+    double Executions = 0;
+    for (Instruction *I : SCI.getInstructionsBySanityCheck(Root)) {
+      Executions = std::max(Executions, ExecutionCount(I));
+    }
+    return Executions;
+  };
+
+  // Costs that are charged per execution of a check, rather than per
+  // instruction: spill code, and measured costs of whole checks from
+  // -asap-cost-table. The instructions of checks with a measured cost are
+  // not priced individually.
+  DenseMap<Instruction *, double> PerCheckCosts;
+  SmallPtrSet<Instruction *, 32> CalibratedChecks;
+  for (Instruction *Root : Roots) {
+    double Cost = 0;
+    unsigned CalibratedCost;
+    if (sanitychecks::getCalibratedCheckCost(Root, CalibratedCost)) {
+      CalibratedChecks.insert(Root);
+      Cost += CalibratedCost;
+    }
+    if (!SpillCostFile.empty()) {
+      auto SC = SpillCosts->Costs.find(SCI.getCheckID(Root));
+      if (SC != SpillCosts->Costs.end()) {
+        Cost += SC->second;
+      }
+    }
+    if (Cost) {
+      PerCheckCosts[Root] = Cost * CheckExecutions(Root);
+    }
+  }
+
+  // Instruction costs can be expensive to compute, and shared instructions
+  // would otherwise be visited once per check.
+  DenseMap<Instruction *, double> Costs;
+  DenseMap<Instruction *, unsigned> NumChecks;
+  for (Instruction *Root : Roots) {
+    if (CalibratedChecks.count(Root)) {
+      continue;
+    }
+    for (Instruction *I : SCI.getInstructionsBySanityCheck(Root)) {
+      if (NumChecks[I]++ == 0) {
+        Costs[I] = InstructionCost(I);
+      }
+    }
+  }
+
+  // The leader of each group, and the total cost of its checks.
+  std::vector<std::pair<Instruction *, double>> Leaders;
+  if (SharedCost == SharedCostGroup) {
+    // Checks that share an instruction belong to the same group.
+    EquivalenceClasses<Instruction *> Groups;
+    DenseMap<Instruction *, Instruction *> FirstCheck;
+    for (Instruction *Root : Roots) {
+      Groups.insert(Root);
+      for (Instruction *I : SCI.getInstructionsBySanityCheck(Root)) {
+        auto FC = FirstCheck.insert(std::make_pair(I, Root));
+        if (!FC.second) {
+          Groups.unionSets(FC.first->second, Root);
+        }
+      }
+    }
+
+    DenseMap<Instruction *, size_t> LeaderIndex;
+    std::vector<SmallPtrSet<Instruction *, 32>> GroupInstructions;
+    for (Instruction *Root : Roots) {
+      auto LI = LeaderIndex.insert(
+          std::make_pair(Groups.getLeaderValue(Root), Leaders.size()));
+      if (LI.second) {
+        Leaders.push_back(std::make_pair(Root, 0.0));
+        GroupInstructions.emplace_back();
+      } else {
+        CheckGroups[Leaders[LI.first->second].first].push_back(Root);
+      }
+      if (!CalibratedChecks.count(Root)) {
+        const InstructionSet &Instrs = SCI.getInstructionsBySanityCheck(Root);
+        GroupInstructions[LI.first->second].insert(Instrs.begin(),
+                                                   Instrs.end());
+      }
+      Leaders[LI.first->second].second += PerCheckCosts.lookup(Root);
+    }
+
+    // Each instruction is counted once per group.
+    for (size_t i = 0; i < Leaders.size(); ++i) {
+      for (Instruction *I : GroupInstructions[i]) {
+        Leaders[i].second += Costs[I];
+      }
+    }
+  } else {
+    for (Instruction *Root : Roots) {
+      double Cost = PerCheckCosts.lookup(Root);
+      if (!CalibratedChecks.count(Root)) {
+        for (Instruction *I : SCI.getInstructionsBySanityCheck(Root)) {
+          Cost += SharedCost == SharedCostSplit ? Costs[I] / NumChecks[I]
+                                                : Costs[I];
+        }
+      }
+      Leaders.push_back(std::make_pair(Root, Cost));
+    }
+  }
+
+  for (auto &L : Leaders) {
+    uint64_t Cost = (uint64_t)L.second;
+    MDNode *MD = MDNode::get(
+        F.getContext(), {ConstantAsMetadata::get(ConstantInt::get(
+                            Type::getInt64Ty(F.getContext()), Cost))});
+    L.first->setMetadata("cost", MD);
+    for (Instruction *Member : getCheckGroup(L.first)) {
+      Member->setMetadata("cost", MD);
+    }
+    CheckCosts.push_back(std::make_pair(L.first, Cost));
+
+    DEBUG(dbgs() << "Sanity check: " << *L.first << "\n";
+          DebugLoc DL = getInstrumentationDebugLoc(L.first);
+          printDebugLoc(DL, F.getContext(), dbgs());
+          dbgs() << "\nGroup size: " << (getCheckGroup(L.first).size() + 1)
+                 << "\nCost: " << Cost << "\n";);
+  }
+
+  std::sort(CheckCosts.begin(), CheckCosts.end(), largerCost);
+}
@@ -3,8 +3,10 @@
 
 #include "llvm/Transforms/SanityChecks/SanityCheckCoverageCost.h"
 #include "llvm/Transforms/SanityChecks/SanityCheckInstructions.h"
+#include "llvm/Transforms/SanityChecks/SymbolizationIndex.h"
 #include "llvm/Transforms/SanityChecks/utils.h"
 
+#include "llvm/ADT/Hashing.h"
 #include "llvm/Analysis/BlockFrequencyInfo.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/DebugInfo/Symbolize/Symbolize.h"
@@ -16,8 +18,10 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/LineIterator.h"
@@ -36,7 +40,13 @@ namespace {
 const std::string kTracePcGuardName =
     "__sanitizer_cov_trace_pc_guard";
 const std::string kInvalidFileName("<invalid>");
-Regex kAllTimeCounterRegex("^AllTimeCounter: (0x[0-9a-f]+) ([0-9]+) ([0-9]+)$");
+const char *const kGuardsSectionName = "__sancov_guards";
+const char *const kGuardTableSectionName = "__sancov_guard_table";
+// The size of a record in the guard table; see
+// SanitizerCoverageModule::CreateFunctionGuardTable.
+const size_t kGuardTableRecordSize = 32;
+Regex kAllTimeCounterRegex(
+    "^AllTimeCounter: (0x[0-9a-f]+) ([0-9]+) ([0-9]+)( (0x[0-9a-f]+))?$");
 
 // FIXME: This class is only here to support the transition to llvm::Error. It
 // will be removed once this transition is complete. Clients should prefer to
@@ -90,6 +100,11 @@ static cl::opt<std::string> ModuleName("asap-module-name", cl::init(""),
 static cl::opt<std::string> PCFile("asap-coverage-file", cl::init(""),
     cl::desc("Path to file containing covered program counters"));
 
+static cl::opt<std::string> SymbolizationIndexFile(
+    "asap-symbolization-index", cl::init(""),
+    cl::desc("Path to an index created by asap-symbolize-coverage, to use "
+             "instead of symbolizing program counters"));
+
 bool SanityCheckCoverageCost::runOnFunction(Function &F) {
   DEBUG(dbgs() << "SanityCheckCoverageCost on " << F.getName() << "\n");
   CheckCosts.clear();
@@ -109,7 +124,11 @@ bool SanityCheckCoverageCost::runOnFunction(Function &F) {
       }
   });
 
-  if (!computeTracePCGuardIndexOffset(F)) {
+  // If the coverage file contains check IDs, we use these to find costs.
+  // Otherwise, we need to match guard indices to covered locations.
+  bool UseCheckIDs = !CostsByCheckID.empty();
+  const DenseMap<size_t, uint64_t> &FunctionCostsByIndex = CostsByIndex[&F];
+  if (!UseCheckIDs && !computeTracePCGuardIndexOffset(F)) {
     dbgs() << "Warning: Could not compute trace_pc_guard index offset for function: " << F.getName() << "\n";
     return false;
   }
@@ -121,14 +140,20 @@ bool SanityCheckCoverageCost::runOnFunction(Function &F) {
     // Compute the cost for all `trace_pc_guard` calls from the corresponding
     // CoveredLocation.
     uint64_t Cost = 0;
-    if (isTracePCGuardCall(Inst)) {
+    uint64_t CheckID;
+    if (UseCheckIDs) {
+      if (isTracePCGuardCall(Inst) && getCheckID(Inst, CheckID)) {
+        auto CBI = CostsByCheckID.find(CheckID);
+        if (CBI != CostsByCheckID.end()) {
+          Cost = CBI->second;
+        }
+      }
+    } else if (isTracePCGuardCall(Inst)) {
       CallInst *CI = cast<CallInst>(Inst);
       size_t Index = getTracePCGuardIndex(*CI);
-      auto CoveredLocation = std::find_if(CoveredLocations[&F].begin(), CoveredLocations[&F].end(), [this, Index](std::tuple<llvm::DIInliningInfo, size_t, uint64_t> &CL) {
-          return std::get<1>(CL) == Index + TracePCGuardIndexOffset;
-      });
-      if (CoveredLocation != CoveredLocations[&F].end()) {
-        Cost = std::get<2>(*CoveredLocation);
+      auto CBI = FunctionCostsByIndex.find(Index + TracePCGuardIndexOffset);
+      if (CBI != FunctionCostsByIndex.end()) {
+        Cost = CBI->second;
       }
     }
 
@@ -171,6 +196,30 @@ bool SanityCheckCoverageCost::loadCoverage(const Module &M) {
     return false;
   }
 
+  // Use the symbolization index if we have one, after making sure it belongs
+  // to the binary that produced the coverage.
+  std::unique_ptr<SymbolizationIndex> SymIndex;
+  if (!SymbolizationIndexFile.empty()) {
+    auto IndexOrErr = SymbolizationIndex::open(SymbolizationIndexFile);
+    if (std::error_code EC = IndexOrErr.getError()) {
+      M.getContext().diagnose(DiagnosticInfoSampleProfile(
+          SymbolizationIndexFile,
+          "Could not open symbolization index: " + EC.message()));
+      return false;
+    }
+    SymIndex = std::move(IndexOrErr.get());
+    if (!ModuleName.empty()) {
+      auto BuildIDOrErr = readBuildID(ModuleName);
+      if (!BuildIDOrErr || *BuildIDOrErr != SymIndex->getBuildID()) {
+        M.getContext().diagnose(DiagnosticInfoSampleProfile(
+            SymbolizationIndexFile,
+            "Symbolization index does not match the build ID of " +
+                ModuleName));
+        return false;
+      }
+    }
+  }
+
   symbolize::LLVMSymbolizer::Options SymbolizerOptions(
       symbolize::FunctionNameKind::LinkageName,
       /* UseSymbolTable */ true,
@@ -178,7 +227,13 @@ bool SanityCheckCoverageCost::loadCoverage(const Module &M) {
       /* RelativeAddresses */ false,
       /* DefaultArch */ "");
   symbolize::LLVMSymbolizer Symbolizer(SymbolizerOptions);
+  // With a guard table, guard indices map to check IDs directly.
+  if (!ModuleName.empty()) {
+    loadGuardTable(M);
+  }
+
   std::unique_ptr<MemoryBuffer> Buffer = std::move(BufOrErr.get());
+  size_t NumMissingPCs = 0;
   line_iterator LineIt(*Buffer, /*SkipBlanks=*/true, '#');
   for (; !LineIt.is_at_eof(); ++LineIt) {
     SmallVector<StringRef, 4> Matches;
@@ -202,14 +257,43 @@ bool SanityCheckCoverageCost::loadCoverage(const Module &M) {
         return false;
       }
 
-      auto ResOrErr = Symbolizer.symbolizeInlinedCode(ModuleName, Offset);
-      if (!ResOrErr) {
-        M.getContext().diagnose(DiagnosticInfoSampleProfile(
-            PCFile, LineIt.line_number(), "Could not symbolize PC: " + *LineIt));
-        return false;
+      // Lines with a check ID need no symbolization; the ID identifies the
+      // `trace_pc_guard` call.
+      if (!Matches[5].empty()) {
+        uint64_t CheckID;
+        if (Matches[5].getAsInteger(0, CheckID)) {
+          M.getContext().diagnose(DiagnosticInfoSampleProfile(
+              PCFile, LineIt.line_number(), "Could not parse ID: " + *LineIt));
+          return false;
+        }
+        CostsByCheckID[CheckID] += Cost;
+        continue;
+      }
+      if (Index > 0 && Index <= CheckIDsByGuard.size()) {
+        CostsByCheckID[CheckIDsByGuard[Index - 1]] += Cost;
+        continue;
+      }
+
+      DIInliningInfo Res;
+      bool Found = SymIndex && SymIndex->lookup(Offset, Res);
+      if (SymIndex && !Found) {
+        // The index was built from other coverage logs. Symbolize the PC if
+        // we have the binary, and skip it otherwise.
+        NumMissingPCs += 1;
+      }
+      if (!Found) {
+        if (ModuleName.empty()) {
+          continue;
+        }
+        auto ResOrErr = Symbolizer.symbolizeInlinedCode(ModuleName, Offset);
+        if (!ResOrErr) {
+          M.getContext().diagnose(DiagnosticInfoSampleProfile(
+              PCFile, LineIt.line_number(), "Could not symbolize PC: " + *LineIt));
+          return false;
+        }
+        Res = ResOrErr.get();
       }
 
-      auto Res = ResOrErr.get();
       if (Res.getNumberOfFrames() && Res.getFrame(0).FileName != kInvalidFileName) {
         Function *F = M.getFunction(Res.getFrame(Res.getNumberOfFrames() - 1).FunctionName);
         if (F) {
@@ -219,11 +303,32 @@ bool SanityCheckCoverageCost::loadCoverage(const Module &M) {
     }
   }
 
+  if (NumMissingPCs) {
+    M.getContext().diagnose(DiagnosticInfoSampleProfile(
+        SymbolizationIndexFile,
+        Twine(NumMissingPCs) + " PCs are not in the symbolization index; " +
+            (ModuleName.empty() ? std::string("their costs are ignored")
+                                : "symbolized them using " + ModuleName),
+        DS_Warning));
+  }
+
+  // Index the covered locations, so that we can look up costs by index and
+  // candidate locations by their lines.
+  for (auto &FCL: CoveredLocations) {
+    DenseMap<size_t, uint64_t> &FunctionCostsByIndex = CostsByIndex[FCL.first];
+    auto &FunctionLocationsByKey = LocationsByKey[FCL.first];
+    for (size_t i = 0, e = FCL.second.size(); i < e; ++i) {
+      auto &CL = FCL.second[i];
+      FunctionCostsByIndex[std::get<1>(CL)] = std::get<2>(CL);
+      FunctionLocationsByKey[getLocationKey(std::get<0>(CL))].push_back(i);
+    }
+  }
+
   // Compute the minimum and maximum offset for each function.
   // We go through indices in order. Whenever the function changes, we adjust
   // the bounds of the last and current function.
   std::map<size_t, Function *> FunctionsByOffset;
-  for (auto FCL: CoveredLocations) {
+  for (auto &FCL: CoveredLocations) {
     for (auto &CL: FCL.second) {
       FunctionsByOffset[std::get<1>(CL)] = FCL.first;
     }
@@ -251,6 +356,47 @@ bool SanityCheckCoverageCost::loadCoverage(const Module &M) {
   return true;
 }
 
+bool SanityCheckCoverageCost::loadGuardTable(const Module &M) {
+  auto ObjOrErr = object::ObjectFile::createObjectFile(ModuleName);
+  if (!ObjOrErr) {
+    consumeError(ObjOrErr.takeError());
+    return false;
+  }
+  object::ObjectFile *Obj = ObjOrErr->getBinary();
+
+  StringRef Table;
+  uint64_t NumGuards = 0;
+  for (const object::SectionRef &Section : Obj->sections()) {
+    StringRef Name;
+    if (Section.getName(Name)) continue;
+    if (Name == kGuardsSectionName) {
+      NumGuards = Section.getSize() / sizeof(uint32_t);
+    } else if (Name == kGuardTableSectionName) {
+      if (Section.getContents(Table)) return false;
+    }
+  }
+  if (Table.empty()) return false;
+
+  // The table is only usable if it covers every guard; libFuzzer numbers the
+  // guards in section order, starting at 1.
+  if (Table.size() % kGuardTableRecordSize ||
+      Table.size() / kGuardTableRecordSize != NumGuards) {
+    M.getContext().diagnose(DiagnosticInfoSampleProfile(
+        ModuleName, "Guard table does not match the guards; ignoring it",
+        DS_Warning));
+    return false;
+  }
+  CheckIDsByGuard.reserve(NumGuards);
+  for (size_t i = 0; i < NumGuards; ++i) {
+    const char *Record = Table.data() + i * kGuardTableRecordSize;
+    CheckIDsByGuard.push_back(Obj->isLittleEndian()
+                                  ? support::endian::read64le(Record)
+                                  : support::endian::read64be(Record));
+  }
+  DEBUG(dbgs() << "Loaded guard table with " << NumGuards << " guards\n");
+  return true;
+}
+
 bool SanityCheckCoverageCost::computeTracePCGuardIndexOffset(Function &F) {
   // computeTracePCGuardIndexOffset tries to compute the range of
   // CoveredLocations that corresponds to `trace_pc_guard` calls in F. This is
@@ -278,6 +424,12 @@ bool SanityCheckCoverageCost::computeTracePCGuardIndexOffset(Function &F) {
     return false;
   }
 
+  // For each call, we only examine the covered locations that have the same
+  // lines and inlining depth, which are the only ones that can match.
+  const auto &FunctionLocations = CoveredLocations[&F];
+  const auto &FunctionLocationsByKey = LocationsByKey[&F];
+  const std::pair<size_t, size_t> &OffsetRange = OffsetRanges[&F];
+
   std::map<size_t, size_t> Offsets;
   size_t NumTracePCGuardCalls = 0;
   for (Instruction &I : instructions(&F)) {
@@ -290,12 +442,15 @@ bool SanityCheckCoverageCost::computeTracePCGuardIndexOffset(Function &F) {
     size_t Index = getTracePCGuardIndex(*CI);
     NumTracePCGuardCalls += 1;
 
-    for (auto CL: CoveredLocations[&F]) {
-      DIInliningInfo &DIII = std::get<0>(CL);
+    auto Candidates = FunctionLocationsByKey.find(getLocationKey(*DIL));
+    if (Candidates == FunctionLocationsByKey.end()) continue;
+    for (size_t CandidateIndex : Candidates->second) {
+      auto &CL = FunctionLocations[CandidateIndex];
+      const DIInliningInfo &DIII = std::get<0>(CL);
       size_t CLIndex = std::get<1>(CL);
       if (/**/ CLIndex > Index
-            && CLIndex - Index >= OffsetRanges[&F].first
-            && CLIndex - Index < OffsetRanges[&F].second) {
+            && CLIndex - Index >= OffsetRange.first
+            && CLIndex - Index < OffsetRange.second) {
         if (locationsMatch(*DIL, DIII)) {
           DEBUG(dbgs() << "  match: " << F.getName() << " " << Index << " " << CLIndex << "\n");
           Offsets[CLIndex - Index] += 1;
@@ -362,6 +517,42 @@ size_t SanityCheckCoverageCost::getTracePCGuardIndex(CallInst &I) {
   }
 }
 
+bool SanityCheckCoverageCost::getCheckID(Instruction *I, uint64_t &CheckID) {
+  MDNode *MD = I->getMetadata("checkid");
+  if (!MD) return false;
+  ConstantAsMetadata *IDMD = cast<ConstantAsMetadata>(MD->getOperand(0));
+  CheckID = cast<ConstantInt>(IDMD->getValue())->getZExtValue();
+  return true;
+}
+
+// The key is a hash of the line numbers of all inlining frames, and the
+// inlining depth. These are the parts of a location that locationsMatch always
+// compares. We drop the hash's top bit, so that it never collides with
+// DenseMap's reserved keys.
+template <class LinesT>
+static size_t hashLocationLines(const LinesT &Lines) {
+  return (size_t)hash_combine(
+             hash_combine_range(Lines.begin(), Lines.end()), Lines.size()) >>
+         1;
+}
+
+size_t SanityCheckCoverageCost::getLocationKey(const DILocation &DIL) {
+  SmallVector<unsigned, 8> Lines;
+  for (const DILocation *LocFrame = &DIL; LocFrame;
+       LocFrame = LocFrame->getInlinedAt()) {
+    Lines.push_back(LocFrame->getLine());
+  }
+  return hashLocationLines(Lines);
+}
+
+size_t SanityCheckCoverageCost::getLocationKey(const DIInliningInfo &DIII) {
+  SmallVector<unsigned, 8> Lines;
+  for (uint32_t i = 0, e = DIII.getNumberOfFrames(); i < e; ++i) {
+    Lines.push_back(DIII.getFrame(i).Line);
+  }
+  return hashLocationLines(Lines);
+}
+
 bool SanityCheckCoverageCost::locationsMatch(const DILocation &DIL, const DIInliningInfo &DIII) {
   const DILocation *LocFrame = &DIL;
   for (uint32_t i = 0, e = DIII.getNumberOfFrames(); i < e; ++i) {
@@ -29,13 +29,6 @@ static cl::opt<std::string> InputGCNO("gcno", cl::desc("<input gcno file>"),
 static cl::opt<std::string> InputGCDA("gcda", cl::desc("<input gcda file>"),
                                       cl::init(""), cl::Hidden);
 
-namespace {
-bool largerCost(const SanityCheckCost::CheckCost &a,
-                const SanityCheckCost::CheckCost &b) {
-  return a.second > b.second;
-}
-} // anonymous namespace
-
 bool SanityCheckGcovCost::doInitialization(Module &M) {
   GF = createGCOVFile();
   return false;
@@ -43,7 +36,6 @@ bool SanityCheckGcovCost::doInitialization(Module &M) {
 
 bool SanityCheckGcovCost::runOnFunction(Function &F) {
   DEBUG(dbgs() << "SanityCheckGcovCost on " << F.getName() << "\n");
-  CheckCosts.clear();
 
   TargetTransformInfoWrapperPass &TTIWP =
       getAnalysis<TargetTransformInfoWrapperPass>();
@@ -51,56 +43,37 @@ bool SanityCheckGcovCost::runOnFunction(Function &F) {
   const TargetTransformInfo &TTI = TTIWP.getTTI(F);
   SanityCheckInstructions &SCI = getAnalysis<SanityCheckInstructions>();
 
-  for (Instruction *Inst : SCI.getSanityCheckRoots()) {
-    assert(Inst->getParent()->getParent() == &F &&
-           "SCI must only contain instructions of the current function.");
-
-#ifndef NDEBUG
-    int nInstructions = 0;
-    int nFreeInstructions = 0;
-    uint64_t maxCount = 0;
-#endif
-
-    // The cost of a check is the sum of the cost of all instructions
-    // that this check uses.
-    // TODO: If an instruction is used by multiple checks, we need an
-    // intelligent way to handle the nonlinearity.
-    uint64_t Cost = 0;
-    for (Instruction *CI : SCI.getInstructionsBySanityCheck(Inst)) {
-      unsigned CurrentCost = sanitychecks::getInstructionCost(CI, &TTI);
-
-      // Assume a default cost of 1 for unknown instructions
-      if (CurrentCost == (unsigned)(-1)) {
-        CurrentCost = 1;
+  // Look up the counts for all blocks at once, rather than for every
+  // instruction.
+  DenseMap<const BasicBlock *, uint64_t> BlockCounts;
+  GF->getBlockCounts(F, BlockCounts);
+
+  sanitychecks::SchedCostModel SchedCosts(F, SCI);
+  auto ExecutionCount = [&](Instruction *I) {
+    return (double)BlockCounts.lookup(I->getParent());
+  };
+
+  // The cost of a check is the sum of the cost of all instructions that this
+  // check uses. computeCheckCosts handles instructions used by several checks.
+  computeCheckCosts(F, SCI, [&](Instruction *CI) {
+    unsigned CurrentCost;
+    bool Calibrated = sanitychecks::getCalibratedCost(CI, CurrentCost);
+    if (!Calibrated) {
+      if (SchedCosts.isEnabled()) {
+        return SchedCosts.getCost(CI) * ExecutionCount(CI);
       }
+      CurrentCost = sanitychecks::getInstructionCost(CI, &TTI);
+    }
 
-      DEBUG(if (CurrentCost == 0) { nFreeInstructions += 1; });
-
-      assert(CurrentCost <= 100 && "Outlier cost value?");
-
-      Cost += CurrentCost * GF->getCount(CI);
-      DEBUG(nInstructions += 1);
-      DEBUG(
-          if (GF->getCount(CI) > maxCount) { maxCount = GF->getCount(CI); });
+    // Assume a default cost of 1 for unknown instructions
+    if (CurrentCost == (unsigned)(-1)) {
+      CurrentCost = 1;
     }
 
-    APInt CountInt = APInt(64, Cost);
-    MDNode *MD = MDNode::get(
-        F.getContext(), {ConstantAsMetadata::get(ConstantInt::get(
-                            Type::getInt64Ty(F.getContext()), CountInt))});
-    Inst->setMetadata("cost", MD);
-    CheckCosts.push_back(std::make_pair(Inst, Cost));
-
-    DEBUG(dbgs() << "Sanity check: " << *Inst << "\n";
-          DebugLoc DL = getInstrumentationDebugLoc(Inst);
-          printDebugLoc(DL, F.getContext(), dbgs());
-          dbgs() << "\nnInstructions: " << nInstructions << "\n";
-          dbgs() << "nFreeInstructions: " << nFreeInstructions << "\n";
-          dbgs() << "maxCount: " << maxCount << "\n";
-          dbgs() << "Cost: " << Cost << "\n";);
-  }
+    assert((Calibrated || CurrentCost <= 100) && "Outlier cost value?");
 
-  std::sort(CheckCosts.begin(), CheckCosts.end(), largerCost);
+    return CurrentCost * ExecutionCount(CI);
+  }, ExecutionCount);
 
   return false;
 }
@@ -0,0 +1,99 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+
+#include "llvm/Transforms/SanityChecks/SanityCheckInstrProfCost.h"
+#include "llvm/Transforms/SanityChecks/SanityCheckInstructions.h"
+#include "llvm/Transforms/SanityChecks/CostModel.h"
+#include "llvm/Transforms/SanityChecks/utils.h"
+
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/Format.h"
+
+#define DEBUG_TYPE "sanity-check-cost"
+
+using namespace llvm;
+
+bool SanityCheckInstrProfCost::runOnFunction(Function &F) {
+  DEBUG(dbgs() << "SanityCheckInstrProfCost on " << F.getName() << "\n");
+
+  TargetTransformInfoWrapperPass &TTIWP =
+      getAnalysis<TargetTransformInfoWrapperPass>();
+
+  const TargetTransformInfo &TTI = TTIWP.getTTI(F);
+  SanityCheckInstructions &SCI = getAnalysis<SanityCheckInstructions>();
+  BlockFrequencyInfo &BFI = getAnalysis<BlockFrequencyInfoWrapperPass>().getBFI();
+
+  if (!F.getEntryCount().hasValue()) {
+    DEBUG(dbgs() << "Warning: no profile for function " << F.getName()
+                 << "; did you compile with -fprofile-use?\n");
+  }
+
+  sanitychecks::SchedCostModel SchedCosts(F, SCI);
+  auto ExecutionCount = [&](Instruction *I) {
+    return (double)getExecutionCount(I, BFI);
+  };
+
+  // The cost of a check is the sum of the cost of all instructions that this
+  // check uses. computeCheckCosts handles instructions used by several checks.
+  computeCheckCosts(F, SCI, [&](Instruction *CI) {
+    unsigned CurrentCost;
+    bool Calibrated = sanitychecks::getCalibratedCost(CI, CurrentCost);
+    if (!Calibrated) {
+      if (SchedCosts.isEnabled()) {
+        return SchedCosts.getCost(CI) * ExecutionCount(CI);
+      }
+      CurrentCost = sanitychecks::getInstructionCost(CI, &TTI);
+    }
+
+    // Assume a default cost of 1 for unknown instructions
+    if (CurrentCost == (unsigned)(-1)) {
+      CurrentCost = 1;
+    }
+
+    assert((Calibrated || CurrentCost <= 100) && "Outlier cost value?");
+
+    return CurrentCost * ExecutionCount(CI);
+  }, ExecutionCount);
+
+  return false;
+}
+
+void SanityCheckInstrProfCost::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<BlockFrequencyInfoWrapperPass>();
+  AU.addRequired<TargetTransformInfoWrapperPass>();
+  AU.addRequired<SanityCheckInstructions>();
+  AU.setPreservesAll();
+}
+
+void SanityCheckInstrProfCost::print(raw_ostream &O, const Module *M) const {
+  O << "                Cost Location\n";
+  for (const CheckCost &I : CheckCosts) {
+    O << format("%20llu ", I.second);
+    DebugLoc DL = getInstrumentationDebugLoc(I.first);
+    printDebugLoc(DL, M->getContext(), O);
+    O << '\n';
+  }
+}
+
+uint64_t SanityCheckInstrProfCost::getExecutionCount(const Instruction *I, const BlockFrequencyInfo &BFI) const {
+  // Unlike sampled profiles, instrumentation profiles contain every function
+  // that was compiled into the profiling build, so a function without an
+  // entry count has either never run or changed since. Either way, we have
+  // no reason to consider its checks expensive.
+  Optional<uint64_t> Count = BFI.getBlockProfileCount(I->getParent());
+  return Count.hasValue() ? Count.getValue() : 0;
+}
+
+char SanityCheckInstrProfCost::ID = 0;
+INITIALIZE_PASS_BEGIN(SanityCheckInstrProfCost, "sanity-check-instrprof-cost",
+                      "Finds costs of sanity checks", false, false)
+INITIALIZE_PASS_DEPENDENCY(BlockFrequencyInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(TargetTransformInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_END(SanityCheckInstrProfCost, "sanity-check-instrprof-cost",
+                    "Finds costs of sanity checks", false, false)
@@ -6,11 +6,16 @@
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Pass.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/IR/Module.h"
 
 #include <algorithm>
@@ -26,16 +31,81 @@ bool SanityCheckInstructions::runOnFunction(Function &F) {
   SCInstructions.clear();
   SCRoots.clear();
   InstructionsBySanityCheck.clear();
+  CheckIDs.clear();
   findInstructions(&F);
+  computeCheckIDs(&F);
+
+  // Instructions shared by several checks are attributed to the first one.
+  DenseMap<Instruction *, MDNode *> MDs;
+  Type *Int64Ty = Type::getInt64Ty(F.getContext());
+  for (Instruction &I : instructions(F)) {
+    auto IBSC = InstructionsBySanityCheck.find(&I);
+    if (IBSC == InstructionsBySanityCheck.end()) {
+      continue;
+    }
+    MDNode *MD = MDNode::get(F.getContext(),
+                             ConstantAsMetadata::get(ConstantInt::get(
+                                 Int64Ty, CheckIDs.lookup(&I))));
+    for (Instruction *Inst : IBSC->second) {
+      MDs.insert(std::make_pair(Inst, MD));
+    }
+  }
 
-  MDNode *MD = MDNode::get(F.getContext(), {});
+  MDNode *EmptyMD = MDNode::get(F.getContext(), {});
   for (Instruction *Inst : SCInstructions) {
-    Inst->setMetadata("sanitycheck", MD);
+    MDNode *MD = MDs.lookup(Inst);
+    Inst->setMetadata("sanitycheck", MD ? MD : EmptyMD);
   }
 
   return !SCInstructions.empty();
 }
 
+void SanityCheckInstructions::computeCheckIDs(Function *F) {
+  // Checks from SanitizerCoverage already have an ID. For all others, derive
+  // one from the function, the kind of check, its location and its ordinal
+  // among checks with the same location, like SanitizerCoverage does.
+  DenseMap<uint64_t, unsigned> Ordinals;
+  for (Instruction &I : instructions(*F)) {
+    if (!SCRoots.count(&I)) {
+      continue;
+    }
+    if (MDNode *MD = I.getMetadata("checkid")) {
+      CheckIDs[&I] =
+          mdconst::extract<ConstantInt>(MD->getOperand(0))->getZExtValue();
+      continue;
+    }
+
+    std::string Key;
+    raw_string_ostream OS(Key);
+    OS << F->getGUID() << ':';
+    if (auto *CI = dyn_cast<CallInst>(&I)) {
+      if (Function *Callee = CI->getCalledFunction()) {
+        OS << Callee->getName();
+      }
+    }
+    for (const DILocation *DIL = I.getDebugLoc(); DIL;
+         DIL = DIL->getInlinedAt()) {
+      OS << ':';
+      if (DISubprogram *SP = DIL->getScope()->getSubprogram()) {
+        OS << (SP->getLinkageName().empty() ? SP->getName()
+                                            : SP->getLinkageName());
+      }
+      OS << ':' << DIL->getLine() << ':' << DIL->getColumn() << ':'
+         << DIL->getDiscriminator();
+    }
+    unsigned Ordinal = Ordinals[MD5Hash(OS.str())]++;
+    OS << ':' << Ordinal;
+    CheckIDs[&I] = MD5Hash(OS.str());
+  }
+}
+
+bool SanityCheckInstructions::isInputDependent(const Instruction *Root) {
+  if (MDNode *MD = Root->getMetadata("inputdependent")) {
+    return !mdconst::extract<ConstantInt>(MD->getOperand(0))->isZero();
+  }
+  return true;
+}
+
 void SanityCheckInstructions::findInstructions(Function *F) {
   if (F->empty()) {
     return;
@@ -27,13 +27,8 @@
 using namespace llvm;
 
 namespace {
-bool largerCost(const SanityCheckCost::CheckCost &a,
-                const SanityCheckCost::CheckCost &b) {
-  return a.second > b.second;
-}
-
 // How many cycles we assume an instrumentation function to take. Not much more
-// than a gross estimate.
+// than a gross estimate; -asap-cost-table overrides these.
 std::map<std::string, uint64_t> KNOWN_FUNCTION_COSTS = {
   {"__sanitizer_cov", 20},
   {"__sanitizer_cov_with_check", 20},
@@ -45,7 +40,6 @@ std::map<std::string, uint64_t> KNOWN_FUNCTION_COSTS = {
 
 bool SanityCheckSampledCost::runOnFunction(Function &F) {
   DEBUG(dbgs() << "SanityCheckSampledCost on " << F.getName() << "\n");
-  CheckCosts.clear();
 
   TargetTransformInfoWrapperPass &TTIWP =
       getAnalysis<TargetTransformInfoWrapperPass>();
@@ -54,70 +48,49 @@ bool SanityCheckSampledCost::runOnFunction(Function &F) {
   SanityCheckInstructions &SCI = getAnalysis<SanityCheckInstructions>();
   BlockFrequencyInfo &BFI = getAnalysis<BlockFrequencyInfoWrapperPass>().getBFI();
 
-  for (Instruction *Inst : SCI.getSanityCheckRoots()) {
-    assert(Inst->getParent()->getParent() == &F &&
-           "SCI must only contain instructions of the current function.");
-
-#ifndef NDEBUG
-    int nInstructions = 0;
-    int nFreeInstructions = 0;
-    double maxCount = 0;
-#endif
-
-    // The cost of a check is the sum of the cost of all instructions
-    // that this check uses.
-    // TODO: If an instruction is used by multiple checks, we need an
-    // intelligent way to handle the nonlinearity.
-    double Cost = 0;
-    for (Instruction *CI : SCI.getInstructionsBySanityCheck(Inst)) {
-      unsigned CurrentCost = sanitychecks::getInstructionCost(CI, &TTI);
-
-      // Use known costs for calls to known instrumentation functions
-      if (auto CallI = dyn_cast<CallInst>(CI)) {
-        auto CalledFunction = CallI->getCalledFunction();
-        StringRef Name = CalledFunction && CalledFunction->hasName() ?
-          CalledFunction->getName() : "";
-        auto CostIt = KNOWN_FUNCTION_COSTS.find(Name);
-        if (CostIt != KNOWN_FUNCTION_COSTS.end()) {
-          CurrentCost = CostIt->second;
-          DEBUG(dbgs() << "Using default cost " << CurrentCost << " for call to \"" << Name << "\"\n");
-        } else {
-          DEBUG(dbgs() << "Missing default cost for call to \"" << Name << "\"\n");
-        }
+  sanitychecks::SchedCostModel SchedCosts(F, SCI);
+  auto ExecutionCount = [&](Instruction *I) {
+    return getExecutionCount(I, BFI);
+  };
+
+  // The cost of a check is the sum of the cost of all instructions that this
+  // check uses. computeCheckCosts handles instructions used by several checks.
+  computeCheckCosts(F, SCI, [&](Instruction *CI) {
+    unsigned CurrentCost;
+    bool Calibrated = sanitychecks::getCalibratedCost(CI, CurrentCost);
+    bool Known = false;
+
+    // Use known costs for calls to known instrumentation functions
+    if (auto CallI = Calibrated ? nullptr : dyn_cast<CallInst>(CI)) {
+      auto CalledFunction = CallI->getCalledFunction();
+      StringRef Name = CalledFunction && CalledFunction->hasName() ?
+        CalledFunction->getName() : "";
+      auto CostIt = KNOWN_FUNCTION_COSTS.find(Name);
+      if (CostIt != KNOWN_FUNCTION_COSTS.end()) {
+        CurrentCost = CostIt->second;
+        Known = true;
+        DEBUG(dbgs() << "Using default cost " << CurrentCost << " for call to \"" << Name << "\"\n");
+      } else {
+        DEBUG(dbgs() << "Missing default cost for call to \"" << Name << "\"\n");
       }
+    }
 
-      // Assume a default cost of 1 for unknown instructions
-      if (CurrentCost == (unsigned)(-1)) {
-        CurrentCost = 1;
+    if (!Calibrated && !Known) {
+      if (SchedCosts.isEnabled()) {
+        return SchedCosts.getCost(CI) * ExecutionCount(CI);
       }
+      CurrentCost = sanitychecks::getInstructionCost(CI, &TTI);
+    }
 
-      DEBUG(if (CurrentCost == 0) { nFreeInstructions += 1; });
-
-      assert(CurrentCost <= 100 && "Outlier cost value?");
-
-      Cost += CurrentCost * getExecutionCount(CI, BFI);
-      DEBUG(nInstructions += 1);
-      DEBUG(
-          if (getExecutionCount(CI, BFI) > maxCount) { maxCount = getExecutionCount(CI, BFI); });
+    // Assume a default cost of 1 for unknown instructions
+    if (CurrentCost == (unsigned)(-1)) {
+      CurrentCost = 1;
     }
 
-    APInt CountInt = APInt(64, (uint64_t)Cost);
-    MDNode *MD = MDNode::get(
-        F.getContext(), {ConstantAsMetadata::get(ConstantInt::get(
-                            Type::getInt64Ty(F.getContext()), CountInt))});
-    Inst->setMetadata("cost", MD);
-    CheckCosts.push_back(std::make_pair(Inst, (uint64_t)Cost));
-
-    DEBUG(dbgs() << "Sanity check: " << *Inst << "\n";
-          DebugLoc DL = getInstrumentationDebugLoc(Inst);
-          printDebugLoc(DL, F.getContext(), dbgs());
-          dbgs() << "\nnInstructions: " << nInstructions << "\n";
-          dbgs() << "nFreeInstructions: " << nFreeInstructions << "\n";
-          dbgs() << "maxCount: " << maxCount << "\n";
-          dbgs() << "Cost: " << Cost << "\n";);
-  }
+    assert((Calibrated || CurrentCost <= 100) && "Outlier cost value?");
 
-  std::sort(CheckCosts.begin(), CheckCosts.end(), largerCost);
+    return CurrentCost * ExecutionCount(CI);
+  }, ExecutionCount);
 
   return false;
 }
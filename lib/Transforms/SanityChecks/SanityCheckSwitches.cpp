@@ -0,0 +1,141 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+//
+// Makes every sanity check switchable at runtime. Each check is guarded by a
+// byte in a writable table; the check runs only while its byte is non-zero.
+// Tools can thus disable expensive checks in a running program, instead of
+// rebuilding it at each cost level.
+//
+// Each function gets a table of switches in the __asap_check_switches
+// section, initialized to 1, and a table of the corresponding check IDs (see
+// SanityCheckInstructions::getCheckID) in the __asap_check_switch_ids
+// section. The linker concatenates these, so that the i-th switch in the
+// program belongs to the i-th ID. Checks whose shape does not allow guarding
+// them get the ID zero, and always run.
+//
+// Switches are bytes rather than bits, so that the guard is a single compare
+// with memory, and so that the tables of different functions can be
+// concatenated without padding.
+
+#include "llvm/Transforms/SanityChecks/AsapPassBase.h"
+#include "llvm/Transforms/SanityChecks/SanityCheckInstructions.h"
+#include "llvm/Transforms/SanityChecks/utils.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <vector>
+#define DEBUG_TYPE "sanity-check-switches"
+
+using namespace llvm;
+
+STATISTIC(NumSwitches, "Number of sanity checks that can be switched off");
+
+static const char *const SwitchesSection = "__asap_check_switches";
+static const char *const SwitchIDsSection = "__asap_check_switch_ids";
+
+namespace {
+struct SanityCheckSwitches : public ModulePass, public AsapPassBase {
+  static char ID;
+
+  SanityCheckSwitches() : ModulePass(ID) {
+    initializeSanityCheckSwitchesPass(*PassRegistry::getPassRegistry());
+  }
+
+  virtual bool runOnModule(Module &M) override;
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<SanityCheckInstructions>();
+  }
+
+private:
+  // Guards the checks in F by switches; returns true if it guarded any.
+  bool addSwitches(Function &F);
+};
+} // anonymous namespace
+
+bool SanityCheckSwitches::runOnModule(Module &M) {
+  bool Changed = false;
+  for (Function &F : M) {
+    if (!F.isDeclaration()) {
+      Changed |= addSwitches(F);
+    }
+  }
+  return Changed;
+}
+
+bool SanityCheckSwitches::addSwitches(Function &F) {
+  SCI = &getAnalysis<SanityCheckInstructions>(F);
+
+  // Coverage is not a check; it must keep running for the fuzzer.
+  std::vector<Instruction *> Checks;
+  for (Instruction &I : instructions(F)) {
+    if (SCI->getSanityCheckRoots().count(&I) && !isSanitizerCoverage(&I)) {
+      Checks.push_back(&I);
+    }
+  }
+  if (Checks.empty()) {
+    SCI = nullptr;
+    return false;
+  }
+
+  Module *M = F.getParent();
+  LLVMContext &Ctx = M->getContext();
+  IntegerType *Int8Ty = Type::getInt8Ty(Ctx);
+  ArrayType *SwitchesTy = ArrayType::get(Int8Ty, Checks.size());
+  GlobalVariable *Switches = new GlobalVariable(
+      *M, SwitchesTy, false, GlobalValue::PrivateLinkage,
+      ConstantDataArray::get(Ctx, std::vector<uint8_t>(Checks.size(), 1)),
+      "__asap_check_switches");
+  Switches->setSection(SwitchesSection);
+  Switches->setComdat(F.getComdat());
+
+  SmallVector<uint64_t, 32> IDs(Checks.size(), 0);
+  for (size_t i = 0; i < Checks.size(); ++i) {
+    auto MakeCondition = [&](Instruction *InsertBefore) -> Value * {
+      IRBuilder<> IRB(InsertBefore);
+      Value *Switch = IRB.CreateConstInBoundsGEP2_64(Switches, 0, i);
+      return IRB.CreateICmpNE(IRB.CreateLoad(Switch),
+                              ConstantInt::get(Int8Ty, 0));
+    };
+    // Get the ID first, because guarding changes the check.
+    uint64_t CheckID = SCI->getCheckID(Checks[i]);
+    if (guardCheck(Checks[i], MakeCondition, nullptr)) {
+      IDs[i] = CheckID;
+      NumSwitches += 1;
+    } else {
+      DEBUG(dbgs() << "SanityCheckSwitches: cannot guard check at ";
+            printDebugLoc(getInstrumentationDebugLoc(Checks[i]), Ctx, dbgs());
+            dbgs() << "\n");
+    }
+  }
+
+  Constant *IDsInit = ConstantDataArray::get(Ctx, IDs);
+  GlobalVariable *SwitchIDs = new GlobalVariable(
+      *M, IDsInit->getType(), true, GlobalValue::PrivateLinkage, IDsInit,
+      "__asap_check_switch_ids");
+  SwitchIDs->setSection(SwitchIDsSection);
+  SwitchIDs->setComdat(F.getComdat());
+  SwitchIDs->setAlignment(8);
+  appendToUsed(*M, {Switches, SwitchIDs});
+
+  SCI = nullptr;
+  return true;
+}
+
+char SanityCheckSwitches::ID = 0;
+INITIALIZE_PASS_BEGIN(SanityCheckSwitches, "sanity-check-switches",
+                      "Makes sanity checks switchable at runtime", false,
+                      false)
+INITIALIZE_PASS_DEPENDENCY(SanityCheckInstructions)
+INITIALIZE_PASS_END(SanityCheckSwitches, "sanity-check-switches",
+                    "Makes sanity checks switchable at runtime", false, false)
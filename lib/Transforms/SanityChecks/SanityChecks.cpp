@@ -10,9 +10,21 @@ void llvm::initializeSanityChecks(PassRegistry &Registry) {
   initializeAsapPassPass(Registry);
   initializeAsapCoveragePassPass(Registry);
   initializeAsapGcovPassPass(Registry);
+  initializeAsapInstrProfPassPass(Registry);
+  initializeAsapModulePassPass(Registry);
+  initializeAsapCoverageModulePassPass(Registry);
+  initializeAsapGcovModulePassPass(Registry);
+  initializeAsapInstrProfModulePassPass(Registry);
+  initializeAsapCloneHotCallSitesPass(Registry);
+  initializeAsapInputDependencePass(Registry);
+  initializeAsapMultiversionPass(Registry);
+  initializeAsapRemoveSafeChecksPass(Registry);
   initializeExitInsteadOfAbortPass(Registry);
+  initializeSanityCheckColdPathsPass(Registry);
   initializeSanityCheckGcovCostPass(Registry);
   initializeSanityCheckCoverageCostPass(Registry);
+  initializeSanityCheckInstrProfCostPass(Registry);
   initializeSanityCheckInstructionsPass(Registry);
   initializeSanityCheckSampledCostPass(Registry);
+  initializeSanityCheckSwitchesPass(Registry);
 }
@@ -0,0 +1,242 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+
+#include "llvm/Transforms/SanityChecks/SymbolizationIndex.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace llvm;
+using namespace llvm::support;
+
+namespace {
+const char kMagic[8] = {'A', 'S', 'A', 'P', 'S', 'Y', 'M', 'X'};
+const uint32_t kVersion = 1;
+const uint32_t kNTGNUBuildID = 3;
+
+uint64_t alignTo8(uint64_t Size) { return (Size + 7) & ~7ULL; }
+} // anonymous namespace
+
+struct SymbolizationIndex::Header {
+  char Magic[8];
+  ulittle32_t Version;
+  ulittle32_t BuildIDSize;
+  ulittle64_t NumEntries;
+  ulittle64_t NumFrames;
+  ulittle64_t StringTableSize;
+};
+
+struct SymbolizationIndex::Entry {
+  ulittle64_t PC;
+  ulittle32_t FirstFrame;
+  ulittle32_t NumFrames;
+};
+
+struct SymbolizationIndex::Frame {
+  ulittle32_t FunctionName;
+  ulittle32_t FileName;
+  ulittle32_t Line;
+  ulittle32_t Column;
+  ulittle32_t Discriminator;
+  ulittle32_t Padding;
+};
+
+std::error_code SymbolizationIndex::write(
+    StringRef Path, StringRef BuildID,
+    std::vector<std::pair<uint64_t, DIInliningInfo>> Entries) {
+  std::sort(Entries.begin(), Entries.end(),
+            [](const std::pair<uint64_t, DIInliningInfo> &a,
+               const std::pair<uint64_t, DIInliningInfo> &b) {
+              return a.first < b.first;
+            });
+
+  // Build the tables. Strings are stored once, and referenced by offset.
+  std::vector<Entry> EntryTable;
+  std::vector<Frame> FrameTable;
+  std::string StringTable;
+  StringMap<uint32_t> StringOffsets;
+  auto AddString = [&](const std::string &S) -> uint32_t {
+    auto Inserted = StringOffsets.insert(
+        std::make_pair(S, (uint32_t)StringTable.size()));
+    if (Inserted.second) {
+      StringTable.append(S);
+      StringTable.push_back('\0');
+    }
+    return Inserted.first->second;
+  };
+  for (auto &PCAndInfo : Entries) {
+    Entry E;
+    E.PC = PCAndInfo.first;
+    E.FirstFrame = FrameTable.size();
+    E.NumFrames = PCAndInfo.second.getNumberOfFrames();
+    for (uint32_t i = 0, e = PCAndInfo.second.getNumberOfFrames(); i < e; ++i) {
+      const DILineInfo &LineInfo = PCAndInfo.second.getFrame(i);
+      Frame F;
+      F.FunctionName = AddString(LineInfo.FunctionName);
+      F.FileName = AddString(LineInfo.FileName);
+      F.Line = LineInfo.Line;
+      F.Column = LineInfo.Column;
+      F.Discriminator = LineInfo.Discriminator;
+      F.Padding = 0;
+      FrameTable.push_back(F);
+    }
+    EntryTable.push_back(E);
+  }
+
+  Header H;
+  memcpy(H.Magic, kMagic, sizeof(kMagic));
+  H.Version = kVersion;
+  H.BuildIDSize = BuildID.size();
+  H.NumEntries = EntryTable.size();
+  H.NumFrames = FrameTable.size();
+  H.StringTableSize = StringTable.size();
+
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC, sys::fs::F_None);
+  if (EC) {
+    return EC;
+  }
+  OS.write(reinterpret_cast<const char *>(&H), sizeof(H));
+  OS << BuildID;
+  OS.write("\0\0\0\0\0\0\0", alignTo8(BuildID.size()) - BuildID.size());
+  OS.write(reinterpret_cast<const char *>(EntryTable.data()),
+           EntryTable.size() * sizeof(Entry));
+  OS.write(reinterpret_cast<const char *>(FrameTable.data()),
+           FrameTable.size() * sizeof(Frame));
+  OS << StringTable;
+  OS.close();
+  if (OS.has_error()) {
+    OS.clear_error();
+    return std::make_error_code(std::errc::io_error);
+  }
+  return std::error_code();
+}
+
+ErrorOr<std::unique_ptr<SymbolizationIndex>>
+SymbolizationIndex::open(StringRef Path) {
+  auto BufOrErr = MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                        /*RequiresNullTerminator=*/false);
+  if (std::error_code EC = BufOrErr.getError()) {
+    return EC;
+  }
+  std::unique_ptr<SymbolizationIndex> Index(
+      new SymbolizationIndex(std::move(BufOrErr.get())));
+
+  // Check that the header and all tables fit into the file.
+  StringRef Data = Index->Buffer->getBuffer();
+  std::error_code Invalid = std::make_error_code(std::errc::invalid_argument);
+  if (Data.size() < sizeof(Header)) {
+    return Invalid;
+  }
+  const Header *H = reinterpret_cast<const Header *>(Data.data());
+  if (memcmp(H->Magic, kMagic, sizeof(kMagic)) || H->Version != kVersion) {
+    return Invalid;
+  }
+  uint64_t BuildIDOffset = sizeof(Header);
+  uint64_t EntriesOffset = BuildIDOffset + alignTo8(H->BuildIDSize);
+  uint64_t FramesOffset = EntriesOffset + H->NumEntries * sizeof(Entry);
+  uint64_t StringsOffset = FramesOffset + H->NumFrames * sizeof(Frame);
+  if (H->NumEntries > Data.size() / sizeof(Entry) ||
+      H->NumFrames > Data.size() / sizeof(Frame) ||
+      StringsOffset > Data.size() ||
+      Data.size() - StringsOffset != H->StringTableSize) {
+    return Invalid;
+  }
+
+  Index->BuildID = Data.substr(BuildIDOffset, H->BuildIDSize);
+  Index->Entries =
+      reinterpret_cast<const Entry *>(Data.data() + EntriesOffset);
+  Index->NumEntries = H->NumEntries;
+  Index->Frames = reinterpret_cast<const Frame *>(Data.data() + FramesOffset);
+  Index->NumFrames = H->NumFrames;
+  Index->Strings = Data.substr(StringsOffset);
+  for (size_t i = 0; i < Index->NumEntries; ++i) {
+    const Entry &E = Index->Entries[i];
+    if ((uint64_t)E.FirstFrame + E.NumFrames > Index->NumFrames) {
+      return Invalid;
+    }
+  }
+  for (size_t i = 0; i < Index->NumFrames; ++i) {
+    const Frame &F = Index->Frames[i];
+    if (F.FunctionName >= Index->Strings.size() ||
+        F.FileName >= Index->Strings.size()) {
+      return Invalid;
+    }
+  }
+  if (!Index->Strings.empty() && Index->Strings.back() != '\0') {
+    return Invalid;
+  }
+  return std::move(Index);
+}
+
+bool SymbolizationIndex::lookup(uint64_t PC, DIInliningInfo &Result) const {
+  const Entry *E = std::lower_bound(
+      Entries, Entries + NumEntries, PC,
+      [](const Entry &E, uint64_t PC) { return E.PC < PC; });
+  if (E == Entries + NumEntries || E->PC != PC) {
+    return false;
+  }
+
+  Result = DIInliningInfo();
+  for (uint32_t i = E->FirstFrame, e = E->FirstFrame + E->NumFrames; i < e;
+       ++i) {
+    const Frame &F = Frames[i];
+    DILineInfo LineInfo;
+    LineInfo.FunctionName = Strings.data() + F.FunctionName;
+    LineInfo.FileName = Strings.data() + F.FileName;
+    LineInfo.Line = F.Line;
+    LineInfo.Column = F.Column;
+    LineInfo.Discriminator = F.Discriminator;
+    Result.addFrame(LineInfo);
+  }
+  return true;
+}
+
+ErrorOr<std::string> readBuildID(StringRef Path) {
+  auto ObjOrErr = object::ObjectFile::createObjectFile(Path);
+  if (!ObjOrErr) {
+    return errorToErrorCode(ObjOrErr.takeError());
+  }
+  object::ObjectFile *Obj = ObjOrErr->getBinary();
+  if (!isa<object::ELFObjectFileBase>(Obj)) {
+    return std::string();
+  }
+
+  // Notes consist of name size, descriptor size and type, followed by the
+  // name and the descriptor, each padded to four bytes.
+  bool IsLittleEndian = Obj->isLittleEndian();
+  auto Read32 = [IsLittleEndian](const char *P) {
+    return IsLittleEndian ? endian::read32le(P) : endian::read32be(P);
+  };
+  for (const object::SectionRef &Section : Obj->sections()) {
+    StringRef Name, Contents;
+    if (Section.getName(Name) || Name != ".note.gnu.build-id" ||
+        Section.getContents(Contents)) {
+      continue;
+    }
+    while (Contents.size() >= 12) {
+      const char *P = Contents.data();
+      uint32_t NameSize = Read32(P);
+      uint32_t DescSize = Read32(P + 4);
+      uint32_t Type = Read32(P + 8);
+      uint64_t DescOffset = 12 + (((uint64_t)NameSize + 3) & ~3ULL);
+      uint64_t NoteSize = DescOffset + (((uint64_t)DescSize + 3) & ~3ULL);
+      if (Contents.size() < DescOffset + DescSize) {
+        break;
+      }
+      if (Type == kNTGNUBuildID && Contents.substr(12, NameSize) ==
+                                       StringRef("GNU", 4)) {
+        return Contents.substr(DescOffset, DescSize).str();
+      }
+      Contents = Contents.drop_front(std::min<uint64_t>(NoteSize, Contents.size()));
+    }
+  }
+  return std::string();
+}
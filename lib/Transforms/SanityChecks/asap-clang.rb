@@ -337,10 +337,14 @@ class AsapOptimizingCompiler < BaseCompiler
     log_name  = mangle(state.log_path(target_name), '.o', '.asap.log')
     opt_level = get_optlevel_for_llc(cmd)
     FileUtils.mkdir_p(File.dirname(log_name))
+    # Moving check failure paths out of hot code is opt-in; set
+    # ASAP_COLD_PATHS=1 to enable it.
+    cold_paths_params = ENV['ASAP_COLD_PATHS'] == '1' ? ['-sanity-check-cold-paths'] : []
     run!(find_opt(),
          '-asap-gcov',
          '-asap-verbose',
          "-asap-cost-threshold=#{@cost_threshold}",
+         *cold_paths_params,
          "-gcda=#{gcda_name}", "-gcno=#{gcno_name}",
          '-o', asap_name, orig_name,
          :out => log_name,
@@ -16,6 +16,7 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 using namespace llvm;
 
 static cl::opt<bool> OptimizeSanityChecks(
@@ -117,6 +118,14 @@ bool isInstrumentation(const Instruction *I) {
   return false;
 }
 
+bool isSanitizerCoverage(const Instruction *I) {
+  if (auto *CI = dyn_cast<const CallInst>(I)) {
+    return CI->getCalledFunction() &&
+           CI->getCalledFunction()->getName().startswith("__sanitizer_cov");
+  }
+  return isa<StoreInst>(I) && isInstrumentation(I);
+}
+
 bool isAsmForSideEffect(const Instruction *I) {
   if (const CallInst *CI = dyn_cast<CallInst>(I)) {
     if (const InlineAsm *IA = dyn_cast<InlineAsm>(CI->getCalledValue())) {
@@ -146,6 +155,22 @@ bool isAbortingCall(const CallInst *CI) {
   return false;
 }
 
+bool parseAsanReport(StringRef Name, bool &IsWrite, uint64_t &AccessSize,
+                     bool &Recover) {
+  if (!Name.consume_front("__asan_report_")) {
+    return false;
+  }
+  if (Name.consume_front("load")) {
+    IsWrite = false;
+  } else if (Name.consume_front("store")) {
+    IsWrite = true;
+  } else {
+    return false;
+  }
+  Recover = Name.consume_back("_noabort");
+  return !Name.getAsInteger(10, AccessSize) && AccessSize > 0;
+}
+
 DebugLoc getBasicBlockDebugLoc(BasicBlock *BB) {
   for (Instruction &Inst : *BB) {
     DebugLoc DL = Inst.getDebugLoc();
@@ -215,6 +240,36 @@ void printDebugLoc(const DebugLoc &DbgLoc, LLVMContext &Ctx,
        << DL->getDiscriminator();
 }
 
+Function *cloneFunction(Function *F, const Twine &Suffix) {
+  Function *Clone = Function::Create(F->getFunctionType(),
+                                     GlobalValue::InternalLinkage,
+                                     F->getName() + Suffix, F->getParent());
+  ValueToValueMapTy VMap;
+  Function::arg_iterator CloneArg = Clone->arg_begin();
+  for (Argument &Arg : F->args()) {
+    CloneArg->setName(Arg.getName());
+    VMap[&Arg] = &*CloneArg++;
+  }
+  if (DISubprogram *SP = F->getSubprogram()) {
+    auto &MD = VMap.MD();
+    MD[SP->getUnit()].reset(SP->getUnit());
+    MD[SP->getType()].reset(SP->getType());
+    MD[SP->getFile()].reset(SP->getFile());
+  }
+  SmallVector<ReturnInst *, 8> Returns;
+  CloneFunctionInto(Clone, F, VMap, F->getSubprogram() != nullptr, Returns);
+
+  // CloneFunctionInto copies F's visibility, which internal functions must
+  // not have.
+  Clone->setVisibility(GlobalValue::DefaultVisibility);
+  Clone->setDLLStorageClass(GlobalValue::DefaultStorageClass);
+  return Clone;
+}
+
+bool isCheckedVersion(const Function &F) {
+  return F.hasFnAttribute("asap-checked-version");
+}
+
 bool getRegionFromInstructionSet(const InstructionSet &instrs,
     Instruction **begin, Instruction **end) {
 
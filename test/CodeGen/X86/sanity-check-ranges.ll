@@ -0,0 +1,51 @@
+; Test that -asap-check-ranges brackets the machine code of sanity checks with
+; labels, and records the ranges with their check IDs.
+; RUN: llc -o - -mtriple=x86_64-unknown-linux-gnu -asap-check-ranges < %s | FileCheck %s
+; RUN: llc -o - -mtriple=x86_64-unknown-linux-gnu < %s | FileCheck %s --check-prefix=CHECK-NORANGES
+
+define i32 @foo(i32* %a) {
+entry:
+  %0 = ptrtoint i32* %a to i64, !sanitycheck !0
+  %1 = lshr i64 %0, 3, !sanitycheck !0
+  %2 = add i64 %1, 2147450880, !sanitycheck !0
+  %3 = inttoptr i64 %2 to i8*, !sanitycheck !0
+  %4 = load i8, i8* %3, !sanitycheck !0
+  %5 = icmp ne i8 %4, 0, !sanitycheck !0
+  br i1 %5, label %report, label %ok, !sanitycheck !0
+
+report:
+  call void @__asan_report_load4(i64 %0), !sanitycheck !0
+  unreachable, !sanitycheck !0
+
+ok:
+  %v = load i32, i32* %a
+  ret i32 %v
+}
+
+declare void @__asan_report_load4(i64)
+
+; The shadow check, up to the branch, is one range.
+; CHECK-LABEL: foo:
+; CHECK: [[FASTBEGIN:.Lsanity_check[0-9]+]]:
+; CHECK: shrq $3
+; CHECK: cmpb $0
+; CHECK-NEXT: [[FASTEND:.Lsanity_check[0-9]+]]:
+; CHECK-NEXT: jne
+
+; The report block is another.
+; CHECK: [[SLOWBEGIN:.Lsanity_check[0-9]+]]:
+; CHECK: callq __asan_report_load4
+; CHECK-NEXT: [[SLOWEND:.Lsanity_check[0-9]+]]:
+
+; CHECK: .section __asap_check_ranges,"",@progbits
+; CHECK: .quad 42
+; CHECK-NEXT: .quad [[FASTBEGIN]]
+; CHECK-NEXT: .quad [[FASTEND]]
+; CHECK-NEXT: .quad 42
+; CHECK-NEXT: .quad [[SLOWBEGIN]]
+; CHECK-NEXT: .quad [[SLOWEND]]
+
+; CHECK-NORANGES-NOT: sanity_check
+; CHECK-NORANGES-NOT: __asap_check_ranges
+
+!0 = !{i64 42}
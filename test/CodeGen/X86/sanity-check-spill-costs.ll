@@ -0,0 +1,39 @@
+; Test that -asap-spill-cost-output charges a check for the spill code around
+; it. The check clobbers all registers, so %x has to be spilled.
+; RUN: rm -f %t
+; RUN: llc -o /dev/null -mtriple=x86_64-unknown-linux-gnu -asap-spill-cost-output=%t < %s
+; RUN: FileCheck %s < %t
+
+; CHECK: 42 {{[0-9]+\.[0-9]+}}
+; CHECK-NOT: 43
+
+define i32 @foo(i32* %a, i32 %n) "no-frame-pointer-elim"="true" {
+entry:
+  %x = load i32, i32* %a
+  %c = icmp ne i32 %n, 0
+  br i1 %c, label %check, label %ok
+
+check:
+  call void asm sideeffect "", "~{rax},~{rbx},~{rcx},~{rdx},~{rsi},~{rdi},~{r8},~{r9},~{r10},~{r11},~{r12},~{r13},~{r14},~{r15}"(), !sanitycheck !0
+  br label %ok, !sanitycheck !0
+
+ok:
+  %y = add i32 %x, %n
+  ret i32 %y
+}
+
+define i32 @bar(i32 %n) {
+entry:
+  %c = icmp ne i32 %n, 0
+  br i1 %c, label %check, label %ok
+
+check:
+  call void asm sideeffect "", ""(), !sanitycheck !1
+  br label %ok, !sanitycheck !1
+
+ok:
+  ret i32 %n
+}
+
+!0 = !{i64 42}
+!1 = !{i64 43}
@@ -0,0 +1,30 @@
+; Test that trace-pc-guard callbacks get stable IDs, and that these are
+; emitted in a side table with the same comdat as the guards.
+; RUN: opt < %s -sancov -sanitizer-coverage-level=3 -sanitizer-coverage-trace-pc-guard -sanitizer-coverage-check-ids -S | FileCheck %s
+; RUN: opt < %s -sancov -sanitizer-coverage-level=3 -sanitizer-coverage-trace-pc-guard -S | FileCheck %s --check-prefix=CHECK-NOIDS
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+$Foo = comdat any
+; Function Attrs: uwtable
+define linkonce_odr void @Foo() comdat {
+entry:
+  ret void
+}
+
+define linkonce_odr void @Bar() {
+entry:
+  ret void
+}
+
+; CHECK: @__sancov_gen_check_ids{{.*}} = private constant [1 x i64] [i64 [[FOO_ID:-?[0-9]+]]], section "__sancov_check_ids", comdat($Foo), align 8
+; CHECK: @__sancov_gen_check_ids{{.*}} = private constant [1 x i64] [i64 [[BAR_ID:-?[0-9]+]]], section "__sancov_check_ids", align 8
+; CHECK: @llvm.used = appending global [2 x i8*] {{.*}}@__sancov_gen_check_ids
+; CHECK-LABEL: define linkonce_odr void @Foo
+; CHECK: call void @__sanitizer_cov_trace_pc_guard({{.*}}), !checkid [[FOO_MD:![0-9]+]]
+; CHECK-LABEL: define linkonce_odr void @Bar
+; CHECK: call void @__sanitizer_cov_trace_pc_guard({{.*}}), !checkid [[BAR_MD:![0-9]+]]
+; CHECK: [[FOO_MD]] = !{i64 [[FOO_ID]]}
+; CHECK: [[BAR_MD]] = !{i64 [[BAR_ID]]}
+
+; CHECK-NOIDS-NOT: __sancov_check_ids
+; CHECK-NOIDS-NOT: !checkid
@@ -0,0 +1,35 @@
+; Test that the guard table has one record per trace-pc-guard guard, with the
+; callback's check ID, the function's GUID, the block ordinal and location.
+; RUN: opt < %s -sancov -sanitizer-coverage-level=1 -sanitizer-coverage-trace-pc-guard -sanitizer-coverage-guard-table -S | FileCheck %s
+; RUN: opt < %s -sancov -sanitizer-coverage-level=1 -sanitizer-coverage-trace-pc-guard -S | FileCheck %s --check-prefix=CHECK-NOTABLE
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+$Foo = comdat any
+; Function Attrs: uwtable
+define linkonce_odr void @Foo() comdat !dbg !6 {
+entry:
+  ret void, !dbg !9
+}
+
+; CHECK: @__sancov_gen_guard_table{{.*}} = private constant [1 x { i64, i64, i32, i32, i32, i32 }] [{ i64, i64, i32, i32, i32, i32 } { i64 [[FOO_ID:-?[0-9]+]], i64 {{-?[0-9]+}}, i32 0, i32 3, i32 0, i32 0 }], section "__sancov_guard_table", comdat($Foo), align 8
+; CHECK: @llvm.used = appending global [1 x i8*] {{.*}}@__sancov_gen_guard_table
+; CHECK-NOT: __sancov_check_ids
+; CHECK-LABEL: define linkonce_odr void @Foo
+; CHECK: call void @__sanitizer_cov_trace_pc_guard({{.*}}), !dbg {{![0-9]+}}, !checkid [[FOO_MD:![0-9]+]]
+; CHECK: [[FOO_MD]] = !{i64 [[FOO_ID]]}
+
+; CHECK-NOTABLE-NOT: __sancov_guard_table
+; CHECK-NOTABLE-NOT: !checkid
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3, !4}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "clang", isOptimized: false, runtimeVersion: 0, emissionKind: FullDebug, enums: !2)
+!1 = !DIFile(filename: "foo.c", directory: "/tmp")
+!2 = !{}
+!3 = !{i32 2, !"Dwarf Version", i32 4}
+!4 = !{i32 2, !"Debug Info Version", i32 3}
+!6 = distinct !DISubprogram(name: "Foo", scope: !1, file: !1, line: 2, type: !7, isLocal: false, isDefinition: true, scopeLine: 3, isOptimized: false, unit: !0, variables: !2)
+!7 = !DISubroutineType(types: !8)
+!8 = !{null}
+!9 = !DILocation(line: 4, column: 1, scope: !6)
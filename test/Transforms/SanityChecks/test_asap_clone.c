@@ -0,0 +1,109 @@
+// Tests that ASAP can remove checks in a hot calling context only, after
+// -asap-clone-hot-callsites gives that context its own copy of the callee.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -g -fprofile-generate -o %t.gen %s
+// RUN: echo 100 | env LLVM_PROFILE_FILE=%t.profraw %t.gen
+// RUN: llvm-profdata merge -o %t.profdata %t.profraw
+// RUN: clang -Wall -O1 -g -flto -fsanitize=address -fprofile-use=%t.profdata -c -o %t.o %s
+
+// Without cloning, the check in `get` is expensive for all callers.
+// RUN: opt -asap-module-instrprof -asap-cost-level=0.5 -o %t.noclone.o %t.o
+// RUN: llvm-dis < %t.noclone.o | FileCheck --check-prefix CHECK-NOCLONE %s
+
+// With cloning, the loop in `sum` calls a hot copy, whose check is removed.
+// The original keeps its check for the call from `main`.
+// RUN: opt -asap-clone-hot-callsites -asap-module-instrprof -asap-cost-level=0.5 -o %t.clone.o %t.o
+// RUN: llvm-dis < %t.clone.o | FileCheck --check-prefix CHECK-CLONE %s
+
+// `scale` is called 4000, 3000, 2000 and 1000 times from four callers. Each
+// call site is compared to all 10000 calls, so only the first two reach a
+// fraction of 0.25, even though the third makes more than a quarter of the
+// calls that remain.
+// RUN: opt -asap-clone-hot-callsites -asap-clone-hot-fraction=0.25 -o %t.fraction.o %t.o
+// RUN: llvm-dis < %t.fraction.o | FileCheck --check-prefix CHECK-FRACTION %s
+
+// CHECK-NOCLONE-LABEL: define i32 @get(
+// CHECK-NOCLONE-NOT: call void @__asan_report_load4
+// CHECK-NOCLONE: ret i32
+
+// CHECK-CLONE-LABEL: define i32 @get(
+// CHECK-CLONE: call void @__asan_report_load4
+// CHECK-CLONE-LABEL: define i32 @sum(
+// CHECK-CLONE: call i32 @get.asap.hot(
+// CHECK-CLONE-LABEL: define i32 @main(
+// CHECK-CLONE: call i32 @get(
+// CHECK-CLONE-LABEL: define internal i32 @get.asap.hot(
+// CHECK-CLONE-NOT: call void @__asan_report_load4
+// CHECK-CLONE: ret i32
+
+// CHECK-FRACTION-LABEL: define i32 @scale40(
+// CHECK-FRACTION: call i32 @scale.asap.hot
+// CHECK-FRACTION-LABEL: define i32 @scale30(
+// CHECK-FRACTION: call i32 @scale.asap.hot
+// CHECK-FRACTION-LABEL: define i32 @scale20(
+// CHECK-FRACTION: call i32 @scale(
+// CHECK-FRACTION-LABEL: define i32 @scale10(
+// CHECK-FRACTION: call i32 @scale(
+
+#include <stdio.h>
+
+int a[10] = {1, 4, 9, 16, 25, 36, 49, 64, 81, 100};
+
+int get(int i) {
+    return a[i];
+}
+
+int sum(int n) {
+    int s = 0;
+    for (int i = 0; i < n * 100; ++i) {
+        s += get(i % 10);
+    }
+    return s;
+}
+
+int scale(int i) {
+    return a[i] * 3;
+}
+
+int scale40(int n) {
+    int s = 0;
+    for (int i = 0; i < n * 40; ++i) {
+        s += scale(i % 10);
+    }
+    return s;
+}
+
+int scale30(int n) {
+    int s = 0;
+    for (int i = 0; i < n * 30; ++i) {
+        s += scale(i % 10);
+    }
+    return s;
+}
+
+int scale20(int n) {
+    int s = 0;
+    for (int i = 0; i < n * 20; ++i) {
+        s += scale(i % 10);
+    }
+    return s;
+}
+
+int scale10(int n) {
+    int s = 0;
+    for (int i = 0; i < n * 10; ++i) {
+        s += scale(i % 10);
+    }
+    return s;
+}
+
+int main() {
+    int n = 0;
+    scanf("%d", &n);
+    printf("%d\n", get(n % 10));
+    printf("%d\n", sum(n));
+    printf("%d\n", scale40(n) + scale30(n) + scale20(n) + scale10(n));
+    return 0;
+}
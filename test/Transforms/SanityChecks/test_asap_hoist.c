@@ -0,0 +1,29 @@
+// Tests that -asap-action=hoist replaces checks in loops by range checks.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -flto -fsanitize=address -c -o %t.o %s
+
+// The check in the loop is replaced by a check of the whole range of `a`
+// before the loop. The check in `foo` is not in a loop and gets removed.
+// RUN: opt -asap-module -asap-action=hoist -asap-cost-level=0 -o %t.hoist.o %t.o
+// RUN: llvm-dis < %t.hoist.o | FileCheck %s
+
+// CHECK: define i32 @foo
+// CHECK-NOT: call void @__asan_report_load4
+// CHECK: define i32 @bar
+// CHECK: call {{.*}} @__asan_region_is_poisoned
+// CHECK: call void @__asan_report_load_n
+// CHECK-NOT: call void @__asan_report_load4
+
+int foo(int *a) {
+    return a[0];
+}
+
+int bar(int *a, int n) {
+    int sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += a[i];
+    }
+    return sum;
+}
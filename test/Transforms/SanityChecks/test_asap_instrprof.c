@@ -0,0 +1,50 @@
+// Tests ASAP with costs from an IR-level instrumentation profile.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -fprofile-generate -o %t.gen %s
+// RUN: echo 100 | env LLVM_PROFILE_FILE=%t.profraw %t.gen
+// RUN: llvm-profdata merge -o %t.profdata %t.profraw
+// RUN: clang -Wall -O1 -flto -fsanitize=address -fprofile-use=%t.profdata -c -o %t.o %s
+
+// The check in the loop in `hot` ran many times, and is removed. The check in
+// `cold` never ran, has cost zero, and is kept.
+// RUN: opt -asap-module-instrprof -asap-cost-level=0.5 -o %t.asap.o %t.o
+// RUN: llvm-dis < %t.asap.o | FileCheck %s
+
+// The function pass uses the same costs.
+// RUN: opt -asap-instrprof -asap-cost-threshold=1000 -o %t.asap2.o %t.o
+// RUN: llvm-dis < %t.asap2.o | FileCheck %s
+
+// CHECK: define i32 @hot
+// CHECK-NOT: call void @__asan_report_load4
+// CHECK: define i32 @cold
+// CHECK: call void @__asan_report_load4
+
+#include <stdio.h>
+
+int a[10] = {1, 4, 9, 16, 25, 36, 49, 64, 81, 100};
+
+__attribute__((noinline))
+int hot(int n) {
+    int sum = 0;
+    for (int i = 0; i < n * 100; ++i) {
+        sum += a[i % 10];
+    }
+    return sum;
+}
+
+__attribute__((noinline))
+int cold(int i) {
+    return a[i];
+}
+
+int main() {
+    int n = 0;
+    scanf("%d", &n);
+    if (n < 0) {
+        printf("%d\n", cold(-n % 10));
+    }
+    printf("%d\n", hot(n));
+    return 0;
+}
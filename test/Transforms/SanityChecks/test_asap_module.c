@@ -0,0 +1,40 @@
+// Tests the module-wide selection of sanity checks by cost or sanity level.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -flto -fsanitize=address -c -o %t.o %s
+
+// At cost level zero, all checks with non-zero cost are removed.
+// RUN: opt -asap-module -asap-cost-level=0 -o %t.cost0.o %t.o
+// RUN: llvm-dis < %t.cost0.o | FileCheck --check-prefix CHECK-COST0 %s
+
+// At sanity level one, all checks are kept.
+// RUN: opt -asap-module -asap-sanity-level=1 -o %t.sanity1.o %t.o
+// RUN: llvm-dis < %t.sanity1.o | FileCheck --check-prefix CHECK-SANITY1 %s
+
+// At sanity level one half, the cheap check in `foo` is kept, whereas the
+// check in the loop in `bar` is removed.
+// RUN: opt -asap-module -asap-sanity-level=0.5 -o %t.sanity05.o %t.o
+// RUN: llvm-dis < %t.sanity05.o | FileCheck --check-prefix CHECK-SANITY05 %s
+
+// CHECK-COST0-NOT: call void @__asan_report_load4
+// CHECK-SANITY1: define i32 @foo
+// CHECK-SANITY1: call void @__asan_report_load4
+// CHECK-SANITY1: define i32 @bar
+// CHECK-SANITY1: call void @__asan_report_load4
+// CHECK-SANITY05: define i32 @foo
+// CHECK-SANITY05: call void @__asan_report_load4
+// CHECK-SANITY05: define i32 @bar
+// CHECK-SANITY05-NOT: call void @__asan_report_load4
+
+int foo(int *a) {
+    return a[0];
+}
+
+int bar(int *a, int n) {
+    int sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += a[i];
+    }
+    return sum;
+}
@@ -0,0 +1,54 @@
+// Tests that -asap-multiversion keeps a fully checked copy of hot functions,
+// while ASAP removes expensive checks from the original.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -g -fprofile-generate -o %t.gen %s
+// RUN: echo 100 | env LLVM_PROFILE_FILE=%t.profraw %t.gen
+// RUN: llvm-profdata merge -o %t.profdata %t.profraw
+// RUN: clang -Wall -O1 -g -flto -fsanitize=address -fprofile-use=%t.profdata -c -o %t.o %s
+
+// RUN: opt -asap-multiversion -asap-multiversion-count=1 -asap-module-instrprof -asap-cost-level=0 -o %t.mv.o %t.o
+// RUN: llvm-dis < %t.mv.o | FileCheck %s
+
+// CHECK: @__asap_checked_version = private global i8 0, section "__asap_checked_versions"
+// CHECK: @llvm.used = {{.*}}@__asap_checked_version
+
+// The lean copy dispatches to the checked copy while its flag is set.
+// CHECK-LABEL: define i32 @get(
+// CHECK: [[FLAG:%[^ ]+]] = load i8, i8* @__asap_checked_version
+// CHECK: [[USE:%[^ ]+]] = icmp ne i8 [[FLAG]], 0
+// CHECK: br i1 [[USE]], label %asap.checked, label %asap.lean
+// CHECK: asap.checked:
+// CHECK: tail call i32 @get.asap.checked(
+// CHECK: asap.lean:
+// CHECK-NOT: call void @__asan_report_load4
+// CHECK: ret i32
+
+// CHECK-LABEL: define i32 @main(
+// CHECK-NOT: @get.asap.checked
+// CHECK: ret i32
+
+// CHECK-LABEL: define internal i32 @get.asap.checked(
+// CHECK: call void @__asan_report_load4
+// CHECK: ret i32
+
+#include <stdio.h>
+
+int a[10] = {1, 4, 9, 16, 25, 36, 49, 64, 81, 100};
+
+__attribute__((noinline))
+int get(int i) {
+    return a[i];
+}
+
+int main() {
+    int n = 0;
+    scanf("%d", &n);
+    int s = 0;
+    for (int i = 0; i < n * 100; ++i) {
+        s += get((i + n) % 10);
+    }
+    printf("%d\n", s);
+    return 0;
+}
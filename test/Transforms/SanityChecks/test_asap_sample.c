@@ -0,0 +1,39 @@
+// Tests that -asap-action=sample guards expensive checks by a countdown.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -flto -fsanitize=address -c -o %t.o %s
+
+// The cheap check in `foo` is kept. The check in the loop in `bar` does not
+// fit into the budget; it stays in the program, but only runs once every few
+// iterations.
+// RUN: opt -asap-module -asap-action=sample -asap-cost-level=0.5 -o %t.sample.o %t.o
+// RUN: llvm-dis < %t.sample.o | FileCheck %s
+
+// At cost level zero, there is no budget for sampling, and checks are removed.
+// RUN: opt -asap-module -asap-action=sample -asap-cost-level=0 -o %t.cost0.o %t.o
+// RUN: llvm-dis < %t.cost0.o | FileCheck --check-prefix CHECK-COST0 %s
+
+// CHECK: @__asap_sample_counter = private global i32 0
+// CHECK: define i32 @foo
+// CHECK-NOT: __asap_sample_counter
+// CHECK: call void @__asan_report_load4
+// CHECK: define i32 @bar
+// CHECK: load i32, i32* @__asap_sample_counter
+// CHECK: store i32 {{.*}} @__asap_sample_counter
+// CHECK: call void @__asan_report_load4
+
+// CHECK-COST0-NOT: __asap_sample_counter
+// CHECK-COST0-NOT: call void @__asan_report_load4
+
+int foo(int *a) {
+    return a[0];
+}
+
+int bar(int *a, int n) {
+    int sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += a[i];
+    }
+    return sum;
+}
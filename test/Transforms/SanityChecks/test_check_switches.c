@@ -0,0 +1,22 @@
+// Tests that -sanity-check-switches guards each check by a switch, and emits
+// the switches and check IDs into their sections.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -flto -fsanitize=address -c -o %t.o %s
+// RUN: opt -sanity-check-switches -o %t.switches.o %t.o
+// RUN: llvm-dis < %t.switches.o | FileCheck %s
+
+// CHECK: @__asap_check_switches = private global [1 x i8] c"\01", section "__asap_check_switches"
+// CHECK: @__asap_check_switch_ids = private constant [1 x i64] [i64 {{-?[1-9][0-9]*}}], section "__asap_check_switch_ids", align 8
+// CHECK: @llvm.used = {{.*}}@__asap_check_switches{{.*}}@__asap_check_switch_ids
+
+// CHECK-LABEL: define i32 @get(
+// CHECK: [[SWITCH:%[^ ]+]] = load i8, i8* getelementptr inbounds ([1 x i8], [1 x i8]* @__asap_check_switches, i64 0, i64 0)
+// CHECK: [[ON:%[^ ]+]] = icmp ne i8 [[SWITCH]], 0
+// CHECK: br i1 [[ON]], label %asap.guard
+// CHECK: asap.guard:
+// CHECK: call void @__asan_report_load4
+int get(int *p, int i) {
+    return p[i];
+}
@@ -0,0 +1,42 @@
+// Tests that -sanity-check-cold-paths marks check failure paths as cold, and
+// outlines those that are larger than a call.
+
+// RUN: rm -rf %t %t.*
+
+// ASan failure paths only contain the report call, and stay in place.
+// RUN: clang -Wall -O1 -flto -fsanitize=address -c -o %t.asan.o %s
+// RUN: opt -sanity-check-cold-paths -o %t.asan.cold.o %t.asan.o
+// RUN: llvm-dis < %t.asan.cold.o | FileCheck --check-prefix CHECK-ASAN %s
+
+// UBSan failure paths also pass the operands to the handler, and are outlined.
+// RUN: clang -Wall -O1 -flto -fsanitize=signed-integer-overflow -fno-sanitize-recover=all -c -o %t.ubsan.o %s
+// RUN: opt -sanity-check-cold-paths -o %t.ubsan.cold.o %t.ubsan.o
+// RUN: llvm-dis < %t.ubsan.cold.o | FileCheck --check-prefix CHECK-UBSAN %s
+// RUN: opt -sanity-check-cold-paths -asap-outline-cold-paths=false -o %t.ubsan.nooutline.o %t.ubsan.o
+// RUN: llvm-dis < %t.ubsan.nooutline.o | FileCheck --check-prefix CHECK-NOOUTLINE %s
+
+// CHECK-ASAN-LABEL: define i32 @add
+// CHECK-ASAN: br i1 {{.*}}, !prof [[WEIGHTS:![0-9]+]]
+// CHECK-ASAN: call void @__asan_report_load4({{.*}}) [[COLD:#[0-9]+]]
+// CHECK-ASAN-NEXT: call void asm sideeffect
+// CHECK-ASAN-NEXT: unreachable
+// CHECK-ASAN-NOT: section ".text.unlikely"
+// CHECK-ASAN: attributes [[COLD]] = { cold }
+// CHECK-ASAN: [[WEIGHTS]] = !{!"branch_weights", i32 {{1, i32 1048575|1048575, i32 1}}}
+
+// CHECK-UBSAN-LABEL: define i32 @add
+// CHECK-UBSAN: br i1 {{.*}}, !prof [[WEIGHTS:![0-9]+]]
+// CHECK-UBSAN: call void @add_{{.*}}(
+// CHECK-UBSAN-NEXT: unreachable
+// CHECK-UBSAN: define internal void @add_{{.*}} [[COLDFN:#[0-9]+]] section ".text.unlikely"
+// CHECK-UBSAN: call void @__ubsan_handle_add_overflow_abort
+// CHECK-UBSAN: attributes [[COLDFN]] = { cold minsize noinline noreturn optsize{{.*}}}
+// CHECK-UBSAN: [[WEIGHTS]] = !{!"branch_weights", i32 {{1, i32 1048575|1048575, i32 1}}}
+
+// CHECK-NOOUTLINE-LABEL: define i32 @add
+// CHECK-NOOUTLINE: call void @__ubsan_handle_add_overflow_abort
+// CHECK-NOOUTLINE-NOT: section ".text.unlikely"
+
+int add(int *a, int b) {
+    return *a + b;
+}
@@ -0,0 +1,33 @@
+// Tests that costs from -asap-cost-table replace the TTI-based costs.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -g -flto -fsanitize=address,signed-integer-overflow -c -o %t.o %s
+// RUN: echo "# Branches are very expensive on this machine." > %t.table
+// RUN: echo "br 1000" >> %t.table
+
+// RUN: opt -analyze -sanity-check-sampled-cost %t.o | FileCheck --check-prefix CHECK-TTI %s
+// RUN: opt -analyze -sanity-check-sampled-cost -asap-cost-table=%t.table %t.o | FileCheck --check-prefix CHECK-TABLE %s
+
+// Entries for the function that a check calls when it fails give the cost of
+// the whole check, and do not affect other kinds of checks.
+// RUN: echo "__asan_report_load4 5000" > %t.checks
+// RUN: opt -analyze -sanity-check-sampled-cost -asap-cost-table=%t.checks %t.o | FileCheck --check-prefix CHECK-CHECKS %s
+
+// CHECK-TTI-LABEL: for function 'foo':
+// CHECK-TABLE-LABEL: for function 'foo':
+// CHECK-CHECKS-LABEL: for function 'foo':
+int foo(int *a) {
+    // CHECK-TTI: {{^ +[0-9]{1,2} .*}}test_cost_table.c:[[@LINE+3]]
+    // CHECK-TABLE: {{^ +[1-9][0-9]{3} .*}}test_cost_table.c:[[@LINE+2]]
+    // CHECK-CHECKS: {{^ +5000 .*}}test_cost_table.c:[[@LINE+1]]
+    return a[0];
+}
+
+// CHECK-TTI-LABEL: for function 'bar':
+// CHECK-CHECKS-LABEL: for function 'bar':
+int bar(int x, int y) {
+    // CHECK-TTI: {{^ +[0-9]{1,2} .*}}test_cost_table.c:[[@LINE+2]]
+    // CHECK-CHECKS: {{^ +[0-9]{1,2} .*}}test_cost_table.c:[[@LINE+1]]
+    return x + y;
+}
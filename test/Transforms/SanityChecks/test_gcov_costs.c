@@ -0,0 +1,74 @@
+// Tests that GCOV counts go to the right function, and that functions whose
+// CFG does not match the GCOV data are skipped. `foo` runs 100 times, `bar`
+// never, and `baz` once.
+
+// RUN: rm -rf %t %t.*
+
+// Instrument the same bitcode with ASan and GCOV, so that the CFG seen by
+// sanity-check-gcov-cost matches the one in the GCOV notes.
+// RUN: clang -Wall -g -O1 -fsanitize=address --coverage -Xclang -disable-llvm-passes -emit-llvm -c -o %t.bc %s
+// RUN: opt -mem2reg -asan -asan-module -o %t.asan.bc %t.bc
+// RUN: opt -insert-gcov-profiling -o %t.gcov.bc %t.asan.bc
+// RUN: clang -fsanitize=address --coverage -Xclang -disable-llvm-passes -o %t %t.gcov.bc
+// RUN: %t
+
+// RUN: opt -sanity-check-gcov-cost -gcno=%t.gcno -gcda=%t.gcda -analyze %t.asan.bc | FileCheck %s
+
+// `foo` has an additional branch in this build, and gets no counts.
+// RUN: clang -Wall -g -O1 -fsanitize=address --coverage -Xclang -disable-llvm-passes -emit-llvm -c -DMISMATCH -o %t.mismatch.bc %s
+// RUN: opt -mem2reg -asan -asan-module -o %t.mismatch.asan.bc %t.mismatch.bc
+// RUN: opt -sanity-check-gcov-cost -gcno=%t.gcno -gcda=%t.gcda -analyze %t.mismatch.asan.bc 2> %t.mismatch.err | FileCheck -check-prefix CHECK-MISMATCH %s
+// RUN: FileCheck -check-prefix CHECK-WARNING %s < %t.mismatch.err
+
+// CHECK-WARNING: Warning: foo has {{[0-9]+}} blocks, but GCOV data has {{[0-9]+}}; ignoring its counts.
+
+int a[10];
+
+// CHECK-LABEL: for function 'foo':
+// CHECK-NEXT: Cost Location
+// CHECK-NEXT: {{^ *[1-9][0-9]* .*}}:34
+// CHECK-MISMATCH-LABEL: for function 'foo':
+// CHECK-MISMATCH-NEXT: Cost Location
+// CHECK-MISMATCH-NEXT: {{^ *0 .*}}:34
+int foo(int i) {
+    int x = a[i];
+#ifdef MISMATCH
+    if (x == 42) {
+        x = i;
+    }
+#endif
+    return x;
+}
+
+// CHECK-LABEL: for function 'bar':
+// CHECK-NEXT: Cost Location
+// CHECK-NEXT: {{^ *0 .*}}:50
+// CHECK-MISMATCH-LABEL: for function 'bar':
+// CHECK-MISMATCH-NEXT: Cost Location
+// CHECK-MISMATCH-NEXT: {{^ *0 .*}}:50
+int bar(int i) {
+    return a[i];
+}
+
+// Skipping foo does not affect the other functions.
+// CHECK-LABEL: for function 'baz':
+// CHECK-NEXT: Cost Location
+// CHECK-NEXT: {{^ *[1-9][0-9]* .*}}:61
+// CHECK-MISMATCH-LABEL: for function 'baz':
+// CHECK-MISMATCH-NEXT: Cost Location
+// CHECK-MISMATCH-NEXT: {{^ *[1-9][0-9]* .*}}:61
+int baz(int i) {
+    return a[i];
+}
+
+int main(int argc, char *argv[]) {
+    int s = 0;
+    for (int i = 0; i < 100; ++i) {
+        s += foo((i + argc) % 10);
+    }
+    if (argc > 100) {
+        s += bar(argc);
+    }
+    s += baz(argc);
+    return s == 42;
+}
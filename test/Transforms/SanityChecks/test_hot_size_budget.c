@@ -0,0 +1,89 @@
+// Tests that -asap-hot-size-budget limits the size of checks in hot functions.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -fprofile-generate -o %t.gen %s
+// RUN: echo 100 | env LLVM_PROFILE_FILE=%t.profraw %t.gen
+// RUN: llvm-profdata merge -o %t.profdata %t.profraw
+// RUN: clang -Wall -O1 -flto -fsanitize=address -fprofile-use=%t.profdata -c -o %t.o %s
+
+// Without a size budget, all checks are kept.
+// RUN: opt -asap-module-instrprof -asap-sanity-level=1 -o %t.all.o %t.o
+// RUN: llvm-dis < %t.all.o | FileCheck --check-prefix CHECK-ALL %s
+
+// A budget for one check keeps one of the two checks in `hot`. The check in
+// `cold` never ran, and is not limited by the budget.
+// RUN: opt -asap-module-instrprof -asap-sanity-level=1 -asap-hot-size-budget=70 -o %t.one.o %t.o
+// RUN: llvm-dis < %t.one.o | FileCheck --check-prefix CHECK-ONE %s
+
+// The function pass applies the same budget.
+// RUN: opt -asap-instrprof -asap-cost-threshold=1000000000 -asap-hot-size-budget=70 -o %t.one2.o %t.o
+// RUN: llvm-dis < %t.one2.o | FileCheck --check-prefix CHECK-ONE %s
+
+// A budget of zero removes all checks from `hot`.
+// RUN: opt -asap-module-instrprof -asap-sanity-level=1 -asap-hot-size-budget=0 -o %t.zero.o %t.o
+// RUN: llvm-dis < %t.zero.o | FileCheck --check-prefix CHECK-ZERO %s
+
+// Functions whose checks cost less than -asap-hot-min-cost are not hot.
+// RUN: opt -asap-module-instrprof -asap-sanity-level=1 -asap-hot-size-budget=0 -asap-hot-min-cost=1000000000 -o %t.mincost.o %t.o
+// RUN: llvm-dis < %t.mincost.o | FileCheck --check-prefix CHECK-ALL %s
+
+// Sizes can come from the check ranges of a linked binary. The checks in
+// `hot` are larger than one byte each, and smaller than a kilobyte.
+// RUN: opt -asap-module-instrprof -asap-sanity-level=1 -o %t.ids.o %t.o
+// RUN: llc -asap-check-ranges -filetype=obj -o %t.ranges.o %t.ids.o
+// RUN: clang -fsanitize=address -o %t.ranges %t.ranges.o
+// RUN: opt -asap-module-instrprof -asap-sanity-level=1 -asap-check-sizes=%t.ranges -asap-hot-size-budget=1 -o %t.measured1.o %t.o
+// RUN: llvm-dis < %t.measured1.o | FileCheck --check-prefix CHECK-ZERO %s
+// RUN: opt -asap-module-instrprof -asap-sanity-level=1 -asap-check-sizes=%t.ranges -asap-hot-size-budget=2000 -o %t.measured2k.o %t.o
+// RUN: llvm-dis < %t.measured2k.o | FileCheck --check-prefix CHECK-ALL %s
+
+// Ranges in an object file have no addresses yet.
+// RUN: not opt -asap-module-instrprof -asap-sanity-level=1 -asap-check-sizes=%t.ranges.o -asap-hot-size-budget=70 -o %t.bad.o %t.o 2>&1 | FileCheck --check-prefix CHECK-UNLINKED %s
+// CHECK-UNLINKED: __asap_check_ranges has no addresses; please pass a linked binary
+
+// CHECK-ALL: define i32 @hot
+// CHECK-ALL: call void @__asan_report_load4
+// CHECK-ALL: call void @__asan_report_load4
+// CHECK-ALL: define i32 @cold
+// CHECK-ALL: call void @__asan_report_load4
+
+// CHECK-ONE: define i32 @hot
+// CHECK-ONE: call void @__asan_report_load4
+// CHECK-ONE-NOT: call void @__asan_report_load4
+// CHECK-ONE: define i32 @cold
+// CHECK-ONE: call void @__asan_report_load4
+
+// CHECK-ZERO: define i32 @hot
+// CHECK-ZERO-NOT: call void @__asan_report_load4
+// CHECK-ZERO: define i32 @cold
+// CHECK-ZERO: call void @__asan_report_load4
+
+#include <stdio.h>
+
+int a[10] = {1, 4, 9, 16, 25, 36, 49, 64, 81, 100};
+int b[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+
+__attribute__((noinline))
+int hot(int n) {
+    int sum = 0;
+    for (int i = 0; i < n * 100; ++i) {
+        sum += a[i % 10] * b[(i + 3) % 10];
+    }
+    return sum;
+}
+
+__attribute__((noinline))
+int cold(int i) {
+    return a[i];
+}
+
+int main() {
+    int n = 0;
+    scanf("%d", &n);
+    if (n < 0) {
+        printf("%d\n", cold(-n % 10));
+    }
+    printf("%d\n", hot(n));
+    return 0;
+}
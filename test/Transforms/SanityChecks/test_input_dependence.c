@@ -0,0 +1,79 @@
+// Tests that -asap-input-dependence finds checks that cannot depend on the
+// fuzzer's input, and that -asap-prefer-input-dependent removes them.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -flto -fsanitize=address -c -o %t.o %s
+// RUN: opt -asap-input-dependence -o %t.input.o %t.o
+// RUN: llvm-dis < %t.input.o | FileCheck %s
+
+// All checks are cheap enough to keep, but input-independent ones are removed
+// regardless of their cost.
+// RUN: opt -asap-input-dependence -asap -asap-cost-threshold=1000000000 -asap-prefer-input-dependent -o %t.asap.o %t.o
+// RUN: llvm-dis < %t.asap.o | FileCheck --check-prefix CHECK-ASAP %s
+
+#include <stddef.h>
+#include <stdint.h>
+
+int table[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+int position = 3;
+
+// The index comes from the input, through an argument.
+// CHECK-LABEL: define i32 @get(
+// CHECK: call void @__asan_report_load4({{.*}}!inputdependent [[DEP:![0-9]+]]
+// CHECK-ASAP-LABEL: define i32 @get(
+// CHECK-ASAP: call void @__asan_report_load4
+__attribute__((noinline))
+int get(int *p, int i) {
+    return p[i];
+}
+
+// Nothing that the input influences is stored to `position`.
+// CHECK-LABEL: define i32 @fixed(
+// CHECK: call void @__asan_report_load4({{.*}}!inputdependent [[INDEP:![0-9]+]]
+// CHECK-ASAP-LABEL: define i32 @fixed(
+// CHECK-ASAP-NOT: call void @__asan_report_load4
+// CHECK-ASAP: ret i32
+__attribute__((noinline))
+int fixed(void) {
+    return table[position];
+}
+
+// `mode` is only assigned constants, but which one depends on the input. It is
+// volatile to keep it in memory, where the store is control dependent on the
+// input. ASan moves it into a stack frame, whose slot is tracked like a local,
+// so that storing to it does not taint the global that `fixed` reads.
+// CHECK-LABEL: define i32 @by_mode(
+// CHECK-NOT: !inputdependent [[INDEP]]
+// CHECK: ret i32
+// CHECK-ASAP-LABEL: define i32 @by_mode(
+// CHECK-ASAP: call void @__asan_report_load4
+__attribute__((noinline))
+int by_mode(const uint8_t *data) {
+    volatile int mode = 0;
+    if (data[0] == 'A') {
+        mode = 7;
+    }
+    return table[mode * 100];
+}
+
+// The loop's trip count depends on the input, and so does `i`.
+// CHECK-LABEL: define i32 @LLVMFuzzerTestOneInput(
+// CHECK-NOT: !inputdependent [[INDEP]]
+// CHECK: ret i32
+// CHECK-ASAP-LABEL: define i32 @LLVMFuzzerTestOneInput(
+// CHECK-ASAP: call void @__asan_report_load4
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    int sum = fixed();
+    if (size > 0) {
+        sum += get(table, data[0] % 16);
+        sum += by_mode(data);
+    }
+    for (size_t i = 0; i < size; ++i) {
+        sum += table[i % 16];
+    }
+    return sum;
+}
+
+// CHECK-DAG: [[DEP]] = !{i1 true}
+// CHECK-DAG: [[INDEP]] = !{i1 false}
@@ -0,0 +1,38 @@
+// Tests that checks dominated by an identical check are removed.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -flto -fsanitize=address -c -o %t.o %s
+
+// The store to a[0] is checked by the same shadow memory check as the load
+// before it. There is no write in between, so the second check is redundant.
+// RUN: opt -asap-module -asap-remove-redundant-checks -asap-sanity-level=1 -o %t.redundant.o %t.o
+// RUN: llvm-dis < %t.redundant.o | FileCheck %s
+
+// Without -asap-remove-redundant-checks, both checks are kept.
+// RUN: opt -asap-module -asap-sanity-level=1 -o %t.all.o %t.o
+// RUN: llvm-dis < %t.all.o | FileCheck --check-prefix CHECK-ALL %s
+
+// CHECK: define void @increment
+// CHECK: call void @__asan_report_load4
+// CHECK-NOT: call void @__asan_report_store4
+// CHECK: define void @increment_after_call
+// CHECK: call void @__asan_report_load4
+// CHECK: call void @__asan_report_store4
+
+// CHECK-ALL: define void @increment
+// CHECK-ALL: call void @__asan_report_load4
+// CHECK-ALL: call void @__asan_report_store4
+
+void bar(void);
+
+void increment(int *a) {
+    a[0] += 1;
+}
+
+// The call to `bar` might free `a`, so both checks are needed.
+void increment_after_call(int *a) {
+    int x = a[0];
+    bar();
+    a[0] = x + 1;
+}
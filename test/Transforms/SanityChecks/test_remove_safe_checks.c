@@ -0,0 +1,76 @@
+// Tests that -asap-remove-safe-checks removes checks of accesses that are
+// provably in bounds, and keeps all others.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -flto -fsanitize=address -c -o %t.o %s
+// RUN: opt -asap-remove-safe-checks -o %t.safe.o %t.o
+// RUN: llvm-dis < %t.safe.o | FileCheck %s
+
+// Safe checks are gone before ASAP computes costs, and do not count towards
+// the budget.
+// RUN: opt -asap-remove-safe-checks -asap-module -asap-sanity-level=1 -o %t.asap.o %t.o
+// RUN: llvm-dis < %t.asap.o | FileCheck %s
+
+// In C++, globals can have dynamic initializers. Their checks stay.
+// RUN: clang -Wall -O1 -flto -fsanitize=address -x c++ -c -o %t.cxx.o %s
+// RUN: opt -asap-remove-safe-checks -o %t.cxx.safe.o %t.cxx.o
+// RUN: llvm-dis < %t.cxx.safe.o | FileCheck %s --check-prefix=CXX
+
+int a[10] = {1, 4, 9, 16, 25, 36, 49, 64, 81, 100};
+
+// CHECK-LABEL: define i32 @loop(
+// CHECK-NOT: call void @__asan_report_load4
+// CHECK: ret i32
+int loop(int n) {
+    int sum = 0;
+    for (int i = 0; i < n && i < 10; ++i) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+// CHECK-LABEL: define i32 @guarded(
+// CHECK-NOT: call void @__asan_report_load4
+// CHECK: ret i32
+int guarded(int i) {
+    if (i >= 0 && i < 10) {
+        return a[i];
+    }
+    return 0;
+}
+
+// CHECK-LABEL: define i32 @off_by_one(
+// CHECK: call void @__asan_report_load4
+int off_by_one(int i) {
+    if (i >= 0 && i <= 10) {
+        return a[i];
+    }
+    return 0;
+}
+
+// CHECK-LABEL: define i32 @unguarded(
+// CHECK: call void @__asan_report_load4
+int unguarded(int i) {
+    return a[i];
+}
+
+// CHECK-LABEL: define i32 @pointer(
+// CHECK: call void @__asan_report_load4
+int pointer(int *p) {
+    return p[3];
+}
+
+#ifdef __cplusplus
+extern "C" int init(void);
+int b[10] = {init()};
+
+// CXX-LABEL: define i32 @dyn_init(
+// CXX: call void @__asan_report_load4
+extern "C" int dyn_init(int i) {
+    if (i >= 0 && i < 10) {
+        return b[i];
+    }
+    return 0;
+}
+#endif
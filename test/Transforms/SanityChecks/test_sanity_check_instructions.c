@@ -6,7 +6,7 @@
 
 int foo(int *a) {
     // It should recognize code that ASan inserted to load metadata...
-    // CHECK: ptrtoint i32* %a to i64, !sanitycheck
+    // CHECK: ptrtoint i32* %a to i64, !sanitycheck [[FOO_CHECK:![0-9]+]]
 
     // It should recognize the two branches (fast path and slow path) inserted
     // by ASan...
@@ -14,7 +14,7 @@ int foo(int *a) {
     // CHECK: br {{.*}}, !sanitycheck
 
     // It should recognize the aborting call, too
-    // CHECK: call void @__asan_report_load4{{.*}} !sanitycheck
+    // CHECK: call void @__asan_report_load4{{.*}} !sanitycheck [[FOO_CHECK]]
 
     // On the other hand, the final load instruction should not be recognized as check
     // CHECK-NOT: load i32* %a{{.*}} !sanitycheck
@@ -25,3 +25,6 @@ int foo(int *a) {
 int bar(int *a) {
     return a[0];
 }
+
+// Instructions are tagged with the ID of their check.
+// CHECK: [[FOO_CHECK]] = !{i64 {{-?[0-9]+}}}
@@ -0,0 +1,17 @@
+// Tests that -asap-cost-model=sched charges the latency of the whole shadow
+// check chain: shift, add, shadow load, compare and branch.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -g -flto -fsanitize=address -c -o %t.o %s
+
+// RUN: opt -analyze -sanity-check-sampled-cost %t.o | FileCheck --check-prefix CHECK-TTI %s
+// RUN: opt -analyze -sanity-check-sampled-cost -asap-cost-model=sched -asap-sched-cpu=haswell %t.o | FileCheck --check-prefix CHECK-SCHED %s
+
+// REQUIRES: x86-registered-target
+
+int foo(int *a) {
+    // CHECK-TTI: {{^ +[0-9]+ .*}}test_sched_cost_model.c:[[@LINE+2]]
+    // CHECK-SCHED: {{^ +([89]|[1-9][0-9]) .*}}test_sched_cost_model.c:[[@LINE+1]]
+    return a[0];
+}
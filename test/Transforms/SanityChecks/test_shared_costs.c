@@ -0,0 +1,64 @@
+// Tests -asap-shared-cost with UBSan checks that share instructions. Both
+// additions in `twice` compute the same overflow flag, and after
+// optimization both checks branch on it.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -fsanitize=signed-integer-overflow -fprofile-generate -o %t.gen %s
+// RUN: echo 100 | env LLVM_PROFILE_FILE=%t.profraw %t.gen
+// RUN: llvm-profdata merge -o %t.profdata %t.profraw
+// RUN: clang -Wall -O1 -flto -fsanitize=signed-integer-overflow -fprofile-use=%t.profdata -c -o %t.o %s
+
+// In a group, both checks get the cost of the whole group.
+// RUN: opt -asap-module-instrprof -asap-shared-cost=group -asap-sanity-level=1 -o %t.group1.o %t.o
+// RUN: llvm-dis < %t.group1.o | FileCheck --check-prefix CHECK-GROUP1 %s
+
+// A group is removed as a unit, without erasing shared instructions twice.
+// RUN: opt -asap-module-instrprof -asap-shared-cost=group -asap-cost-level=0 -o %t.group0.o %t.o
+// RUN: llvm-dis < %t.group0.o | FileCheck --check-prefix CHECK-REMOVED %s
+// RUN: opt -asap-instrprof -asap-shared-cost=group -asap-cost-threshold=0 -o %t.groupf.o %t.o
+// RUN: llvm-dis < %t.groupf.o | FileCheck --check-prefix CHECK-REMOVED %s
+
+// Sampling guards the group once.
+// RUN: opt -asap-module-instrprof -asap-shared-cost=group -asap-action=sample -asap-cost-level=0.5 -o %t.sample.o %t.o
+// RUN: llvm-dis < %t.sample.o | FileCheck --check-prefix CHECK-SAMPLE %s
+
+// When splitting shared costs, checks are removed one by one.
+// RUN: opt -asap-module-instrprof -asap-shared-cost=split -asap-cost-level=0 -o %t.split0.o %t.o
+// RUN: llvm-dis < %t.split0.o | FileCheck --check-prefix CHECK-REMOVED %s
+
+// CHECK-GROUP1-LABEL: define i32 @twice(
+// CHECK-GROUP1: call void @__ubsan_handle_add_overflow({{.*}}!cost [[COST:![0-9]+]]
+// CHECK-GROUP1: call void @__ubsan_handle_add_overflow({{.*}}!cost [[COST]]
+
+// CHECK-REMOVED-LABEL: define i32 @twice(
+// CHECK-REMOVED-NOT: call void @__ubsan_handle_add_overflow
+// CHECK-REMOVED: ret i32
+
+// CHECK-SAMPLE-LABEL: define i32 @twice(
+// CHECK-SAMPLE: asap.guard:
+// CHECK-SAMPLE-NOT: asap.guard{{[0-9]+}}:
+// CHECK-SAMPLE: ret i32
+
+#include <stdio.h>
+
+int last;
+
+__attribute__((noinline))
+int twice(int a, int b) {
+    int x = a + b;
+    int y = a + b;
+    last = y;
+    return x;
+}
+
+int main() {
+    int n = 0;
+    scanf("%d", &n);
+    int s = 0;
+    for (int i = 0; i < n; ++i) {
+        s ^= twice(i, n);
+    }
+    printf("%d\n", s);
+    return 0;
+}
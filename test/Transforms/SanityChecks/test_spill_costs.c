@@ -0,0 +1,16 @@
+// Tests that spill costs from -asap-spill-costs are added to check costs.
+
+// RUN: rm -rf %t %t.*
+
+// RUN: clang -Wall -O1 -g -flto -fsanitize=address -c -o %t.o %s
+// RUN: opt -sanity-check-instructions -S -o %t.ll %t.o
+// RUN: sed -n 's/^![0-9]* = !{i64 \(-\{0,1\}[0-9]*\)}$/\1 1000/p' %t.ll > %t.spills
+
+// RUN: opt -analyze -sanity-check-sampled-cost %t.o | FileCheck --check-prefix CHECK-NOSPILLS %s
+// RUN: opt -analyze -sanity-check-sampled-cost -asap-spill-costs=%t.spills %t.o | FileCheck --check-prefix CHECK-SPILLS %s
+
+int foo(int *a) {
+    // CHECK-NOSPILLS: {{^ +[0-9]{1,2} .*}}test_spill_costs.c:[[@LINE+2]]
+    // CHECK-SPILLS: {{^ +[1-9][0-9]{3} .*}}test_spill_costs.c:[[@LINE+1]]
+    return a[0];
+}
@@ -0,0 +1,66 @@
+// Tests that coverage costs can be loaded through a symbolization index
+// created by asap-symbolize-coverage.
+
+// RUN: rm -rf %t %t.*
+
+// Compile the program with trace_pc_guard, and a second binary with another
+// build ID.
+// RUN: clang -Wall -g -O2 -fsanitize-coverage=trace-pc-guard -flto -c -o %t.o %s
+// RUN: clang -Wall -g -O2 -fsanitize-coverage=trace-pc-guard -flto -Wl,--build-id=sha1 -o %t %t.o
+// RUN: clang -Wall -g -O2 -fsanitize-coverage=trace-pc-guard -flto -Wl,--build-id=0xdeadbeef -o %t.other %t.o
+
+// Write a coverage log in FUSS format, where each guard has cost 7.
+// RUN: llvm-objdump -d %t | grep 'call.*__sanitizer_cov_trace_pc_guard>' | tr -d : | awk '{print "AllTimeCounter: 0x"$1" "NR" 7"}' > %t.cov
+
+// Build the index. It starts with its magic number.
+// RUN: asap-symbolize-coverage -binary=%t -j 2 -o %t.idx %t.cov | FileCheck -check-prefix CHECK-TOOL %s
+// RUN: head -c 8 %t.idx | FileCheck -check-prefix CHECK-MAGIC %s
+// CHECK-TOOL: Symbolized [[N:[0-9]+]] of [[N]] PCs using {{[0-9]+}} threads.
+// CHECK-MAGIC: ASAPSYMX
+
+// Costs are the same with and without the index, and the index can be used
+// without the binary.
+// RUN: opt -sanity-check-coverage-cost -asap-module-name=%t -asap-coverage-file=%t.cov -analyze %t.o | FileCheck -check-prefix CHECK-COST %s
+// RUN: opt -sanity-check-coverage-cost -asap-module-name=%t -asap-coverage-file=%t.cov -asap-symbolization-index=%t.idx -analyze %t.o | FileCheck -check-prefix CHECK-COST %s
+// RUN: opt -sanity-check-coverage-cost -asap-coverage-file=%t.cov -asap-symbolization-index=%t.idx -analyze %t.o | FileCheck -check-prefix CHECK-COST %s
+
+// The index must belong to the binary.
+// RUN: not opt -sanity-check-coverage-cost -asap-module-name=%t.other -asap-coverage-file=%t.cov -asap-symbolization-index=%t.idx -analyze %t.o 2>&1 | FileCheck -check-prefix CHECK-MISMATCH %s
+// CHECK-MISMATCH: Symbolization index does not match the build ID of {{.*}}.other
+
+// Truncated indices are rejected.
+// RUN: head -c 20 %t.idx > %t.bad
+// RUN: not opt -sanity-check-coverage-cost -asap-coverage-file=%t.cov -asap-symbolization-index=%t.bad -analyze %t.o 2>&1 | FileCheck -check-prefix CHECK-BAD %s
+// CHECK-BAD: Could not open symbolization index
+
+// PCs that are missing from the index are symbolized using the binary, or
+// ignored with a warning if there is none.
+// RUN: head -n 1 %t.cov > %t.cov1
+// RUN: asap-symbolize-coverage -binary=%t -o %t.idx1 %t.cov1
+// RUN: opt -sanity-check-coverage-cost -asap-module-name=%t -asap-coverage-file=%t.cov -asap-symbolization-index=%t.idx1 -analyze %t.o 2>&1 | FileCheck -check-prefix CHECK-FALLBACK -check-prefix CHECK-COST %s
+// RUN: opt -sanity-check-coverage-cost -asap-coverage-file=%t.cov -asap-symbolization-index=%t.idx1 -analyze %t.o 2>&1 | FileCheck -check-prefix CHECK-IGNORED %s
+// CHECK-FALLBACK: warning: {{.*}}PCs are not in the symbolization index; symbolized them using
+// CHECK-IGNORED: warning: {{.*}}PCs are not in the symbolization index; their costs are ignored
+
+#include <stdio.h>
+
+int foo(int *a, int n) {
+    int sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+int a[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+// The checks inlined from foo get the cost from the log.
+// CHECK-COST: Printing analysis 'Finds costs of sanity checks' for function 'main':
+// CHECK-COST: 7 {{.*}}:50:16
+int main(int argc, char *argv[]) {
+    if (foo(a, argc) == argc * (argc + 1) / 2) {
+        return 0;
+    } else {
+        return 1;
+    }
+}
@@ -0,0 +1,137 @@
+// This file is part of ASAP.
+// Please see LICENSE.txt for copyright and licensing information.
+
+// Symbolizes all program counters in FUSS coverage logs (AllTimeCounter
+// lines) once, and writes them to an index that
+// `opt -asap-coverage -asap-symbolization-index=...` can use instead of
+// symbolizing the binary again for every translation unit.
+
+#include "llvm/DebugInfo/Symbolize/Symbolize.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/thread.h"
+#include "llvm/Transforms/SanityChecks/SymbolizationIndex.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<std::string>
+    BinaryPath("binary", cl::Required,
+               cl::desc("Binary whose program counters are symbolized"));
+
+static cl::opt<std::string> OutputPath("o", cl::Required,
+                                       cl::desc("Output index file"),
+                                       cl::value_desc("filename"));
+
+static cl::list<std::string> CoverageFiles(cl::Positional, cl::OneOrMore,
+                                           cl::desc("<coverage log files>"));
+
+static cl::opt<unsigned>
+    NumThreads("j", cl::init(0),
+               cl::desc("Number of threads (default: number of cores)"));
+
+static const char *const kInvalidFileName = "<invalid>";
+
+int main(int argc, char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj Y;
+  cl::ParseCommandLineOptions(argc, argv, "ASAP coverage symbolizer\n");
+
+  auto BuildIDOrErr = readBuildID(BinaryPath);
+  if (std::error_code EC = BuildIDOrErr.getError()) {
+    errs() << "Could not read " << BinaryPath << ": " << EC.message() << "\n";
+    return 1;
+  }
+  if (BuildIDOrErr->empty()) {
+    errs() << "Warning: " << BinaryPath
+           << " has no build ID; opt cannot check that the index matches.\n";
+  }
+
+  // Collect the unique PCs from all coverage files.
+  Regex AllTimeCounterRegex("^AllTimeCounter: (0x[0-9a-f]+) ");
+  std::set<uint64_t> UniquePCs;
+  for (const std::string &CoverageFile : CoverageFiles) {
+    auto BufOrErr = MemoryBuffer::getFile(CoverageFile);
+    if (std::error_code EC = BufOrErr.getError()) {
+      errs() << "Could not open " << CoverageFile << ": " << EC.message()
+             << "\n";
+      return 1;
+    }
+    SmallVector<StringRef, 0> Lines;
+    BufOrErr.get()->getBuffer().split(Lines, '\n', -1, false);
+    for (StringRef Line : Lines) {
+      SmallVector<StringRef, 2> Matches;
+      uint64_t PC;
+      if (AllTimeCounterRegex.match(Line, &Matches) &&
+          !Matches[1].getAsInteger(0, PC)) {
+        UniquePCs.insert(PC);
+      }
+    }
+  }
+  std::vector<uint64_t> PCs(UniquePCs.begin(), UniquePCs.end());
+
+  // Symbolize in parallel. The symbolizer is not thread safe, so every thread
+  // uses its own, for a contiguous chunk of PCs.
+  unsigned Threads = NumThreads ? NumThreads : thread::hardware_concurrency();
+  Threads = std::max(1u, std::min<unsigned>(Threads, PCs.size()));
+  size_t ChunkSize = (PCs.size() + Threads - 1) / Threads;
+  std::vector<std::pair<uint64_t, DIInliningInfo>> Entries(PCs.size());
+  std::vector<char> Symbolized(PCs.size());
+  {
+    ThreadPool Pool(Threads);
+    for (size_t Begin = 0; Begin < PCs.size(); Begin += ChunkSize) {
+      size_t End = std::min(PCs.size(), Begin + ChunkSize);
+      Pool.async([&, Begin, End]() {
+        symbolize::LLVMSymbolizer::Options SymbolizerOptions(
+            symbolize::FunctionNameKind::LinkageName,
+            /* UseSymbolTable */ true,
+            /* Demangle */ false,
+            /* RelativeAddresses */ false,
+            /* DefaultArch */ "");
+        symbolize::LLVMSymbolizer Symbolizer(SymbolizerOptions);
+        for (size_t i = Begin; i < End; ++i) {
+          auto ResOrErr = Symbolizer.symbolizeInlinedCode(BinaryPath, PCs[i]);
+          if (!ResOrErr) {
+            consumeError(ResOrErr.takeError());
+            continue;
+          }
+          Entries[i] = std::make_pair(PCs[i], ResOrErr.get());
+          Symbolized[i] = true;
+        }
+      });
+    }
+  }
+
+  // PCs that could not be symbolized get an entry without frames. opt finds
+  // them in the index and skips them, instead of symbolizing them again.
+  size_t NumSymbolized = 0;
+  for (size_t i = 0; i < Entries.size(); ++i) {
+    const DIInliningInfo &Info = Entries[i].second;
+    if (Symbolized[i] && Info.getNumberOfFrames() &&
+        Info.getFrame(0).FileName != kInvalidFileName) {
+      NumSymbolized += 1;
+    } else {
+      Entries[i] = std::make_pair(PCs[i], DIInliningInfo());
+    }
+  }
+
+  if (std::error_code EC = SymbolizationIndex::write(
+          OutputPath, *BuildIDOrErr, std::move(Entries))) {
+    errs() << "Could not write " << OutputPath << ": " << EC.message() << "\n";
+    return 1;
+  }
+  outs() << "Symbolized " << NumSymbolized << " of " << PCs.size()
+         << " PCs using " << Threads << " threads.\n";
+  return 0;
+}